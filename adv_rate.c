@@ -0,0 +1,106 @@
+/***************************************************************************//**
+ * @file adv_rate.c
+ * @brief Adaptive advertising interval.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#include "adv_rate.h"
+
+const adv_rate_profile_t adv_rate_profile_responsive = {
+  .fast_interval_ms = 100,
+  .burst_ms = 3000,
+  .idle_interval_ms = 2000,
+  .events_per_step = 4
+};
+
+const adv_rate_profile_t adv_rate_profile_balanced = {
+  .fast_interval_ms = 150,
+  .burst_ms = 2000,
+  .idle_interval_ms = 4000,
+  .events_per_step = 3
+};
+
+const adv_rate_profile_t adv_rate_profile_low_power = {
+  .fast_interval_ms = 250,
+  .burst_ms = 1000,
+  .idle_interval_ms = 8000,
+  .events_per_step = 2
+};
+
+/**************************************************************************//**
+ * Initialize the controller at the idle interval.
+ *****************************************************************************/
+void adv_rate_init(adv_rate_t *rate, const adv_rate_profile_t *profile)
+{
+  rate->profile = profile;
+  rate->interval_ms = profile->idle_interval_ms;
+}
+
+/**************************************************************************//**
+ * Start a burst at the fast interval.
+ *****************************************************************************/
+uint16_t adv_rate_changed(adv_rate_t *rate)
+{
+  rate->interval_ms = rate->profile->fast_interval_ms;
+  return rate->interval_ms;
+}
+
+/**************************************************************************//**
+ * Duration of the current interval: the burst, then events_per_step events.
+ *****************************************************************************/
+uint32_t adv_rate_step_ms(const adv_rate_t *rate)
+{
+  if (rate->interval_ms >= rate->profile->idle_interval_ms) {
+    return ADV_RATE_NO_STEP;
+  }
+  if (rate->interval_ms == rate->profile->fast_interval_ms) {
+    return rate->profile->burst_ms;
+  }
+  return (uint32_t)rate->interval_ms * rate->profile->events_per_step;
+}
+
+/**************************************************************************//**
+ * Double the interval, up to the idle interval.
+ *****************************************************************************/
+uint16_t adv_rate_step(adv_rate_t *rate)
+{
+  uint32_t interval = 2 * (uint32_t)rate->interval_ms;
+
+  if (interval > rate->profile->idle_interval_ms) {
+    interval = rate->profile->idle_interval_ms;
+  }
+  rate->interval_ms = (uint16_t)interval;
+  return rate->interval_ms;
+}
+
+/**************************************************************************//**
+ * Current advertising interval.
+ *****************************************************************************/
+uint16_t adv_rate_get_interval(const adv_rate_t *rate)
+{
+  return rate->interval_ms;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************//**
+ * @file adv_rate.h
+ * @brief Adaptive advertising interval.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#ifndef ADV_RATE_H
+#define ADV_RATE_H
+
+#include <stdint.h>
+
+// Returned by adv_rate_step_ms() once the idle interval is reached.
+#define ADV_RATE_NO_STEP  0xFFFFFFFF
+
+// Advertising rate profile: after a change, the fast interval is used for
+// burst_ms, then the interval doubles after every events_per_step advertising
+// events, up to the idle interval.
+typedef struct {
+  uint16_t fast_interval_ms;  // interval of the burst following a change
+  uint16_t burst_ms;          // duration of the burst
+  uint16_t idle_interval_ms;  // interval reached when nothing changes
+  uint8_t events_per_step;    // advertising events at each back-off interval
+} adv_rate_profile_t;
+
+// Controller state.
+typedef struct {
+  const adv_rate_profile_t *profile;
+  uint16_t interval_ms;       // current interval
+} adv_rate_t;
+
+// Predefined profiles.
+// 100 ms interval for a 3 s burst, 2 s idle
+extern const adv_rate_profile_t adv_rate_profile_responsive;
+// 150 ms interval for a 2 s burst, 4 s idle
+extern const adv_rate_profile_t adv_rate_profile_balanced;
+// 250 ms interval for a 1 s burst, 8 s idle
+extern const adv_rate_profile_t adv_rate_profile_low_power;
+
+/**************************************************************************//**
+ * Initialize the controller at the idle interval.
+ *
+ * @param[out] rate Controller.
+ * @param[in] profile Profile used by the controller.
+ *****************************************************************************/
+void adv_rate_init(adv_rate_t *rate, const adv_rate_profile_t *profile);
+
+/**************************************************************************//**
+ * A significant change is advertised: start a burst.
+ *
+ * @return Advertising interval in ms.
+ *****************************************************************************/
+uint16_t adv_rate_changed(adv_rate_t *rate);
+
+/**************************************************************************//**
+ * Duration of the current interval before the next step of the back-off.
+ *
+ * @return Duration in ms, ADV_RATE_NO_STEP at the idle interval.
+ *****************************************************************************/
+uint32_t adv_rate_step_ms(const adv_rate_t *rate);
+
+/**************************************************************************//**
+ * Next step of the back-off, once adv_rate_step_ms() elapsed: the interval
+ * doubles, up to the idle interval.
+ *
+ * @return Advertising interval in ms.
+ *****************************************************************************/
+uint16_t adv_rate_step(adv_rate_t *rate);
+
+/**************************************************************************//**
+ * Current advertising interval.
+ *
+ * @return Advertising interval in ms.
+ *****************************************************************************/
+uint16_t adv_rate_get_interval(const adv_rate_t *rate);
+
+#endif // ADV_RATE_H
@@ -0,0 +1,162 @@
+/***************************************************************************//**
+ * @file adv_rate_sim.c
+ * @brief Host simulation of the adaptive advertising interval.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include "adv_rate_sim.h"
+
+#define NEVER           UINT64_MAX
+// Random delay added to each advertising event by the link layer.
+#define ADV_DELAY_MAX_US 10000
+
+static uint32_t random_state;
+
+/**************************************************************************//**
+ * xorshift32 pseudo-random numbers, reproducible for a given seed.
+ *****************************************************************************/
+static uint32_t random_next(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static uint64_t adv_delay_us(void)
+{
+  return random_next() % (ADV_DELAY_MAX_US + 1);
+}
+
+/**************************************************************************//**
+ * Time at which a change is advertised: the next measurement after it.
+ *****************************************************************************/
+static uint64_t detection_us(const adv_rate_sim_config_t *config, uint16_t index)
+{
+  uint64_t change_us = (uint64_t)config->changes_ms[index] * 1000;
+  uint64_t interval_us = (uint64_t)config->measurement_ms * 1000;
+
+  if (interval_us == 0) {
+    return change_us;
+  }
+  return (change_us + interval_us - 1) / interval_us * interval_us;
+}
+
+/**************************************************************************//**
+ * Simulate the advertising events.
+ *****************************************************************************/
+void adv_rate_simulate(const adv_rate_sim_config_t *config,
+                       adv_rate_sim_result_t *result)
+{
+  adv_rate_t rate;
+  uint64_t duration_us = (uint64_t)config->duration_ms * 1000;
+  uint64_t next_event_us;
+  uint64_t next_step_us = NEVER;
+  uint64_t next_change_us;
+  uint64_t change_us;
+  uint64_t now_us;
+  uint64_t radio_us = 0;
+  uint64_t latency_sum_us = 0;
+  // changes not received yet: count, sum and oldest of their times
+  uint16_t pending = 0;
+  uint64_t pending_sum_us = 0;
+  uint64_t pending_oldest_us = 0;
+  uint16_t change_index = 0;
+  uint32_t step_ms;
+  uint16_t interval_ms;
+
+  memset(result, 0, sizeof(*result));
+  random_state = config->seed ? config->seed : 1;
+  adv_rate_init(&rate, config->profile);
+  next_event_us = adv_delay_us();
+
+  for (;; ) {
+    next_change_us = (change_index < config->change_count)
+                     ? detection_us(config, change_index)
+                     : NEVER;
+    now_us = next_event_us;
+    if (next_change_us <= now_us) {
+      now_us = next_change_us;
+    }
+    if (next_step_us < now_us) {
+      now_us = next_step_us;
+    }
+    if (now_us >= duration_us) {
+      break;
+    }
+
+    if (now_us == next_change_us || now_us == next_step_us) {
+      interval_ms = adv_rate_get_interval(&rate);
+      if (now_us == next_change_us) {
+        // the new data is advertised right away, at the fast interval; the
+        // latency counts from the change itself
+        change_us = (uint64_t)config->changes_ms[change_index] * 1000;
+        change_index++;
+        if (pending == 0) {
+          pending_oldest_us = change_us;
+        }
+        pending++;
+        pending_sum_us += change_us;
+        adv_rate_changed(&rate);
+      } else {
+        adv_rate_step(&rate);
+      }
+      step_ms = adv_rate_step_ms(&rate);
+      next_step_us = (step_ms == ADV_RATE_NO_STEP)
+                     ? NEVER : now_us + (uint64_t)step_ms * 1000;
+      // a new interval applies once the advertising is restarted
+      if (adv_rate_get_interval(&rate) != interval_ms) {
+        next_event_us = now_us + adv_delay_us();
+      }
+      continue;
+    }
+
+    // advertising event
+    result->events++;
+    radio_us += config->event_us;
+    if (pending && (random_next() % 100) < config->receive_percent) {
+      latency_sum_us += pending * now_us - pending_sum_us;
+      if ((now_us - pending_oldest_us) / 1000 > result->max_latency_ms) {
+        result->max_latency_ms = (uint32_t)((now_us - pending_oldest_us) / 1000);
+      }
+      result->received += pending;
+      pending = 0;
+      pending_sum_us = 0;
+    }
+    next_event_us = now_us + (uint64_t)adv_rate_get_interval(&rate) * 1000
+                    + adv_delay_us();
+  }
+
+  if (result->events) {
+    result->mean_interval_ms = (float)config->duration_ms / result->events;
+  }
+  result->duty_cycle = (float)radio_us / (float)duration_us;
+  if (result->received) {
+    result->mean_latency_ms = (float)latency_sum_us / result->received / 1000.0f;
+  }
+}
@@ -0,0 +1,84 @@
+/***************************************************************************//**
+ * @file adv_rate_sim.h
+ * @brief Host simulation of the adaptive advertising interval.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#ifndef ADV_RATE_SIM_H
+#define ADV_RATE_SIM_H
+
+// Runs the advertising rate controller against a timeline of weight changes
+// and a lossy scanner, off-target. Not part of the firmware build.
+
+#include <stdint.h>
+#include "adv_rate.h"
+
+// Radio time of a legacy advertising event with len bytes of advertising
+// data: the packet on the 3 primary channels, plus the ramp-up and the
+// listening for requests after each of them.
+#define ADV_RATE_SIM_CHANNEL_OVERHEAD_US  300
+#define ADV_RATE_SIM_EVENT_US(len) \
+  (3 * (((len) + 16) * 8 + ADV_RATE_SIM_CHANNEL_OVERHEAD_US))
+
+// Simulation parameters.
+typedef struct {
+  const adv_rate_profile_t *profile;
+  uint32_t duration_ms;           // simulated time
+  const uint32_t *changes_ms;     // times of the weight changes, ascending
+  uint16_t change_count;
+  uint32_t measurement_ms;        // interval of the measurements detecting the
+                                  // changes, 0 to advertise them right away
+  uint32_t event_us;              // radio time of an advertising event
+  uint8_t receive_percent;        // probability of an event being received
+  uint32_t seed;                  // seed of the advertising delay and losses
+} adv_rate_sim_config_t;
+
+// Simulation results.
+typedef struct {
+  uint32_t events;                // advertising events
+  float mean_interval_ms;         // simulated time per event
+  float duty_cycle;               // radio time / simulated time
+  float mean_latency_ms;          // from a weight change to the first received
+                                  // event
+  uint32_t max_latency_ms;
+  uint16_t received;              // changes received before the end
+} adv_rate_sim_result_t;
+
+/**************************************************************************//**
+ * Simulate the advertising events. As in the application, a weight change is
+ * advertised from the next periodic measurement, and a change of the interval
+ * restarts the advertising: at the fast interval on a change, then at each step
+ * of the back-off. Each event comes with the random advertising delay of 0 to
+ * 10 ms, and is received with the probability receive_percent.
+ *
+ * @param[in] config Simulation parameters.
+ * @param[out] result Simulation results.
+ *****************************************************************************/
+void adv_rate_simulate(const adv_rate_sim_config_t *config,
+                       adv_rate_sim_result_t *result);
+
+#endif // ADV_RATE_SIM_H
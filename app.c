@@ -28,15 +28,21 @@
  *
  ******************************************************************************/
 #include <stdbool.h>
+#include <string.h>
 #include "sl_status.h"
 #include "sl_simple_button_instances.h"
 #include "app_timer.h"
+#include "sl_sleeptimer.h"
 #include "app_assert.h"
 #include "sl_bluetooth.h"
 #include "app.h"
 #include "gatt_db.h"
 #include "hx711.h"
+#include "hx711_power.h"
 #include "bthome_v2.h"
+#include "adv_rate.h"
+#include "calibration.h"
+#include "profile.h"
 #include "sl_component_catalog.h"
 #if defined(SL_CATALOG_APP_LOG_PRESENT)
 #include "app_log.h"
@@ -49,8 +55,86 @@
 #define TARE_DELAY_MS                2000
 #define DEFAULT_SCALE                375
 #define AVERAGE_COUNT                5
+// adaptive averaging of the measurements: stop when the mean is known within +/- MASS_RESOLUTION_MG
+#define AVERAGE_MIN_COUNT            2
+#define AVERAGE_MAX_COUNT            AVERAGE_COUNT
+#define MASS_RESOLUTION_MG           1000
+// auto-zero tracking: an empty scale drifting less than AUTOZERO_WINDOW_MG for AUTOZERO_HOLD_MS is zeroed
+#define AUTOZERO_WINDOW_MG           1000
+#define AUTOZERO_HOLD_MS             30000
+#define AUTOZERO_SHIFT               2
+// validation of the readings: a single reading jumping more than VALIDATION_SPIKE_COUNTS
+// or VALIDATION_STUCK_COUNT identical readings in a row are dropped
+#define VALIDATION_SPIKE_COUNTS      20000
+#define VALIDATION_STUCK_COUNT       8
+// change-driven advertising: a measurement within +/- ADVERTISING_DEADBAND_MG of the advertised one
+// leaves the advertising data as it is, unless it is older than ADVERTISING_HEARTBEAT_MS
+#define ADVERTISING_DEADBAND_MG      1000
+#define ADVERTISING_HEARTBEAT_MS     60000
+// advertising interval: a burst at a short interval after a change, backing off to a long interval
+#define ADVERTISING_RATE_PROFILE     adv_rate_profile_balanced
+
+// Requests served by the next measurement
+#define MEASUREMENT_REQUEST_LOG        (1 << 0)
+#define MEASUREMENT_REQUEST_BOOT       (1 << 1)
+#define MEASUREMENT_REQUEST_ADVERTISE  (1 << 2)
+#define MEASUREMENT_REQUEST_INDICATE   (1 << 3)
+#define MEASUREMENT_REQUEST_READ       (1 << 4)
+#define MEASUREMENT_REQUEST_CALIBRATE  (1 << 5)
+
+// External signals raised by the HX711 completion callbacks
+#define SIGNAL_MEASUREMENT_DONE        (1 << 0)
+#define SIGNAL_TARE_DONE               (1 << 1)
+
+#define MAX_PENDING_READS              4
+
+// Health characteristic: the counters and the status of hx711_health_t, without padding
+#define HEALTH_LEN                     (6 * sizeof(uint32_t) + 1)
+
+// ATT error codes of the calibration procedure, the long reads and the deferred reads
+#define ATT_ERR_SUCCESS                0x00
+#define ATT_ERR_INVALID_OFFSET         0x07
+#define ATT_ERR_INVALID_LENGTH         0x0D
+#define ATT_ERR_INSUFFICIENT_RESOURCES 0x11
+#define ATT_ERR_PROCEDURE_FAILED       0x80
+#define ATT_ERR_UNKNOWN_OPCODE         0x81
 
 static uint8_t device_name[] = "Mass";
+// All the measurement objects in one extended advertising event, if supported
+static bool extended_advertising = false;
+static uint8_t packet_id = 0;
+static int32_t advertised_mg;
+static uint64_t advertised_tick;
+static adv_rate_t adv_rate;
+// The advertising could not start yet: it is tried again with each advertising measurement.
+static bool advertising_started = false;
+
+// Asynchronous HX711 operations: only one runs at a time, a pending tare goes first.
+static bool hx711_active = false;
+static bool tare_requested = false;
+static uint8_t measurement_requests = 0;
+static uint8_t measurement_serving = 0;
+static hx711_measurement_t measurement;
+static uint8_t tare_status;
+
+// HX711 power policy, driven by the deadlines of the measurement and tare timers.
+static hx711_power_t power;
+static uint32_t measurement_interval_ms = 0; // 0 while the measurement timer is stopped
+static uint64_t measurement_timer_start_tick;
+static bool tare_delayed = false;
+static uint64_t tare_deadline_tick;
+
+// Calibration points are captured from the output of this filter.
+static hx711_filter_t filter;
+static int32_t calibration_reference_mg;
+
+// GATT reads of the mass waiting for the measurement.
+typedef struct {
+  uint8_t connection;
+  uint16_t characteristic;
+} pending_read_t;
+static pending_read_t pending_reads[MAX_PENDING_READS];
+static uint8_t pending_read_count = 0;
 
 // Button state.
 static volatile bool tare_button_pressed = false;
@@ -59,12 +143,34 @@ static volatile bool on_off_button_pressed = false;
 // Timers and their callbacks
 static app_timer_t measurement_timer;
 static app_timer_t tare_timer;
+static app_timer_t wake_timer;
+static app_timer_t adv_rate_timer;
 static void measurement_indication_cb(app_timer_t *timer, void *data);
 static void measurement_advertising_cb(app_timer_t *timer, void *data);
 static void tare_timer_cb(app_timer_t *timer, void *data);
+static void wake_timer_cb(app_timer_t *timer, void *data);
+static void adv_rate_timer_cb(app_timer_t *timer, void *data);
+static void adv_rate_timer_start(void);
+static void measurement_timer_start(uint32_t interval_ms, app_timer_callback_t callback);
+static void measurement_timer_stop(void);
+static uint32_t next_deadline_ms(void);
+static void power_release(void);
 
 static void measurement_indication_changed_cb(sl_bt_gatt_client_config_flag_t client_config);
-static float get_mass(void);
+static void request_measurement(uint8_t request);
+static void request_tare(void);
+static void start_next_operation(void);
+static void measurement_done_cb(hx711_t *dev, const hx711_measurement_t *result);
+static void tare_done_cb(hx711_t *dev, const hx711_measurement_t *result);
+static void measurement_ready(void);
+static void tare_ready(void);
+static void read_requested(uint8_t connection, uint16_t characteristic);
+static void read_cancel(uint8_t connection);
+static void read_respond(uint8_t att_errorcode, int32_t mass);
+static uint8_t calibration_write(const uint8_t *data, uint8_t len);
+static void calibration_capture(void);
+static bool advertising_changed(int32_t mg);
+static bool advertising_heartbeat_due(void);
 
 /**************************************************************************//**
  * Application Init.
@@ -72,13 +178,26 @@ static float get_mass(void);
 void app_init(void)
 {
   app_log("BTHome v2 scale\n");
+  profile_init();
   HX711_init(128);
   app_log("HX711_init done\n");
-  HX711_tare(AVERAGE_COUNT);
-  app_log("HX711_tare done\n");
-  HX711_set_scale(DEFAULT_SCALE);
-  app_log("HX711_set_scale done\n");
-  HX711_power_down();
+  // The temperature coefficients are needed by the tare.
+  if (calibration_init(DEFAULT_SCALE)) {
+    app_log("calibration table loaded\n");
+  } else {
+    app_log("default scale used\n");
+  }
+  if (HX711_tare(AVERAGE_COUNT)) {
+    app_log("HX711_tare done\n");
+  } else {
+    app_log("HX711_tare timed out\n");
+  }
+  hx711_filter_init_median(&filter, AVERAGE_COUNT);
+  hx711_set_filter(HX711_get_default(), &filter);
+  HX711_set_autozero(AUTOZERO_WINDOW_MG, AUTOZERO_HOLD_MS, AUTOZERO_SHIFT);
+  HX711_set_validation(VALIDATION_SPIKE_COUNTS, VALIDATION_STUCK_COUNT);
+  hx711_power_init(&power, HX711_get_default());
+  power_release();
 }
 
 /**************************************************************************//**
@@ -99,12 +218,20 @@ void app_process_action(void)
                                      NULL,
                                      false);
     app_assert_status(sc);
+    tare_delayed = true;
+    tare_deadline_tick = sl_sleeptimer_get_tick_count64()
+                         + sl_sleeptimer_ms_to_tick(TARE_DELAY_MS);
+    power_release();
   }
   if (on_off_button_pressed) {
     on_off_button_pressed = false;
-    // Just log the mass
-    (void)get_mass();
+    // Just log the mass, and the timing of the hot paths if profiling is enabled
+    request_measurement(MEASUREMENT_REQUEST_LOG);
+    profile_dump();
   }
+  // Idle: the encryption of the next packets is precomputed, so that the
+  // packet is built right when the measurement is ready
+  bthome_v2_prepare();
 }
 
 /**************************************************************************//**
@@ -151,37 +278,31 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       
       sc = bthome_v2_init(device_name, false, NULL, false);
       app_assert_status(sc);
-
-      bthome_v2_add_measurement_float(ID_MASS, get_mass());
-      sc = bthome_v2_send_packet();
+      extended_advertising =
+        (bthome_v2_set_extended_advertising(true) == SL_STATUS_OK);
+      adv_rate_init(&adv_rate, &ADVERTISING_RATE_PROFILE);
+      sc = bthome_v2_set_interval(adv_rate_get_interval(&adv_rate));
       app_assert_status(sc);
 
-      sc = app_timer_start(&measurement_timer,
-                           MEASUREMENT_INTERVAL_ADV_MS,
-                           measurement_advertising_cb,
-                           NULL,
-                           true);
-      app_assert_status(sc);
+      // The advertising starts once the first measurement is done.
+      request_measurement(MEASUREMENT_REQUEST_BOOT);
+
+      measurement_timer_start(MEASUREMENT_INTERVAL_ADV_MS, measurement_advertising_cb);
       break;
 
     // -------------------------------
     // This event indicates that a new connection was opened.
     case sl_bt_evt_connection_opened_id:
       app_log("Connection opened\n");
-      sc = app_timer_stop(&measurement_timer);
-      app_assert_status(sc);
+      measurement_timer_stop();
       break;
 
     // -------------------------------
     // This event indicates that a connection was closed.
     case sl_bt_evt_connection_closed_id:
       app_log("Connection closed\n");
-      sc = app_timer_start(&measurement_timer,
-                           MEASUREMENT_INTERVAL_ADV_MS,
-                           measurement_advertising_cb,
-                           NULL,
-                           true);
-      app_assert_status(sc);
+      read_cancel(evt->data.evt_connection_closed.connection);
+      measurement_timer_start(MEASUREMENT_INTERVAL_ADV_MS, measurement_advertising_cb);
       // Update advertising data
       measurement_advertising_cb(&measurement_timer, NULL);
       break;
@@ -198,18 +319,71 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     
     case sl_bt_evt_gatt_server_user_read_request_id:
       if (evt->data.evt_gatt_server_user_read_request.characteristic == gattdb_mass) {
-        float mass = get_mass();
-        int32_t mass_int = (int32_t)mass;
+        // The response is sent when the measurement is done.
+        read_requested(evt->data.evt_gatt_server_user_read_request.connection,
+                       evt->data.evt_gatt_server_user_read_request.characteristic);
+      } else if (evt->data.evt_gatt_server_user_read_request.characteristic == gattdb_health) {
+        hx711_health_t health;
+        HX711_get_health(&health);
+        sc = sl_bt_gatt_server_send_user_read_response(
+            evt->data.evt_gatt_server_user_read_request.connection,
+            evt->data.evt_gatt_server_user_read_request.characteristic,
+            ATT_ERR_SUCCESS,
+            HEALTH_LEN,
+            (uint8_t *)&health,
+            NULL);
+      } else if (evt->data.evt_gatt_server_user_read_request.characteristic == gattdb_calibration) {
+        uint8_t points[1 + CALIBRATION_MAX_POINTS * 8];
+        size_t len = calibration_get_points(points, sizeof(points));
+        sc = sl_bt_gatt_server_send_user_read_response(
+            evt->data.evt_gatt_server_user_read_request.connection,
+            evt->data.evt_gatt_server_user_read_request.characteristic,
+            ATT_ERR_SUCCESS,
+            len,
+            points,
+            NULL);
+      } else if (evt->data.evt_gatt_server_user_read_request.characteristic == gattdb_profile) {
+        // The table is longer than the ATT MTU, it is read with long reads.
+        uint8_t table[PROFILE_SERIALIZED_LEN];
+        size_t len = profile_serialize(table, sizeof(table));
+        size_t offset = evt->data.evt_gatt_server_user_read_request.offset;
+        uint8_t att_err = ATT_ERR_SUCCESS;
+        if (offset > len) {
+          att_err = ATT_ERR_INVALID_OFFSET;
+          offset = len;
+        }
         sc = sl_bt_gatt_server_send_user_read_response(
             evt->data.evt_gatt_server_user_read_request.connection,
             evt->data.evt_gatt_server_user_read_request.characteristic,
-            SL_STATUS_OK,
-            sizeof(mass_int),
-            (uint8_t *)&mass_int,
+            att_err,
+            len - offset,
+            table + offset,
             NULL);
       }
       break;
 
+    case sl_bt_evt_gatt_server_user_write_request_id:
+      if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_calibration) {
+        uint8_t att_err = calibration_write(evt->data.evt_gatt_server_user_write_request.value.data,
+                                            evt->data.evt_gatt_server_user_write_request.value.len);
+        sc = sl_bt_gatt_server_send_user_write_response(
+            evt->data.evt_gatt_server_user_write_request.connection,
+            evt->data.evt_gatt_server_user_write_request.characteristic,
+            att_err);
+      }
+      break;
+
+    // -------------------------------
+    // This event indicates that an HX711 operation has completed.
+    case sl_bt_evt_system_external_signal_id:
+      if (evt->data.evt_system_external_signal.extsignals & SIGNAL_TARE_DONE) {
+        tare_ready();
+      }
+      if (evt->data.evt_system_external_signal.extsignals & SIGNAL_MEASUREMENT_DONE) {
+        measurement_ready();
+      }
+      break;
+
     // -------------------------------
     // Default event handler.
     default:
@@ -222,23 +396,17 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
  *****************************************************************************/
 static void measurement_indication_changed_cb(sl_bt_gatt_client_config_flag_t client_config)
 {
-  sl_status_t sc;
   // Indication or notification enabled.
   if (sl_bt_gatt_disable != client_config) {
     // Start timer used for periodic indications.
-    sc = app_timer_start(&measurement_timer,
-                         MEASUREMENT_INTERVAL_IND_MS,
-                         measurement_indication_cb,
-                         NULL,
-                         true);
-    app_assert_status(sc);
+    measurement_timer_start(MEASUREMENT_INTERVAL_IND_MS, measurement_indication_cb);
     // Send first indication.
     measurement_indication_cb(&measurement_timer, NULL);
   }
   // Indications disabled.
   else {
     // Stop timer used for periodic indications.
-    (void)app_timer_stop(&measurement_timer);
+    measurement_timer_stop();
   }
 }
 
@@ -263,35 +431,451 @@ static void measurement_indication_cb(app_timer_t *timer, void *data)
 {
   (void)data;
   (void)timer;
-  int32_t mass_int = (int32_t)get_mass();
-  sl_bt_gatt_server_notify_all(gattdb_mass, sizeof(mass_int), (uint8_t *)&mass_int);
+  request_measurement(MEASUREMENT_REQUEST_INDICATE);
 }
 
 static void measurement_advertising_cb(app_timer_t *timer, void *data)
 {
   (void)data;
   (void)timer;
-  float mass = get_mass();
-  bthome_v2_reset_measurement();
-  bthome_v2_add_measurement_float(ID_MASS, mass);
-  bthome_v2_build_packet();
+  request_measurement(MEASUREMENT_REQUEST_ADVERTISE);
 }
 
 static void tare_timer_cb(app_timer_t *timer, void *data)
 {
   (void)data;
   (void)timer;
-  HX711_power_up();
-  HX711_tare(AVERAGE_COUNT);
-  HX711_power_down();
-  app_log("tare done\n");
+  tare_delayed = false;
+  request_tare();
+}
+
+static void wake_timer_cb(app_timer_t *timer, void *data)
+{
+  (void)data;
+  (void)timer;
+  hx711_power_wake(&power);
+}
+
+/**************************************************************************//**
+ * Back-off of the advertising interval after a change, one step per timeout
+ * until the idle interval is reached.
+ *****************************************************************************/
+static void adv_rate_timer_cb(app_timer_t *timer, void *data)
+{
+  sl_status_t sc;
+  (void)data;
+  (void)timer;
+
+  sc = bthome_v2_set_interval(adv_rate_step(&adv_rate));
+  app_assert_status(sc);
+  adv_rate_timer_start();
+}
+
+static void adv_rate_timer_start(void)
+{
+  sl_status_t sc;
+  uint32_t step_ms = adv_rate_step_ms(&adv_rate);
+
+  if (step_ms == ADV_RATE_NO_STEP) {
+    (void)app_timer_stop(&adv_rate_timer);
+  } else {
+    sc = app_timer_start(&adv_rate_timer,
+                         step_ms,
+                         adv_rate_timer_cb,
+                         NULL,
+                         false);
+    app_assert_status(sc);
+  }
+}
+
+/**************************************************************************//**
+ * Start or stop the periodic measurement timer, keeping track of its deadlines
+ * for the power policy.
+ *****************************************************************************/
+static void measurement_timer_start(uint32_t interval_ms, app_timer_callback_t callback)
+{
+  sl_status_t sc = app_timer_start(&measurement_timer,
+                                   interval_ms,
+                                   callback,
+                                   NULL,
+                                   true);
+  app_assert_status(sc);
+  measurement_interval_ms = interval_ms;
+  measurement_timer_start_tick = sl_sleeptimer_get_tick_count64();
+  power_release();
+}
+
+static void measurement_timer_stop(void)
+{
+  (void)app_timer_stop(&measurement_timer);
+  measurement_interval_ms = 0;
+  power_release();
+}
+
+/**************************************************************************//**
+ * Time until the next HX711 operation is due, in ms: 0 if one is waiting to
+ * start, HX711_POWER_NO_DEADLINE if none is scheduled.
+ *****************************************************************************/
+static uint32_t next_deadline_ms(void)
+{
+  uint64_t now = sl_sleeptimer_get_tick_count64();
+  uint64_t ms;
+  uint32_t next = HX711_POWER_NO_DEADLINE;
+
+  if (tare_requested || measurement_requests) {
+    return 0;
+  }
+  if (measurement_interval_ms) {
+    // The periodic timer fires on multiples of the interval since its start.
+    (void)sl_sleeptimer_tick64_to_ms(now - measurement_timer_start_tick, &ms);
+    next = measurement_interval_ms - (uint32_t)(ms % measurement_interval_ms);
+  }
+  if (tare_delayed) {
+    ms = 0;
+    if (tare_deadline_tick > now) {
+      (void)sl_sleeptimer_tick64_to_ms(tare_deadline_tick - now, &ms);
+    }
+    if ((uint32_t)ms < next) {
+      next = (uint32_t)ms;
+    }
+  }
+  return next;
+}
+
+/**************************************************************************//**
+ * Hand the idle HX711 over to the power policy: it is powered down unless the
+ * next deadline is closer than its settling time, and the wake timer powers it
+ * up again one settling time before the deadline.
+ *****************************************************************************/
+static void power_release(void)
+{
+  sl_status_t sc;
+  uint32_t wake_ms;
+
+  if (hx711_active) {
+    return;
+  }
+  wake_ms = hx711_power_release(&power, next_deadline_ms());
+  if (wake_ms == HX711_POWER_NO_DEADLINE) {
+    (void)app_timer_stop(&wake_timer);
+  } else {
+    sc = app_timer_start(&wake_timer,
+                         wake_ms,
+                         wake_timer_cb,
+                         NULL,
+                         false);
+    app_assert_status(sc);
+  }
+}
+
+/**************************************************************************//**
+ * Queue a measurement request. Requests arriving before the measurement starts
+ * are served by the same measurement.
+ *****************************************************************************/
+static void request_measurement(uint8_t request)
+{
+  measurement_requests |= request;
+  start_next_operation();
+}
+
+static void request_tare(void)
+{
+  tare_requested = true;
+  start_next_operation();
+}
+
+/**************************************************************************//**
+ * Start the next HX711 operation, if none is running. The conversions are done
+ * from the DOUT interrupt, so this returns immediately.
+ *****************************************************************************/
+static void start_next_operation(void)
+{
+  bool started;
+
+  if (hx711_active) {
+    return;
+  }
+  if (tare_requested) {
+    tare_requested = false;
+    (void)hx711_power_acquire(&power);
+    started = HX711_tare_async(AVERAGE_COUNT, tare_done_cb);
+  } else if (measurement_requests) {
+    measurement_serving = measurement_requests;
+    measurement_requests = 0;
+    if (measurement_serving & MEASUREMENT_REQUEST_CALIBRATE) {
+      // Only the readings of the reference weight count.
+      hx711_filter_reset(&filter);
+    }
+    (void)hx711_power_acquire(&power);
+    started = HX711_measure_async(MASS_RESOLUTION_MG,
+                                  AVERAGE_MIN_COUNT,
+                                  AVERAGE_MAX_COUNT,
+                                  measurement_done_cb);
+  } else {
+    return;
+  }
+  app_assert(started, "HX711 busy\n");
+  hx711_active = true;
+}
+
+/**************************************************************************//**
+ * HX711 completion callbacks, called from interrupt context.
+ * The result is handed over to the Bluetooth event loop.
+ *****************************************************************************/
+static void measurement_done_cb(hx711_t *dev, const hx711_measurement_t *result)
+{
+  (void)dev;
+  measurement = *result;
+  sl_bt_external_signal(SIGNAL_MEASUREMENT_DONE);
+}
+
+static void tare_done_cb(hx711_t *dev, const hx711_measurement_t *result)
+{
+  (void)dev;
+  tare_status = result->status;
+  sl_bt_external_signal(SIGNAL_TARE_DONE);
+}
+
+static void tare_ready(void)
+{
+  hx711_active = false;
+  if (tare_status) {
+    // The offset is left as it was.
+    app_log("tare failed: 0x%02x\n", tare_status);
+  } else {
+    app_log("tare done\n");
+  }
+  start_next_operation();
+  power_release();
+}
+
+/**************************************************************************//**
+ * Serve the requests waiting for the measurement.
+ *****************************************************************************/
+static void measurement_ready(void)
+{
+  sl_status_t sc;
+  float mass = measurement.mg / 1000.0f;
+  int32_t mass_int = (int32_t)mass;
+  uint8_t served = measurement_serving;
+  bool start;
+  bool changed;
+
+  hx711_active = false;
+  measurement_serving = 0;
+  if (measurement.status) {
+    // No reading came, e.g. the HX711 is disconnected: the reads fail, and
+    // the advertising goes on with the last mass until a measurement succeeds.
+    app_log("measurement failed: 0x%02x\n", measurement.status);
+    if (served & MEASUREMENT_REQUEST_READ) {
+      read_respond(ATT_ERR_PROCEDURE_FAILED, 0);
+    }
+    start_next_operation();
+    power_release();
+    return;
+  }
+
+  PROFILE_START(PROFILE_MEASUREMENT_READY);
+  app_log("mass: %f (%u samples, std dev %ld mg)\n",
+          mass,
+          measurement.count,
+          (long)measurement.stddev_mg);
+
+  start = !advertising_started
+          && (served & (MEASUREMENT_REQUEST_BOOT | MEASUREMENT_REQUEST_ADVERTISE));
+  changed = start || advertising_changed(measurement.mg);
+  if (start
+      || ((served & MEASUREMENT_REQUEST_ADVERTISE)
+          && (changed || advertising_heartbeat_due()))) {
+    advertised_mg = measurement.mg;
+    advertised_tick = sl_sleeptimer_get_tick_count64();
+    bthome_v2_reset_measurement();
+    // the packet id tells the receivers an update from a repeated packet
+    bthome_v2_add_measurement(ID_PACKET, packet_id++);
+    bthome_v2_add_measurement_float(ID_MASS, mass);
+    if (extended_advertising) {
+      // the number of readings averaged
+      bthome_v2_add_measurement(ID_COUNT, measurement.count);
+    }
+    if (start) {
+      // e.g. no encryption counter value could be reserved on a worn out
+      // flash: the device keeps running and tries again later
+      sc = bthome_v2_send_packet();
+      advertising_started = (sc == SL_STATUS_OK);
+      if (!advertising_started) {
+        app_log("advertising not started: 0x%04lx\n", (unsigned long)sc);
+      }
+    } else {
+      sc = bthome_v2_build_packet();
+      if (sc != SL_STATUS_OK) {
+        app_log("advertising data not updated: 0x%04lx\n", (unsigned long)sc);
+      }
+    }
+    if (changed) {
+      // new data: advertise it at the fast interval for a while
+      sc = bthome_v2_set_interval(adv_rate_changed(&adv_rate));
+      app_assert_status(sc);
+      adv_rate_timer_start();
+    }
+  }
+  if (served & MEASUREMENT_REQUEST_INDICATE) {
+    sl_bt_gatt_server_notify_all(gattdb_mass, sizeof(mass_int), (uint8_t *)&mass_int);
+  }
+  if (served & MEASUREMENT_REQUEST_CALIBRATE) {
+    calibration_capture();
+  }
+  if (served & MEASUREMENT_REQUEST_READ) {
+    read_respond(ATT_ERR_SUCCESS, mass_int);
+  }
+  PROFILE_STOP(PROFILE_MEASUREMENT_READY);
+
+  start_next_operation();
+  power_release();
+}
+
+/**************************************************************************//**
+ * Change detection of the advertised mass: the packet is rebuilt, and
+ * encrypted, only if the mass moved out of the deadband or as a heartbeat.
+ *****************************************************************************/
+static bool advertising_changed(int32_t mg)
+{
+  int32_t change = mg - advertised_mg;
+
+  return change >= ADVERTISING_DEADBAND_MG || change <= -ADVERTISING_DEADBAND_MG;
 }
 
-static float get_mass(void)
+static bool advertising_heartbeat_due(void)
 {
-  HX711_power_up();
-  float mass = HX711_get_mean_units(AVERAGE_COUNT);
-  HX711_power_down();
-  app_log("mass: %f\n", mass);
-  return mass;
+  uint64_t ms;
+
+  (void)sl_sleeptimer_tick64_to_ms(sl_sleeptimer_get_tick_count64() - advertised_tick, &ms);
+  return ms >= ADVERTISING_HEARTBEAT_MS;
+}
+
+/**************************************************************************//**
+ * Deferred GATT read: remember the request until the measurement is done.
+ * ATT allows a single outstanding request per connection.
+ *****************************************************************************/
+static void read_requested(uint8_t connection, uint16_t characteristic)
+{
+  if (pending_read_count == MAX_PENDING_READS) {
+    (void)sl_bt_gatt_server_send_user_read_response(connection,
+                                                    characteristic,
+                                                    ATT_ERR_INSUFFICIENT_RESOURCES,
+                                                    0,
+                                                    NULL,
+                                                    NULL);
+    return;
+  }
+  pending_reads[pending_read_count].connection = connection;
+  pending_reads[pending_read_count].characteristic = characteristic;
+  pending_read_count++;
+  request_measurement(MEASUREMENT_REQUEST_READ);
+}
+
+/**************************************************************************//**
+ * Answer the pending reads: with the mass, or with an error and no value.
+ *****************************************************************************/
+static void read_respond(uint8_t att_errorcode, int32_t mass)
+{
+  for (uint8_t i = 0; i < pending_read_count; i++) {
+    (void)sl_bt_gatt_server_send_user_read_response(pending_reads[i].connection,
+                                                    pending_reads[i].characteristic,
+                                                    att_errorcode,
+                                                    att_errorcode ? 0 : sizeof(mass),
+                                                    (uint8_t *)&mass,
+                                                    NULL);
+  }
+  pending_read_count = 0;
+}
+
+static void read_cancel(uint8_t connection)
+{
+  uint8_t count = 0;
+
+  for (uint8_t i = 0; i < pending_read_count; i++) {
+    if (pending_reads[i].connection != connection) {
+      pending_reads[count++] = pending_reads[i];
+    }
+  }
+  pending_read_count = count;
+}
+
+/**************************************************************************//**
+ * Calibration procedure, written by the GATT client.
+ *
+ * @return ATT error code of the write response.
+ *****************************************************************************/
+static uint8_t calibration_write(const uint8_t *data, uint8_t len)
+{
+  if (len < 1) {
+    return ATT_ERR_INVALID_LENGTH;
+  }
+  switch (data[0]) {
+    case CALIBRATION_OP_START:
+      calibration_start();
+      break;
+
+    case CALIBRATION_OP_CAPTURE:
+      if (len != 1 + sizeof(int32_t)) {
+        return ATT_ERR_INVALID_LENGTH;
+      }
+      // The point is captured once the reference weight is measured.
+      memcpy(&calibration_reference_mg, &data[1], sizeof(int32_t));
+      request_measurement(MEASUREMENT_REQUEST_CALIBRATE);
+      break;
+
+    case CALIBRATION_OP_APPLY:
+      if (calibration_apply() != SL_STATUS_OK) {
+        return ATT_ERR_PROCEDURE_FAILED;
+      }
+      app_log("calibration table applied\n");
+      break;
+
+    case CALIBRATION_OP_TEMPCO:
+    {
+      int32_t coefficients[3];
+      hx711_tempco_t tempco;
+
+      if (len != 1 + sizeof(coefficients)) {
+        return ATT_ERR_INVALID_LENGTH;
+      }
+      memcpy(coefficients, &data[1], sizeof(coefficients));
+      tempco.ref_celsius = coefficients[0] / 100.0f;
+      tempco.zero_per_degree = coefficients[1] / 100.0f;
+      tempco.span_ppm_per_degree = coefficients[2] / 100.0f;
+      if (calibration_set_tempco(&tempco) != SL_STATUS_OK) {
+        return ATT_ERR_PROCEDURE_FAILED;
+      }
+      app_log("temperature coefficients applied\n");
+      break;
+    }
+
+    case CALIBRATION_OP_RESET:
+      if (calibration_reset() != SL_STATUS_OK) {
+        return ATT_ERR_PROCEDURE_FAILED;
+      }
+      app_log("calibration reset\n");
+      break;
+
+    default:
+      return ATT_ERR_UNKNOWN_OPCODE;
+  }
+  return ATT_ERR_SUCCESS;
+}
+
+/**************************************************************************//**
+ * Capture a calibration point from the filter output, corrected to the
+ * reference temperature of the compensation as the table is used.
+ *****************************************************************************/
+static void calibration_capture(void)
+{
+  hx711_t *dev = HX711_get_default();
+  int32_t raw = hx711_to_counts(dev, hx711_get_filtered(dev));
+  sl_status_t sc = calibration_add_point(raw, calibration_reference_mg);
+
+  app_log("calibration point %ld counts = %ld mg: %s\n",
+          (long)raw,
+          (long)calibration_reference_mg,
+          sc == SL_STATUS_OK ? "captured" : "table full");
 }
@@ -37,33 +37,135 @@
  *
  ******************************************************************************/
 #include <stdlib.h>
+#include <string.h>
 #include <sl_string.h>
 #include "sl_bt_api.h"
 #include "bthome_v2.h"
+#include "profile.h"
+#include "sl_component_catalog.h"
+#if BTHOME_V2_COUNTER_BLOCK > 0
+#include "nvm3_default.h"
+#endif
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+#include "mbedtls/aes.h"
+#else
 #include "mbedtls/ccm.h"
+#endif
+
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+#define SENSOR_DATA_MAX_LEN  MEASUREMENT_EXT_MAX_LEN
+#else
+#define SENSOR_DATA_MAX_LEN  MEASUREMENT_MAX_LEN
+#endif
+
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+#define AES_BLOCK_LEN        16
+// Keystream for the longest encrypted sensor data, in whole blocks
+#define KEYSTREAM_MAX_LEN    ((SENSOR_DATA_MAX_LEN - 8 + AES_BLOCK_LEN - 1) \
+                              / AES_BLOCK_LEN * AES_BLOCK_LEN)
+// CCM flags of the first CBC-MAC block and of the counter blocks, for a
+// MIC_LEN bytes tag and a 15 - NONCE_LEN bytes length field
+#define CCM_FLAGS_B0         ((((MIC_LEN - 2) / 2) << 3) | (15 - NONCE_LEN - 1))
+#define CCM_FLAGS_A          (15 - NONCE_LEN - 1)
+
+// AES-CCM blocks which do not depend on the data, for a counter value
+typedef struct {
+  bool valid;
+  uint32_t counter;
+  // Data length the first CBC-MAC block was computed for.
+  uint8_t mac_len;
+  // First CBC-MAC block, E(B0).
+  uint8_t mac_block[AES_BLOCK_LEN];
+  // Mask of the MIC, E(A0).
+  uint8_t tag_mask[MIC_LEN];
+  // Keystream E(A1), E(A2)..., stream_len bytes computed.
+  uint8_t stream_len;
+  uint8_t stream[KEYSTREAM_MAX_LEN];
+} keystream_t;
+#endif
+
+// Default advertising interval, the stack picks it within +/- 10 %
+#define ADV_INTERVAL_MS            1000
+// The legacy fallback of the extended advertising is sent less often
+#define ADV_FALLBACK_FACTOR        4
+// Extended advertising data set with a single command, longer data is
+// written to the system data buffer and set from there
+#define EXT_ADV_SET_DATA_MAX_LEN   191
+
+// Advertising packet template: flags, name, UUID and device information are
+// built once per configuration, each update only patches the measurements,
+// the counter and the MIC.
+typedef struct {
+  // The advertising set handle allocated from Bluetooth stack.
+  uint8_t handle;
+  uint8_t max_len;
+  uint8_t *data;
+  bool valid;
+  // Sensor data length the name was truncated for.
+  uint8_t data_len;
+  // Index of the service data length byte.
+  uint8_t service_len_index;
+  // Index of the first measurement byte.
+  uint8_t data_index;
+} adv_packet_t;
 
 // -----------------------------------------------------------------------------
 //                          Static Variables Declarations
 // -----------------------------------------------------------------------------
 static uint8_t sensor_data_index = 0;
-static uint8_t sensor_data[MEASUREMENT_MAX_LEN] = { 0 };
+static uint8_t sensor_data[SENSOR_DATA_MAX_LEN] = { 0 };
+// Highest object id added since the reset: objects from there on are appended.
+static uint8_t last_object_id;
 static uint8_t *dev_name;
 static bool b_encrypt_enable;
 static bool b_trigger_device;
-static bool b_sort_enable;
-
-static uint8_t last_object_id;
 
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+// The AES context for encrypt
+static mbedtls_aes_context encrypt_ctx;
+// Keystreams of the next counter values, indexed by the counter
+static keystream_t keystreams[BTHOME_V2_KEYSTREAM_DEPTH];
+#else
 // The CCM context for encrypt
 static mbedtls_ccm_context encrypt_ctx;
+#endif
 // Store key used for encrypt
 static unsigned char bind_key[BIND_KEY_LEN];
 
 static uint32_t encrypt_count;
+#if BTHOME_V2_COUNTER_BLOCK > 0
+// Counter values from counter_limit on are not reserved in NVM3 yet.
+static uint32_t counter_limit;
+// The next block is reserved ahead from this counter value on.
+static uint32_t counter_reserve_at;
+#endif
+
+// Connectable legacy advertising, and fallback of the extended advertising.
+static uint8_t legacy_data[BLE_ADVERT_MAX_LEN];
+static adv_packet_t legacy_packet = {
+  .handle = 0xff,
+  .max_len = BLE_ADVERT_MAX_LEN,
+  .data = legacy_data,
+  .valid = false
+};
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+// Non-connectable extended advertising carrying all the measurements.
+static uint8_t extended_data[BLE_EXT_ADVERT_MAX_LEN];
+static adv_packet_t extended_packet = {
+  .handle = 0xff,
+  .max_len = BLE_EXT_ADVERT_MAX_LEN,
+  .data = extended_data,
+  .valid = false
+};
+#endif
+static bool b_extended_enable = false;
+// The legacy advertising set carries a BTHome packet.
+static bool legacy_data_set = false;
+// MAC, UUID and device information of the nonce; the counter is patched.
+static uint8_t adv_nonce[NONCE_LEN];
 
-// The advertising set handle allocated from Bluetooth stack.
-static uint8_t advertising_set_handle = 0xff;
 static bool is_advertising = false;
+static uint16_t adv_interval_ms = ADV_INTERVAL_MS;
 
 // -----------------------------------------------------------------------------
 //                          Static Function Declarations
@@ -72,10 +174,58 @@ static uint8_t get_byte_number(uint8_t sens);
 
 static uint16_t get_factor(uint8_t sens);
 
-static void sort_sensor_data(void);
+static uint8_t get_object_length(uint8_t index);
+
+static uint8_t insert_object(uint8_t object_id, uint8_t length);
 
 static void remove_oldest_sensor_data(void);
 
+static uint8_t get_measurement_limit(void);
+
+static uint8_t get_legacy_length(void);
+
+static uint8_t build_adv_packet(adv_packet_t *packet,
+                                uint8_t data_len,
+                                uint8_t *out);
+
+static void pad_sensor_data(void);
+
+static void build_template(adv_packet_t *packet, uint8_t data_len);
+
+static void invalidate_templates(void);
+
+static void encrypt_sensor_data(uint8_t data_len, uint8_t *out, uint8_t *tag);
+
+#if BTHOME_V2_COUNTER_BLOCK > 0
+static void reserve_counters(void);
+
+static bool counters_reserved(uint8_t count);
+#endif
+
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+static void compute_keystream(keystream_t *keystream,
+                              uint32_t counter,
+                              uint8_t data_len);
+
+static void extend_keystream(keystream_t *keystream, uint8_t data_len);
+
+static void compute_mac_block(keystream_t *keystream, uint8_t data_len);
+
+static void encrypt_block(uint8_t *block,
+                          uint8_t flags,
+                          uint32_t counter,
+                          uint16_t value,
+                          uint8_t *out);
+#endif
+
+static sl_status_t set_timing(uint8_t handle, uint32_t interval_ms);
+
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+static sl_status_t set_extended_data(uint8_t data_len, const uint8_t *data);
+#endif
+
+static sl_status_t apply_timing(void);
+
 // -----------------------------------------------------------------------------
 //                          Public Function Definitions
 // -----------------------------------------------------------------------------
@@ -107,13 +257,30 @@ sl_status_t bthome_v2_init(uint8_t *device_name,
       if (encryption) {
         b_encrypt_enable = true;
 
+#if BTHOME_V2_COUNTER_BLOCK > 0
+        // resume past the counter values reserved before the reset, they
+        // may have been used; the next packet reserves a new block
+        if (nvm3_readCounter(nvm3_defaultHandle,
+                             BTHOME_V2_COUNTER_NVM3_KEY,
+                             &encrypt_count) != ECODE_NVM3_OK) {
+          encrypt_count = rand() % 0x427;
+        }
+        counter_limit = encrypt_count;
+        counter_reserve_at = encrypt_count;
+#else
         encrypt_count = rand() % 0x427;
+#endif
 
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+        mbedtls_aes_init(&encrypt_ctx);
+        sc = mbedtls_aes_setkey_enc(&encrypt_ctx, bind_key, BIND_KEY_LEN * 8);
+#else
         mbedtls_ccm_init(&encrypt_ctx);
         sc = mbedtls_ccm_setkey(&encrypt_ctx,
                                 MBEDTLS_CIPHER_ID_AES,
                                 bind_key,
                                 BIND_KEY_LEN * 8);
+#endif
         if (sc != SL_STATUS_OK) {
           return sc;
         }
@@ -124,6 +291,7 @@ sl_status_t bthome_v2_init(uint8_t *device_name,
   }
 
   b_trigger_device = trigger_based_device;
+  invalidate_templates();
   bthome_v2_reset_measurement();
 
   return sc;
@@ -137,6 +305,7 @@ sl_status_t bthome_v2_set_device_name(uint8_t *device_name)
   if (device_name != NULL) {
     if (!sl_str_is_empty((const char *)device_name)) {
       dev_name = device_name;
+      invalidate_templates();
       return SL_STATUS_OK;
     }
   }
@@ -147,156 +316,117 @@ sl_status_t bthome_v2_set_device_name(uint8_t *device_name)
 /***************************************************************************//**
  *  Build packet used for advertise.
  ******************************************************************************/
-void bthome_v2_build_packet(void)
+sl_status_t bthome_v2_build_packet(void)
 {
-  bd_addr address;
-  uint8_t address_type;
-  // dev_name length
-  uint8_t dn_length;
-  uint8_t dn_flag = COMPLETE_NAME;
-  // build encrypt
-  uint8_t ciphertext[MEASUREMENT_MAX_LEN];
-  uint8_t encryption_mic[MIC_LEN];
-  // build initialization vector (nonce)
-  uint8_t nonce[NONCE_LEN];
-  uint8_t *p_count = (uint8_t *)(&encrypt_count);
-  // build data
-  uint8_t payload_data[BLE_ADVERT_MAX_LEN] = { 0 };
-  uint8_t payload_count = 0;
-  uint8_t service_data[MEASUREMENT_MAX_LEN] = { 0 };
-  uint8_t service_count = 0;
-
-  // the Object ids have to be applied in numerical order (from low to high)
-  if (b_sort_enable) {
-    sort_sensor_data();
-  }
-
-  // head
-  payload_data[payload_count++] = FLAG1;
-  payload_data[payload_count++] = FLAG2;
-  payload_data[payload_count++] = FLAG3;
-
-  // local name
-  if (!sl_str_is_empty((const char *)dev_name)) {
-    // +1(flag name)+1(name length)
-    dn_length = sl_strlen((char *)dev_name) + 2;
+  sl_status_t sc = SL_STATUS_OK;
+  uint8_t legacy_len;
+  PROFILE_START(PROFILE_BTHOME_BUILD);
 
-    if (b_encrypt_enable) {
-      // deal with the device name to make sure the adv length <= 31
-      // 16=3(FLAG)+2(UUID)+1(ENCRYPT)
-      //    +4(nonce)+4(mic)+1(serviceData length bit)
-      if (dn_length > BLE_ADVERT_MAX_LEN - sensor_data_index - 16) {
-        dn_length = BLE_ADVERT_MAX_LEN - sensor_data_index - 16;
-        dn_flag = SHORT_NAME;
-      }
-    } else {
-      // 8=3(FLAG)+1(SERVICE_DATA)+2(UUID)
-      //    +1(ENCRYPT)+1(serviceData length bit)
-      if (dn_length > BLE_ADVERT_MAX_LEN - sensor_data_index - 8) {
-        dn_length = BLE_ADVERT_MAX_LEN - sensor_data_index - 8;
-        dn_flag = SHORT_NAME;
-      }
-    }
+  pad_sensor_data();
+  legacy_len = sensor_data_index;
 
-    // Add the length of the Name
-    // Complete_Name: Complete local name -- Short_Name: Shortened Name
-    if (dn_length > 2) {
-      payload_data[payload_count++] = dn_length - 1;
-      payload_data[payload_count++] = dn_flag;
-      for (uint8_t i = 0; i < (dn_length - 2); i++) {
-        payload_data[payload_count++] = dev_name[i];
-      }
+  if (b_encrypt_enable) {
+#if BTHOME_V2_COUNTER_BLOCK > 0
+    // a counter value is only sent once reserved, otherwise the advertising
+    // data is left as it is
+    if (!counters_reserved(b_extended_enable ? 2 : 1)) {
+      PROFILE_STOP(PROFILE_BTHOME_BUILD);
+      return SL_STATUS_FAIL;
     }
+#endif
   }
 
-  // DO NOT CHANGE -- Service Data - 16-bit UUID
-  service_data[service_count++] = SERVICE_DATA;
-  // DO NOT CHANGE -- UUID
-  service_data[service_count++] = UUID1;
-  // DO NOT CHANGE -- UUID
-  service_data[service_count++] = UUID2;
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+  if (b_extended_enable) {
+    uint8_t extended_len = build_adv_packet(&extended_packet,
+                                            sensor_data_index,
+                                            extended_data);
+    // Add to advertise packet, the extended advertising data is sent as is
+    sc = set_extended_data(extended_len, extended_data);
+    legacy_len = get_legacy_length();
+  }
+#endif
 
-  // The encryption
-  if (b_encrypt_enable) {
-    if (b_trigger_device) {
-      service_data[service_count++] = ENCRYPT_TRIGGER_BASE;
-    } else {
-      service_data[service_count++] = ENCRYPT;
-    }
+  legacy_len = build_adv_packet(&legacy_packet, legacy_len, legacy_data);
+  // Add to advertise packet, without padding
+  sl_status_t sc_legacy = sl_bt_legacy_advertiser_set_data(
+    legacy_packet.handle,
+    sl_bt_advertiser_advertising_data_packet,
+    legacy_len,
+    legacy_data);
+  if (sc_legacy == SL_STATUS_OK) {
+    legacy_data_set = true;
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sc_legacy;
+  }
+  PROFILE_STOP(PROFILE_BTHOME_BUILD);
+  return sc;
+}
 
-    // Extract unique ID from BT Address.
-    sl_bt_system_get_identity_address(&address, &address_type);
+/***************************************************************************//**
+ *  Encode the legacy advertising packet into a buffer.
+ ******************************************************************************/
+uint8_t bthome_v2_encode_packet(uint8_t *buffer, uint8_t size)
+{
+  uint8_t data_len;
+  PROFILE_START(PROFILE_BTHOME_BUILD);
 
-    // MAC
-    nonce[0] = address.addr[5];
-    nonce[1] = address.addr[4];
-    nonce[2] = address.addr[3];
-    nonce[3] = address.addr[2];
-    nonce[4] = address.addr[1];
-    nonce[5] = address.addr[0];
-    // UUID
-    nonce[6] = UUID1;
-    nonce[7] = UUID2;
-    // BTHome information flag
-    nonce[8] = service_data[service_count - 1];
-    // Counter
-    nonce[9] = p_count[0];
-    nonce[10] = p_count[1];
-    nonce[11] = p_count[2];
-    nonce[12] = p_count[3];
+  pad_sensor_data();
+  data_len = get_legacy_length();
 
-    // add some padding to the payload if needed
-    while (sensor_data_index < 5) {
-      sensor_data[sensor_data_index] = 0xFF;
-      sensor_data_index++;
-    }
+  // the name is truncated to fit the measurements
+  if (!legacy_packet.valid || legacy_packet.data_len != data_len) {
+    build_template(&legacy_packet, data_len);
+  }
+  if (legacy_packet.data_index + data_len
+      + (b_encrypt_enable ? 4 + MIC_LEN : 0) > size) {
+    PROFILE_STOP(PROFILE_BTHOME_BUILD);
+    return 0;
+  }
+#if BTHOME_V2_COUNTER_BLOCK > 0
+  if (b_encrypt_enable && !counters_reserved(1)) {
+    PROFILE_STOP(PROFILE_BTHOME_BUILD);
+    return 0;
+  }
+#endif
 
-    // encrypt sensorData
-    mbedtls_ccm_encrypt_and_tag(&encrypt_ctx, sensor_data_index,
-                                nonce, NONCE_LEN,
-                                0, 0,
-                                sensor_data, ciphertext,
-                                encryption_mic, MIC_LEN);
-    // Add ciphertext
-    for (uint8_t i = 0; i < sensor_data_index; i++) {
-      service_data[service_count++] = ciphertext[i];
-    }
-    // Add Counter
-    service_data[service_count++] = nonce[9];
-    service_data[service_count++] = nonce[10];
-    service_data[service_count++] = nonce[11];
-    service_data[service_count++] = nonce[12];
-    encrypt_count++;
+  data_len = build_adv_packet(&legacy_packet, data_len, buffer);
+  PROFILE_STOP(PROFILE_BTHOME_BUILD);
+  return data_len;
+}
 
-    // Add MIC
-    service_data[service_count++] = encryption_mic[0];
-    service_data[service_count++] = encryption_mic[1];
-    service_data[service_count++] = encryption_mic[2];
-    service_data[service_count++] = encryption_mic[3];
-  } else {
-    if (b_trigger_device) {
-      service_data[service_count++] = NO_ENCRYPT_TRIGGER_BASE;
-    } else {
-      service_data[service_count++] = NO_ENCRYPT;
-    }
+/***************************************************************************//**
+ *  Precompute the encryption of the next packets.
+ ******************************************************************************/
+void bthome_v2_prepare(void)
+{
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+  keystream_t *keystream;
+  uint32_t counter;
+#endif
 
-    for (uint8_t i = 0; i < sensor_data_index; i++) {
-      // Add the sensor data to the Service Data
-      service_data[service_count++] = sensor_data[i];
-    }
+  // the nonce is known once a packet was built
+  if (!b_encrypt_enable || !legacy_packet.valid) {
+    return;
   }
-
-  // Add the length of the Service Data
-  payload_data[payload_count++] = service_count;
-  // Finalize the packet
-  for (uint8_t i = 0; i < service_count; i++) {
-    payload_data[payload_count++] = service_data[i];
+#if BTHOME_V2_COUNTER_BLOCK > 0
+  // the next block is reserved ahead, out of the packet builds
+  if ((int32_t)(encrypt_count - counter_reserve_at) >= 0) {
+    reserve_counters();
+  }
+#endif
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+  for (uint8_t i = 0; i < BTHOME_V2_KEYSTREAM_DEPTH; i++) {
+    counter = encrypt_count + i;
+    keystream = &keystreams[counter % BTHOME_V2_KEYSTREAM_DEPTH];
+    if (!keystream->valid || keystream->counter != counter) {
+      // the packet using this entry is expected to have the same length as
+      // the one which used it last
+      compute_keystream(keystream, counter, keystream->mac_len);
+    }
   }
-  // Add to advertise packet
-  sl_bt_legacy_advertiser_set_data(advertising_set_handle,
-                                   sl_bt_advertiser_advertising_data_packet,
-                                   sizeof(payload_data),
-                                   payload_data);
+#endif
 }
 
 /***************************************************************************//**
@@ -307,9 +437,9 @@ sl_status_t bthome_v2_send_packet(void)
   sl_status_t sc = SL_STATUS_OK;
 
   if (sensor_data_index > 0) {
-    bthome_v2_build_packet();
+    sc = bthome_v2_build_packet();
 
-    if (!is_advertising) {
+    if (sc == SL_STATUS_OK && !is_advertising) {
       sc = bthome_v2_start();
     }
   }
@@ -324,7 +454,60 @@ void bthome_v2_reset_measurement(void)
 {
   sensor_data_index = 0;
   last_object_id = 0;
-  b_sort_enable = false;
+}
+
+/***************************************************************************//**
+ *  Enable or disable the extended advertising of the measurements.
+ ******************************************************************************/
+sl_status_t bthome_v2_set_extended_advertising(bool enable)
+{
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+  sl_status_t sc;
+
+  if (is_advertising || legacy_packet.handle == 0xff) {
+    return SL_STATUS_INVALID_STATE;
+  }
+
+  if (enable && extended_packet.handle == 0xff) {
+    sc = sl_bt_advertiser_create_set(&extended_packet.handle);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+  }
+
+  b_extended_enable = enable;
+  bthome_v2_reset_measurement();
+  sc = apply_timing();
+
+  return sc;
+#else
+  return enable ? SL_STATUS_NOT_SUPPORTED : SL_STATUS_OK;
+#endif
+}
+
+/***************************************************************************//**
+ *  Set the advertising interval.
+ ******************************************************************************/
+sl_status_t bthome_v2_set_interval(uint16_t interval_ms)
+{
+  sl_status_t sc;
+
+  if (interval_ms == adv_interval_ms) {
+    return SL_STATUS_OK;
+  }
+  adv_interval_ms = interval_ms;
+  if (legacy_packet.handle == 0xff) {
+    // applied once the advertising set is created
+    return SL_STATUS_OK;
+  }
+
+  sc = apply_timing();
+  if (sc == SL_STATUS_OK && is_advertising) {
+    // the new timing is used from the next start
+    (void)bthome_v2_stop();
+    sc = bthome_v2_start();
+  }
+  return sc;
 }
 
 /***************************************************************************//**
@@ -338,22 +521,13 @@ void bthome_v2_add_measurement_state(uint8_t sensor_id,
     steps = 0;
   }
 
-  if ((sensor_data_index + 2 + ((steps > 0) ? 1 : 0))
-      <= (MEASUREMENT_MAX_LEN - (b_encrypt_enable ? 8 : 0))) {
-    sensor_data[sensor_data_index] = sensor_id & 0xff;
-    sensor_data_index++;
-    sensor_data[sensor_data_index] = state & 0xff;
-    sensor_data_index++;
+  uint8_t length = 2 + ((steps > 0) ? 1 : 0);
+  if ((sensor_data_index + length) <= get_measurement_limit()) {
+    uint8_t index = insert_object(sensor_id, length);
+    sensor_data[index] = state & 0xff;
     if (steps > 0) {
-      sensor_data[sensor_data_index] = steps & 0xff;
-      sensor_data_index++;
-    }
-    if (!b_sort_enable) {
-      if (sensor_id < last_object_id) {
-        b_sort_enable = true;
-      }
+      sensor_data[index + 1] = steps & 0xff;
     }
-    last_object_id = sensor_id;
   } else {
     bthome_v2_send_packet();
     remove_oldest_sensor_data();
@@ -368,21 +542,12 @@ void bthome_v2_add_measurement(uint8_t sensor_id, uint64_t value)
 {
   uint8_t size = get_byte_number(sensor_id);
   uint16_t factor = get_factor(sensor_id);
-  if ((sensor_data_index + size + 1)
-      <= (MEASUREMENT_MAX_LEN - (b_encrypt_enable ? 8 : 0))) {
-    sensor_data[sensor_data_index] = sensor_id & 0xff;
-    sensor_data_index++;
+  if ((sensor_data_index + size + 1) <= get_measurement_limit()) {
+    uint8_t index = insert_object(sensor_id, size + 1);
     for (uint8_t i = 0; i < size; i++) {
-      sensor_data[sensor_data_index] =
+      sensor_data[index + i] =
         (uint8_t)(((value * factor) >> (8 * i)) & 0xff);
-      sensor_data_index++;
-    }
-    if (!b_sort_enable) {
-      if (sensor_id < last_object_id) {
-        b_sort_enable = true;
-      }
     }
-    last_object_id = sensor_id;
   } else {
     bthome_v2_send_packet();
     remove_oldest_sensor_data();
@@ -397,21 +562,12 @@ void bthome_v2_add_measurement_float(uint8_t sensor_id, float value)
 {
   uint8_t size = get_byte_number(sensor_id);
   uint16_t factor = get_factor(sensor_id);
-  if ((sensor_data_index + size + 1)
-      <= (MEASUREMENT_MAX_LEN - (b_encrypt_enable ? 8 : 0))) {
+  if ((sensor_data_index + size + 1) <= get_measurement_limit()) {
     uint64_t value2 = (uint64_t)(value * factor);
-    sensor_data[sensor_data_index] = sensor_id & 0xff;
-    sensor_data_index++;
+    uint8_t index = insert_object(sensor_id, size + 1);
     for (uint8_t i = 0; i < size; i++) {
-      sensor_data[sensor_data_index] = (uint8_t)((value2 >> (8 * i)) & 0xff);
-      sensor_data_index++;
-    }
-    if (!b_sort_enable) {
-      if (sensor_id < last_object_id) {
-        b_sort_enable = true;
-      }
+      sensor_data[index + i] = (uint8_t)((value2 >> (8 * i)) & 0xff);
     }
-    last_object_id = sensor_id;
   } else {
     bthome_v2_send_packet();
     remove_oldest_sensor_data();
@@ -428,9 +584,21 @@ sl_status_t bthome_v2_start(void)
 
   if (!is_advertising) {
     // Start advertising
-    sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
+    sc = sl_bt_legacy_advertiser_start(legacy_packet.handle,
                                        sl_bt_legacy_advertiser_connectable);
-    is_advertising = true;
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+    if (sc == SL_STATUS_OK && b_extended_enable) {
+      sc = sl_bt_extended_advertiser_start(
+        extended_packet.handle,
+        sl_bt_extended_advertiser_non_connectable,
+        0);
+      if (sc != SL_STATUS_OK) {
+        // both sets start again with the next attempt
+        (void)sl_bt_advertiser_stop(legacy_packet.handle);
+      }
+    }
+#endif
+    is_advertising = (sc == SL_STATUS_OK);
   }
   return sc;
 }
@@ -442,8 +610,16 @@ sl_status_t bthome_v2_stop(void)
 {
   sl_status_t sc;
 
-  // Start advertising
-  sc = sl_bt_advertiser_stop(advertising_set_handle);
+  // Stop advertising
+  sc = sl_bt_advertiser_stop(legacy_packet.handle);
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+  if (b_extended_enable) {
+    sl_status_t sc_extended = sl_bt_advertiser_stop(extended_packet.handle);
+    if (sc == SL_STATUS_OK) {
+      sc = sc_extended;
+    }
+  }
+#endif
   is_advertising = false;
 
   return sc;
@@ -469,16 +645,11 @@ void bthome_v2_bt_on_event(sl_bt_msg_t *evt)
     // Do not call any stack command before receiving this boot event!
     case sl_bt_evt_system_boot_id:
       // Check if advertising set is invalid
-      if (advertising_set_handle == 0xff) {
-        sl_bt_advertiser_create_set(&advertising_set_handle);
-
-        // Set advertising interval to 1000 +/- 100 ms.
-        sl_bt_advertiser_set_timing(
-          advertising_set_handle,
-          1440, // min. adv. interval (milliseconds * 1.6)
-          1760, // max. adv. interval (milliseconds * 1.6)
-          0,    // adv. duration
-          0);   // max. num. adv. events
+      if (legacy_packet.handle == 0xff) {
+        sl_bt_advertiser_create_set(&legacy_packet.handle);
+
+        // Set advertising interval, 1000 +/- 100 ms by default.
+        apply_timing();
       }
       break;
 
@@ -494,8 +665,12 @@ void bthome_v2_bt_on_event(sl_bt_msg_t *evt)
     // This event indicates that a connection was closed.
     case sl_bt_evt_connection_closed_id:
       if (!bthome_v2_is_advertising()) {
-        sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
-                                              sl_bt_advertiser_general_discoverable);
+        // the advertising set keeps its data over the connection, the
+        // BTHome packet is advertised again until the next update
+        if (!legacy_data_set) {
+          sl_bt_legacy_advertiser_generate_data(legacy_packet.handle,
+                                                sl_bt_advertiser_general_discoverable);
+        }
         bthome_v2_start();
       }
       break;
@@ -506,6 +681,429 @@ void bthome_v2_bt_on_event(sl_bt_msg_t *evt)
 //                          Static Function Definitions
 // -----------------------------------------------------------------------------
 
+/***************************************************************************//**
+ * Returns the room for the measurements in the packet.
+ ******************************************************************************/
+static uint8_t get_measurement_limit(void)
+{
+  uint8_t limit = b_extended_enable ? MEASUREMENT_EXT_MAX_LEN
+                  : MEASUREMENT_MAX_LEN;
+
+  return limit - (b_encrypt_enable ? 8 : 0);
+}
+
+/***************************************************************************//**
+ * Returns the length of the objects which fit in the legacy packet. The
+ * objects are in ascending id order, the lowest ids are kept.
+ ******************************************************************************/
+static uint8_t get_legacy_length(void)
+{
+  uint8_t limit = MEASUREMENT_MAX_LEN - (b_encrypt_enable ? 8 : 0);
+  uint8_t length = 0;
+
+  if (sensor_data_index <= limit) {
+    return sensor_data_index;
+  }
+  while (length + get_object_length(length) <= limit) {
+    length += get_object_length(length);
+  }
+  return length;
+}
+
+/***************************************************************************//**
+ * Add padding to the encrypted payload if needed.
+ ******************************************************************************/
+static void pad_sensor_data(void)
+{
+  if (b_encrypt_enable) {
+    while (sensor_data_index < 5) {
+      sensor_data[sensor_data_index] = 0xFF;
+      sensor_data_index++;
+    }
+  }
+}
+
+/***************************************************************************//**
+ * Encode a packet into out with the first data_len bytes of the sensor data,
+ * encrypted with the next counter value if needed. When out is the template
+ * of the packet, only the measurements, the counter and the MIC are written,
+ * otherwise the static part is copied from the template first.
+ *
+ * @return Length of the packet.
+ ******************************************************************************/
+static uint8_t build_adv_packet(adv_packet_t *packet,
+                                uint8_t data_len,
+                                uint8_t *out)
+{
+  uint8_t *p;
+
+  // the name is truncated to fit the measurements
+  if (!packet->valid || packet->data_len != data_len) {
+    build_template(packet, data_len);
+  }
+  if (out != packet->data) {
+    memcpy(out, packet->data, packet->data_index);
+  }
+
+  p = &out[packet->data_index];
+  if (b_encrypt_enable) {
+    // Counter
+    adv_nonce[9] = (uint8_t)encrypt_count;
+    adv_nonce[10] = (uint8_t)(encrypt_count >> 8);
+    adv_nonce[11] = (uint8_t)(encrypt_count >> 16);
+    adv_nonce[12] = (uint8_t)(encrypt_count >> 24);
+
+    // encrypt sensorData into the packet, the MIC goes after the counter
+    encrypt_sensor_data(data_len, p, p + data_len + 4);
+    memcpy(p + data_len, &adv_nonce[9], 4);
+    encrypt_count++;
+    p += data_len + 4 + MIC_LEN;
+  } else {
+    memcpy(p, sensor_data, data_len);
+    p += data_len;
+  }
+
+  // Add the length of the Service Data
+  out[packet->service_len_index] =
+    (uint8_t)(p - &out[packet->service_len_index + 1]);
+
+  return (uint8_t)(p - out);
+}
+
+/***************************************************************************//**
+ * Build the static part of the advertising packet and of the nonce, for the
+ * current configuration and sensor data length.
+ ******************************************************************************/
+static void build_template(adv_packet_t *packet, uint8_t data_len)
+{
+  bd_addr address;
+  uint8_t address_type;
+  // dev_name length
+  uint8_t dn_length;
+  uint8_t dn_flag = COMPLETE_NAME;
+  uint8_t payload_count = 0;
+
+  memset(packet->data, 0, packet->max_len);
+
+  // head
+  packet->data[payload_count++] = FLAG1;
+  packet->data[payload_count++] = FLAG2;
+  packet->data[payload_count++] = FLAG3;
+
+  // local name
+  if (!sl_str_is_empty((const char *)dev_name)) {
+    // +1(flag name)+1(name length)
+    dn_length = sl_strlen((char *)dev_name) + 2;
+
+    if (b_encrypt_enable) {
+      // deal with the device name to make sure the adv length <= max_len
+      // 16=3(FLAG)+2(UUID)+1(ENCRYPT)
+      //    +4(nonce)+4(mic)+1(serviceData length bit)
+      if (dn_length > packet->max_len - data_len - 16) {
+        dn_length = packet->max_len - data_len - 16;
+        dn_flag = SHORT_NAME;
+      }
+    } else {
+      // 8=3(FLAG)+1(SERVICE_DATA)+2(UUID)
+      //    +1(ENCRYPT)+1(serviceData length bit)
+      if (dn_length > packet->max_len - data_len - 8) {
+        dn_length = packet->max_len - data_len - 8;
+        dn_flag = SHORT_NAME;
+      }
+    }
+
+    // Add the length of the Name
+    // Complete_Name: Complete local name -- Short_Name: Shortened Name
+    if (dn_length > 2) {
+      packet->data[payload_count++] = dn_length - 1;
+      packet->data[payload_count++] = dn_flag;
+      memcpy(&packet->data[payload_count], dev_name, dn_length - 2);
+      payload_count += dn_length - 2;
+    }
+  }
+
+  // Length of the Service Data, patched on each update
+  packet->service_len_index = payload_count++;
+  // DO NOT CHANGE -- Service Data - 16-bit UUID
+  packet->data[payload_count++] = SERVICE_DATA;
+  // DO NOT CHANGE -- UUID
+  packet->data[payload_count++] = UUID1;
+  // DO NOT CHANGE -- UUID
+  packet->data[payload_count++] = UUID2;
+
+  if (b_encrypt_enable) {
+    if (b_trigger_device) {
+      packet->data[payload_count++] = ENCRYPT_TRIGGER_BASE;
+    } else {
+      packet->data[payload_count++] = ENCRYPT;
+    }
+
+    // Extract unique ID from BT Address.
+    sl_bt_system_get_identity_address(&address, &address_type);
+
+    // MAC
+    adv_nonce[0] = address.addr[5];
+    adv_nonce[1] = address.addr[4];
+    adv_nonce[2] = address.addr[3];
+    adv_nonce[3] = address.addr[2];
+    adv_nonce[4] = address.addr[1];
+    adv_nonce[5] = address.addr[0];
+    // UUID
+    adv_nonce[6] = UUID1;
+    adv_nonce[7] = UUID2;
+    // BTHome information flag
+    adv_nonce[8] = packet->data[payload_count - 1];
+  } else {
+    if (b_trigger_device) {
+      packet->data[payload_count++] = NO_ENCRYPT_TRIGGER_BASE;
+    } else {
+      packet->data[payload_count++] = NO_ENCRYPT;
+    }
+  }
+
+  packet->data_index = payload_count;
+  packet->data_len = data_len;
+  packet->valid = true;
+}
+
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+/***************************************************************************//**
+ * Set the extended advertising data, through the system data buffer when it
+ * does not fit in a single command.
+ ******************************************************************************/
+static sl_status_t set_extended_data(uint8_t data_len, const uint8_t *data)
+{
+  sl_status_t sc;
+  uint8_t length;
+
+  if (data_len <= EXT_ADV_SET_DATA_MAX_LEN) {
+    return sl_bt_extended_advertiser_set_data(extended_packet.handle,
+                                              data_len,
+                                              data);
+  }
+
+  sc = sl_bt_system_data_buffer_clear();
+  for (uint8_t i = 0; sc == SL_STATUS_OK && i < data_len; i += length) {
+    length = data_len - i;
+    if (length > EXT_ADV_SET_DATA_MAX_LEN) {
+      length = EXT_ADV_SET_DATA_MAX_LEN;
+    }
+    sc = sl_bt_system_data_buffer_write(length, &data[i]);
+  }
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_extended_advertiser_set_long_data(extended_packet.handle);
+  }
+  return sc;
+}
+#endif
+
+/***************************************************************************//**
+ * Set the advertising interval of a set to interval_ms +/- 10 %.
+ ******************************************************************************/
+static sl_status_t set_timing(uint8_t handle, uint32_t interval_ms)
+{
+  return sl_bt_advertiser_set_timing(
+    handle,
+    interval_ms * 36 / 25, // min. adv. interval (milliseconds * 1.6 * 0.9)
+    interval_ms * 44 / 25, // max. adv. interval (milliseconds * 1.6 * 1.1)
+    0,                     // adv. duration
+    0);                    // max. num. adv. events
+}
+
+/***************************************************************************//**
+ * Set the advertising interval of the advertising sets in use.
+ ******************************************************************************/
+static sl_status_t apply_timing(void)
+{
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+  if (b_extended_enable) {
+    sl_status_t sc = set_timing(extended_packet.handle, adv_interval_ms);
+    if (sc != SL_STATUS_OK) {
+      return sc;
+    }
+    // The legacy advertising is only a fallback, advertise it less often
+    return set_timing(legacy_packet.handle,
+                      (uint32_t)adv_interval_ms * ADV_FALLBACK_FACTOR);
+  }
+#endif
+  return set_timing(legacy_packet.handle, adv_interval_ms);
+}
+
+/***************************************************************************//**
+ * Rebuild the templates on the next update. The keystreams depend on the
+ * nonce of the template and on the key.
+ ******************************************************************************/
+static void invalidate_templates(void)
+{
+  legacy_packet.valid = false;
+#if defined(SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT)
+  extended_packet.valid = false;
+#endif
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+  for (uint8_t i = 0; i < BTHOME_V2_KEYSTREAM_DEPTH; i++) {
+    keystreams[i].valid = false;
+  }
+#endif
+}
+
+/***************************************************************************//**
+ * AES-CCM encryption of the sensor data with the nonce of encrypt_count, as
+ * mbedtls_ccm_encrypt_and_tag(). With the keystream precomputed, only the
+ * CBC-MAC of the data is left: one AES block per 16 bytes of data.
+ ******************************************************************************/
+static void encrypt_sensor_data(uint8_t data_len, uint8_t *out, uint8_t *tag)
+{
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+  keystream_t *keystream =
+    &keystreams[encrypt_count % BTHOME_V2_KEYSTREAM_DEPTH];
+  uint8_t mac[AES_BLOCK_LEN];
+  uint8_t length;
+
+  if (!keystream->valid || keystream->counter != encrypt_count) {
+    compute_keystream(keystream, encrypt_count, data_len);
+  } else {
+    extend_keystream(keystream, data_len);
+    if (keystream->mac_len != data_len) {
+      compute_mac_block(keystream, data_len);
+    }
+  }
+
+  memcpy(mac, keystream->mac_block, AES_BLOCK_LEN);
+  for (uint8_t i = 0; i < data_len; i += AES_BLOCK_LEN) {
+    length = data_len - i;
+    if (length > AES_BLOCK_LEN) {
+      length = AES_BLOCK_LEN;
+    }
+    for (uint8_t j = 0; j < length; j++) {
+      mac[j] ^= sensor_data[i + j];
+      out[i + j] = sensor_data[i + j] ^ keystream->stream[i + j];
+    }
+    mbedtls_aes_crypt_ecb(&encrypt_ctx, MBEDTLS_AES_ENCRYPT, mac, mac);
+  }
+  for (uint8_t j = 0; j < MIC_LEN; j++) {
+    tag[j] = mac[j] ^ keystream->tag_mask[j];
+  }
+
+  // a counter value is used once, the entry is left for the prediction of
+  // the length
+  keystream->valid = false;
+#else
+  mbedtls_ccm_encrypt_and_tag(&encrypt_ctx, data_len,
+                              adv_nonce, NONCE_LEN,
+                              0, 0,
+                              sensor_data, out,
+                              tag, MIC_LEN);
+#endif
+}
+
+#if BTHOME_V2_COUNTER_BLOCK > 0
+/***************************************************************************//**
+ * Reserve the next BTHOME_V2_COUNTER_BLOCK counter values: the limit is
+ * stored before any of them is used, so the counter never goes back after a
+ * reset. The next reservation is due when 3/4 of the block are used, or with
+ * the next packet on failure.
+ ******************************************************************************/
+static void reserve_counters(void)
+{
+  uint32_t limit = encrypt_count + BTHOME_V2_COUNTER_BLOCK;
+
+  if (nvm3_writeCounter(nvm3_defaultHandle,
+                        BTHOME_V2_COUNTER_NVM3_KEY,
+                        limit) == ECODE_NVM3_OK) {
+    counter_limit = limit;
+    counter_reserve_at = limit - BTHOME_V2_COUNTER_BLOCK / 4;
+  } else {
+    counter_reserve_at = encrypt_count + 1;
+  }
+}
+
+/***************************************************************************//**
+ * Check that the next count counter values are reserved, reserve them if not.
+ ******************************************************************************/
+static bool counters_reserved(uint8_t count)
+{
+  if ((int32_t)(encrypt_count + count - counter_limit) > 0) {
+    reserve_counters();
+  }
+  return (int32_t)(encrypt_count + count - counter_limit) <= 0;
+}
+#endif
+
+#if BTHOME_V2_KEYSTREAM_DEPTH > 0
+/***************************************************************************//**
+ * Compute the blocks of a counter value which do not depend on the data.
+ ******************************************************************************/
+static void compute_keystream(keystream_t *keystream,
+                              uint32_t counter,
+                              uint8_t data_len)
+{
+  uint8_t block[AES_BLOCK_LEN];
+  uint8_t mask[AES_BLOCK_LEN];
+
+  keystream->counter = counter;
+  keystream->stream_len = 0;
+  encrypt_block(block, CCM_FLAGS_A, counter, 0, mask);
+  memcpy(keystream->tag_mask, mask, MIC_LEN);
+  extend_keystream(keystream, data_len);
+  compute_mac_block(keystream, data_len);
+  keystream->valid = true;
+}
+
+/***************************************************************************//**
+ * Compute the keystream up to data_len bytes.
+ ******************************************************************************/
+static void extend_keystream(keystream_t *keystream, uint8_t data_len)
+{
+  uint8_t block[AES_BLOCK_LEN];
+
+  while (keystream->stream_len < data_len) {
+    encrypt_block(block,
+                  CCM_FLAGS_A,
+                  keystream->counter,
+                  keystream->stream_len / AES_BLOCK_LEN + 1,
+                  &keystream->stream[keystream->stream_len]);
+    keystream->stream_len += AES_BLOCK_LEN;
+  }
+}
+
+/***************************************************************************//**
+ * Compute the first CBC-MAC block, which holds the data length.
+ ******************************************************************************/
+static void compute_mac_block(keystream_t *keystream, uint8_t data_len)
+{
+  uint8_t block[AES_BLOCK_LEN];
+
+  encrypt_block(block,
+                CCM_FLAGS_B0,
+                keystream->counter,
+                data_len,
+                keystream->mac_block);
+  keystream->mac_len = data_len;
+}
+
+/***************************************************************************//**
+ * Encrypt a CCM block: flags, nonce with the counter value, then a 16-bit
+ * big endian value, the block index or the data length.
+ ******************************************************************************/
+static void encrypt_block(uint8_t *block,
+                          uint8_t flags,
+                          uint32_t counter,
+                          uint16_t value,
+                          uint8_t *out)
+{
+  block[0] = flags;
+  // MAC, UUID and device information
+  memcpy(&block[1], adv_nonce, 9);
+  block[10] = (uint8_t)counter;
+  block[11] = (uint8_t)(counter >> 8);
+  block[12] = (uint8_t)(counter >> 16);
+  block[13] = (uint8_t)(counter >> 24);
+  block[14] = (uint8_t)(value >> 8);
+  block[15] = (uint8_t)value;
+  mbedtls_aes_crypt_ecb(&encrypt_ctx, MBEDTLS_AES_ENCRYPT, block, out);
+}
+#endif
+
 /***************************************************************************//**
  * Returns the data size use for property.
  ******************************************************************************/
@@ -609,56 +1207,46 @@ static uint16_t get_factor(uint8_t sens)
 }
 
 /***************************************************************************//**
- * Sort the sensor data.
+ * Returns the length of the object at the given index, its id included.
  ******************************************************************************/
-static void sort_sensor_data(void)
+static uint8_t get_object_length(uint8_t index)
 {
-  uint8_t i, j, k, data_block_num;
-  data_block_t data_block[MEASUREMENT_MAX_LEN / 2 + 1];
-  data_block_t temp_data_block;
+  if (sensor_data[index] == EVENT_DIMMER) {
+    // the dimmer has a steps byte unless it did not move
+    return (sensor_data[index + 1] == EVENT_DIMMER_NONE) ? 2 : 3;
+  }
+  return get_byte_number(sensor_data[index]) + 1;
+}
 
-  for (i = 0, j = 0, data_block_num = 0; j < sensor_data_index; i++) {
-    // copy the object id
-    data_block[i].object_id = sensor_data[j];
-    data_block_num++;
-    // copy the data length
-    if (sensor_data[j] == EVENT_DIMMER) {
-      if (sensor_data[j + 1] == EVENT_DIMMER_NONE) {
-        data_block[i].data_len = 1;
-      } else {
-        data_block[i].data_len = 2;
-      }
-    } else {
-      data_block[i].data_len = get_byte_number(sensor_data[j]);
-    }
-    // copy the data
-    for (k = 0; k < data_block[i].data_len; k++) {
-      data_block[i].data[k] = sensor_data[j + 1 + k];
-    }
-    // move to the next object id location
-    j = j + data_block[i].data_len + 1;
-  }
-
-  if (data_block_num > 1) {
-    // bubble sort
-    for (i = 0; i < data_block_num - 1; i++) {
-      for (j = 0; j < data_block_num - 1 - i; j++) {
-        if (data_block[j].object_id > data_block[j + 1].object_id) {
-          memcpy(&temp_data_block, &data_block[j], sizeof(data_block_t));
-          memcpy(&data_block[j], &data_block[j + 1], sizeof(data_block_t));
-          memcpy(&data_block[j + 1], &temp_data_block, sizeof(data_block_t));
-        }
-      }
+/***************************************************************************//**
+ * Insert an object id, keeping the objects in ascending id order as required
+ * by the format. The object goes after those with the same id, and only the
+ * objects with a higher id are moved.
+ *
+ * @return Index of the data of the object, length - 1 bytes to fill in.
+ ******************************************************************************/
+static uint8_t insert_object(uint8_t object_id, uint8_t length)
+{
+  uint8_t index = sensor_data_index;
+
+  if (object_id < last_object_id) {
+    index = 0;
+    while (index < sensor_data_index && sensor_data[index] <= object_id) {
+      index += get_object_length(index);
     }
-    // copy the new order to sensor_data array
-    for (i = 0, j = 0; i < data_block_num && j < sensor_data_index; i++) {
-      sensor_data[j] = data_block[i].object_id;
-      for (k = 0; k < data_block[i].data_len; k++) {
-        sensor_data[j + 1 + k] = data_block[i].data[k];
-      }
-      j = j + data_block[i].data_len + 1;
+    if (index > sensor_data_index) {
+      index = sensor_data_index;
     }
+  } else {
+    last_object_id = object_id;
   }
+  memmove(&sensor_data[index + length],
+          &sensor_data[index],
+          sensor_data_index - index);
+  sensor_data[index] = object_id;
+  sensor_data_index += length;
+
+  return index + 1;
 }
 
 /***************************************************************************//**
@@ -666,7 +1254,7 @@ static void sort_sensor_data(void)
  ******************************************************************************/
 static void remove_oldest_sensor_data(void)
 {
-  uint8_t remove_length = get_byte_number(sensor_data[0]) + 1;
+  uint8_t remove_length = get_object_length(0);
 
   for (uint8_t i = 0; i < sensor_data_index - remove_length; i++) {
     sensor_data[i] = sensor_data[i + remove_length];
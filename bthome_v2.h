@@ -62,9 +62,26 @@
 // ENABLE_ENCRYPT will use extra 8 bytes,
 // so each Measurement should smaller than 15
 #define MEASUREMENT_MAX_LEN             23
+// Extended advertising (bluetooth_feature_extended_advertiser): a single
+// service data structure, its length byte limits the packet to 255 bytes
+#define BLE_EXT_ADVERT_MAX_LEN          255
+// 247 = 255(BLE_EXT_ADVERT_MAX_LEN)-8, as for MEASUREMENT_MAX_LEN
+#define MEASUREMENT_EXT_MAX_LEN         247
 #define BIND_KEY_LEN                    16
 #define NONCE_LEN                       13
 #define MIC_LEN                         4
+// Encryption keystream precomputed for the next counter values by
+// bthome_v2_prepare(), a power of 2; 0 encrypts with mbedtls_ccm on each build
+#ifndef BTHOME_V2_KEYSTREAM_DEPTH
+#define BTHOME_V2_KEYSTREAM_DEPTH       2
+#endif
+// Encryption counter persisted in NVM3: each write reserves the next
+// BTHOME_V2_COUNTER_BLOCK counter values, after a reset the counter resumes
+// past the reserved ones; 0 seeds the counter randomly at each init instead
+#ifndef BTHOME_V2_COUNTER_BLOCK
+#define BTHOME_V2_COUNTER_BLOCK         4096
+#endif
+#define BTHOME_V2_COUNTER_NVM3_KEY      0x1100
 
 #define FLAG                            0x020106
 #define FLAG1                           0x02
@@ -169,17 +186,6 @@
 #define EVENT_DIMMER_LEFT               0x01
 #define EVENT_DIMMER_RIGHT              0x02
 
-/***************************************************************************//**
- * @brief
- *    Typedef for data block.
- ******************************************************************************/
-typedef struct data_block
-{
-  uint8_t object_id;
-  uint8_t data[4];
-  uint8_t data_len;
-} data_block_t;
-
 /***************************************************************************//**
  * @brief
  *    Initializes function for advertising packet.
@@ -215,6 +221,40 @@ sl_status_t bthome_v2_init(uint8_t *device_name,
  ******************************************************************************/
 sl_status_t bthome_v2_set_device_name(uint8_t *device_name);
 
+/***************************************************************************//**
+ * @brief
+ *    Enable or disable the extended advertising of the measurements.
+ *    The measurements fit in a single extended advertising event of up to
+ *    BLE_EXT_ADVERT_MAX_LEN bytes, sent from a non-connectable advertising set.
+ *    The connectable legacy advertising goes on at a slower interval, as a
+ *    fallback for the scanners without extended advertising support: it
+ *    carries the objects with the lowest ids which fit in a legacy packet.
+ *    The packet is reset. Call it before the advertising is started.
+ *
+ * @param[in] enable
+ *    Extended advertising enabled.
+ *
+ * @return
+ *    Error status, SL_STATUS_NOT_SUPPORTED without the
+ *    bluetooth_feature_extended_advertiser component
+ ******************************************************************************/
+sl_status_t bthome_v2_set_extended_advertising(bool enable);
+
+/***************************************************************************//**
+ * @brief
+ *    Set the advertising interval, 1000 ms by default. The stack picks the
+ *    interval within +/- 10 %. The legacy fallback of the extended
+ *    advertising uses a 4 times longer interval. A running advertising is
+ *    restarted with the new interval.
+ *
+ * @param[in] interval_ms
+ *    Advertising interval in ms, 20 ms at least.
+ *
+ * @return
+ *    Error status
+ ******************************************************************************/
+sl_status_t bthome_v2_set_interval(uint16_t interval_ms);
+
 /***************************************************************************//**
  * @brief
  *    Add device event to the packet.
@@ -265,9 +305,45 @@ void bthome_v2_reset_measurement(void);
 /***************************************************************************//**
  * @brief
  *    Build packet used for advertise.
+ *    The extended advertising data longer than a single command goes through
+ *    the system data buffer.
+ *
+ * @return
+ *    Error status of the advertising data update, SL_STATUS_FAIL if no
+ *    encryption counter value could be reserved: the advertising data is
+ *    then left as it is
  ******************************************************************************/
+sl_status_t bthome_v2_build_packet(void);
 
-void bthome_v2_build_packet(void);
+/***************************************************************************//**
+ * @brief
+ *    Encode the legacy advertising packet of the measurements into a buffer,
+ *    e.g. one of a double buffer handed to sl_bt_legacy_advertiser_set_data()
+ *    of an advertising set of the caller. The measurements are encoded, and
+ *    encrypted, straight into the buffer, after the flags, name and service
+ *    data header copied from the cached template. With extended advertising
+ *    enabled, the objects which fit in a legacy packet are encoded.
+ *
+ * @param[out] buffer
+ *    Buffer receiving the packet.
+ * @param[in] size
+ *    Size of the buffer, BLE_ADVERT_MAX_LEN is always enough.
+ *
+ * @return
+ *    Exact length of the packet, 0 if it does not fit in the buffer or if no
+ *    encryption counter value could be reserved
+ ******************************************************************************/
+uint8_t bthome_v2_encode_packet(uint8_t *buffer, uint8_t size);
+
+/***************************************************************************//**
+ * @brief
+ *    Precompute the encryption of the next packets, the AES blocks which do
+ *    not depend on the data, so that building a packet is left with the
+ *    XOR of the keystream and the CBC-MAC of the data. Call it when idle,
+ *    e.g. from app_process_action(). Without it, the keystream is computed
+ *    when the packet is built; the packets are the same in both cases.
+ ******************************************************************************/
+void bthome_v2_prepare(void);
 
 /***************************************************************************//**
  * @brief
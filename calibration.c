@@ -0,0 +1,197 @@
+/***************************************************************************//**
+ * @file calibration.c
+ * @brief Multi-point calibration of the scale.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include "nvm3_default.h"
+#include "hx711.h"
+#include "calibration.h"
+
+#define CALIBRATION_NVM3_KEY    0x1000
+#define TEMPCO_NVM3_KEY         0x1001
+
+// The chip temperature is sampled at most this often, at the start of a measurement.
+#define TEMPERATURE_INTERVAL_MS 60000
+
+// Reference points, as stored in NVM3.
+typedef struct {
+  uint8_t count;
+  int32_t raw[CALIBRATION_MAX_POINTS];
+  int32_t mg[CALIBRATION_MAX_POINTS];
+} calibration_points_t;
+
+static float scale;
+static calibration_points_t captured;
+static calibration_points_t stored;
+static hx711_calibration_t table;
+static hx711_tempco_t tempco;
+
+/**************************************************************************//**
+ * Load the calibration table from NVM3 and apply it to the HX711.
+ *****************************************************************************/
+bool calibration_init(float default_scale)
+{
+  Ecode_t ec;
+
+  scale = default_scale;
+  captured.count = 0;
+  stored.count = 0;
+
+  ec = nvm3_readData(nvm3_defaultHandle,
+                     TEMPCO_NVM3_KEY,
+                     &tempco,
+                     sizeof(tempco));
+  if (ec == ECODE_NVM3_OK) {
+    HX711_set_tempco(&tempco, TEMPERATURE_INTERVAL_MS);
+  }
+
+  ec = nvm3_readData(nvm3_defaultHandle,
+                     CALIBRATION_NVM3_KEY,
+                     &stored,
+                     sizeof(stored));
+  if (ec == ECODE_NVM3_OK
+      && hx711_calibration_build(&table, stored.raw, stored.mg, stored.count)) {
+    HX711_set_calibration(&table);
+    return true;
+  }
+
+  stored.count = 0;
+  HX711_set_calibration(NULL);
+  HX711_set_scale(scale);
+  return false;
+}
+
+/**************************************************************************//**
+ * Forget the captured points.
+ *****************************************************************************/
+void calibration_start(void)
+{
+  captured.count = 0;
+}
+
+/**************************************************************************//**
+ * Add a captured point.
+ *****************************************************************************/
+sl_status_t calibration_add_point(int32_t raw, int32_t mg)
+{
+  if (captured.count == CALIBRATION_MAX_POINTS) {
+    return SL_STATUS_FULL;
+  }
+  captured.raw[captured.count] = raw;
+  captured.mg[captured.count] = mg;
+  captured.count++;
+  return SL_STATUS_OK;
+}
+
+/**************************************************************************//**
+ * Build, store and apply the table.
+ *****************************************************************************/
+sl_status_t calibration_apply(void)
+{
+  Ecode_t ec;
+
+  // The table in use is read from interrupt context, build the new one aside.
+  static hx711_calibration_t new_table;
+  if (!hx711_calibration_build(&new_table, captured.raw, captured.mg, captured.count)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  ec = nvm3_writeData(nvm3_defaultHandle,
+                      CALIBRATION_NVM3_KEY,
+                      &captured,
+                      sizeof(captured));
+  if (ec != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+
+  HX711_set_calibration(NULL);
+  table = new_table;
+  HX711_set_calibration(&table);
+  stored = captured;
+  return SL_STATUS_OK;
+}
+
+/**************************************************************************//**
+ * Erase the stored table and go back to the default scale.
+ *****************************************************************************/
+sl_status_t calibration_reset(void)
+{
+  Ecode_t ec;
+
+  HX711_set_calibration(NULL);
+  HX711_set_scale(scale);
+  stored.count = 0;
+
+  ec = nvm3_deleteObject(nvm3_defaultHandle, CALIBRATION_NVM3_KEY);
+  if (ec != ECODE_NVM3_OK && ec != ECODE_NVM3_ERR_KEY_NOT_FOUND) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+/**************************************************************************//**
+ * Store the temperature coefficients in NVM3 and apply them.
+ *****************************************************************************/
+sl_status_t calibration_set_tempco(const hx711_tempco_t *new_tempco)
+{
+  Ecode_t ec;
+
+  ec = nvm3_writeData(nvm3_defaultHandle,
+                      TEMPCO_NVM3_KEY,
+                      new_tempco,
+                      sizeof(*new_tempco));
+  if (ec != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+
+  // The coefficients in use are read from interrupt context.
+  HX711_set_tempco(NULL, 0);
+  tempco = *new_tempco;
+  HX711_set_tempco(&tempco, TEMPERATURE_INTERVAL_MS);
+  return SL_STATUS_OK;
+}
+
+/**************************************************************************//**
+ * Serialize the points of the table in use.
+ *****************************************************************************/
+size_t calibration_get_points(uint8_t *buf, size_t size)
+{
+  size_t len = 0;
+
+  if (size < 1) {
+    return 0;
+  }
+  buf[len++] = stored.count;
+  for (uint8_t i = 0; i < stored.count && len + 8 <= size; i++) {
+    memcpy(&buf[len], &stored.raw[i], sizeof(int32_t));
+    memcpy(&buf[len + 4], &stored.mg[i], sizeof(int32_t));
+    len += 8;
+  }
+  return len;
+}
@@ -0,0 +1,104 @@
+/***************************************************************************//**
+ * @file calibration.h
+ * @brief Multi-point calibration of the scale.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+#include "hx711.h"
+
+// Maximum number of reference points, the zero point excluded.
+#define CALIBRATION_MAX_POINTS  (HX711_CAL_POINTS - 1)
+
+// Calibration procedure over GATT: opcode followed by its parameters.
+#define CALIBRATION_OP_START    0x00  // forget the captured points
+#define CALIBRATION_OP_CAPTURE  0x01  // int32 reference weight in mg follows
+#define CALIBRATION_OP_APPLY    0x02  // build, store and use the table
+#define CALIBRATION_OP_RESET    0x03  // erase the table, back to the default scale
+#define CALIBRATION_OP_TEMPCO   0x04  // int32 reference temperature in 0.01 degC, zero drift
+                                      // in 0.01 counts/degC and span drift in 0.01 ppm/degC follow
+
+/**************************************************************************//**
+ * Load the calibration table and the temperature coefficients from NVM3 and
+ * apply them to the HX711.
+ *
+ * @param[in] default_scale Scale used when no table is stored.
+ *
+ * @return true if a stored table was applied.
+ *****************************************************************************/
+bool calibration_init(float default_scale);
+
+/**************************************************************************//**
+ * Forget the captured points. The table in use is not changed.
+ *****************************************************************************/
+void calibration_start(void);
+
+/**************************************************************************//**
+ * Add a captured point.
+ *
+ * @param[in] raw Reading without the offset.
+ * @param[in] mg Reference weight in milligrams.
+ *
+ * @return SL_STATUS_FULL if the maximum number of points is reached.
+ *****************************************************************************/
+sl_status_t calibration_add_point(int32_t raw, int32_t mg);
+
+/**************************************************************************//**
+ * Build the piecewise-linear table from the captured points, store it in NVM3
+ * and apply it.
+ *
+ * @return SL_STATUS_INVALID_PARAMETER if the points do not form a table.
+ *****************************************************************************/
+sl_status_t calibration_apply(void);
+
+/**************************************************************************//**
+ * Erase the stored table and go back to the default scale.
+ *****************************************************************************/
+sl_status_t calibration_reset(void);
+
+/**************************************************************************//**
+ * Store the temperature coefficients in NVM3 and apply them.
+ *
+ * @param[in] tempco Temperature coefficients of the load cell.
+ *****************************************************************************/
+sl_status_t calibration_set_tempco(const hx711_tempco_t *tempco);
+
+/**************************************************************************//**
+ * Serialize the points of the table in use: count, then raw and mg pairs as
+ * little endian int32.
+ *
+ * @return Number of bytes written.
+ *****************************************************************************/
+size_t calibration_get_points(uint8_t *buf, size_t size);
+
+#endif // CALIBRATION_H
@@ -1,126 +1,1164 @@
+#include <math.h>
 #include "hx711.h"
 #include "hx711_platform.h"
+#include "profile.h"
 
-static uint8_t GAIN = 1;   // amplification factor
-static long OFFSET = 0;    // used for tare weight
-static float SCALE = 1;    // used to return weight in grams, kg, ounces, whatever
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART
+// The 24 + gain clock pulses of a readout are generated as frames of equal size,
+// since the frame size cannot change within a DMA transfer: 25 = 5 * 5, 26 = 2 * 13, 27 = 3 * 9
+static const uint8_t FRAME_BITS[3] = { 5, 13, 9 };   // indexed by gain - 1
 
-void HX711_init(uint8_t gain) {
-    HX711_set_gain(gain);
+static void transfer_done(void *ctx);
+#endif
+
+static void shift_in(hx711_t *const *cells, uint8_t count, long *values);
+static void dout_irq_handler(uint8_t int_no, void *ctx);
+static void deliver(hx711_t *dev, long value);
+static void group_deliver(hx711_group_t *group);
+static void track(hx711_t *dev, long value);
+static uint8_t validate(hx711_t *dev, long value);
+static void rearm(hx711_t *dev);
+static void group_rearm(hx711_group_t *group);
+static long net_value(hx711_t *dev, long raw);
+static float to_units(hx711_t *dev, long raw);
+static void sample_temperature(hx711_t *dev);
+static void start_settling(hx711_t *dev);
+
+// result of the blocking reads
+static volatile uint8_t DONE = 0;
+static volatile long VALUE = 0;
+static volatile uint8_t FAULTS = 0;
+static void read_done(hx711_t *dev, long value);
+static void group_read_done(hx711_group_t *group, const hx711_group_result_t *result);
+
+static uint8_t measure_start(hx711_t *dev, uint8_t min_times, uint8_t max_times, float limit, uint8_t tare,
+                             hx711_measure_cb_t callback);
+static void measure_sample(hx711_t *dev, long value);
+static void measure_timeout(void *ctx);
+
+// result of the blocking measurements
+static volatile uint8_t MEASURED = 0;
+static hx711_measurement_t MEASUREMENT;
+static void measure_done(hx711_t *dev, const hx711_measurement_t *result);
+
+void hx711_init(hx711_t *dev, uint8_t sck_port, uint8_t sck_pin, uint8_t dout_port, uint8_t dout_pin, uint8_t gain) {
+    dev->sck_port = sck_port;
+    dev->sck_pin = sck_pin;
+    dev->dout_port = dout_port;
+    dev->dout_pin = dout_pin;
+    dev->rate_port = HX711_NO_PIN;
+    dev->rate_pin = HX711_NO_PIN;
+    dev->gain = 1;
+    dev->converting = 1;
+    dev->converted = 1;
+    dev->offset = 0;
+    hx711_set_scale(dev, 1);
+    dev->calibration = 0;
+    hx711_set_tempco(dev, 0, 0);
+    dev->busy = 0;
+    dev->callback = 0;
+    dev->faults = 0;
+    dev->group = 0;
+    dev->filter = 0;
+    dev->autozero.window_mg = 0;
+    dev->valid.enabled = 0;
+    dev->valid.health = (hx711_health_t){ 0 };
+    dev->measure.active = 0;
+    dev->power.down = 0;
+    dev->power.settling = 0;
+    dev->power.settle_ms = HX711_SETTLE_MS_10SPS;
+    dev->power.discarded = 0;
+    dev->user = 0;
+
+    transport_init();
+    pins_init(dev);
+    dev->dout_int = dout_irq_init(dev, dout_irq_handler);
+    hx711_set_gain(dev, gain);
 }
 
-uint8_t HX711_is_ready() {
-    return (get_DOUT() == 0);
+uint8_t hx711_is_ready(hx711_t *dev) {
+    return (get_DOUT(dev) == 0);
 }
 
-void HX711_set_gain(uint8_t gain) {
+void hx711_set_gain(hx711_t *dev, uint8_t gain) {
+    hx711_select_gain(dev, gain);
+
+    clock_low(dev);
+    long value;
+    (void)hx711_read(dev, &value);
+}
+
+void hx711_select_gain(hx711_t *dev, uint8_t gain) {
     switch (gain) {
         case 128:        // channel A, gain factor 128
-            GAIN = 1;
+            dev->gain = 1;
             break;
         case 64:        // channel A, gain factor 64
-            GAIN = 3;
+            dev->gain = 3;
             break;
         case 32:        // channel B, gain factor 32
-            GAIN = 2;
+            dev->gain = 2;
             break;
     }
+}
+
+void hx711_set_rate_pin(hx711_t *dev, uint8_t rate_port, uint8_t rate_pin) {
+    dev->rate_port = rate_port;
+    dev->rate_pin = rate_pin;
+    rate_pin_init(dev);
+}
+
+uint8_t hx711_set_rate(hx711_t *dev, uint8_t sps) {
+    if (dev->rate_pin == HX711_NO_PIN) {
+        return 0;
+    }
+    // RATE low: 10 SPS, high: 80 SPS
+    uint32_t settle_ms = dev->power.settle_ms;
+    if (sps == 80) {
+        rate_high(dev);
+        dev->power.settle_ms = HX711_SETTLE_MS_80SPS;
+    } else {
+        rate_low(dev);
+        dev->power.settle_ms = HX711_SETTLE_MS_10SPS;
+    }
+    // the output settles again at the new rate; a powered down chip settles when powered up
+    if (dev->power.settle_ms != settle_ms && !dev->power.down) {
+        start_settling(dev);
+    }
+    return 1;
+}
+
+uint8_t hx711_read_async(hx711_t *dev, hx711_read_cb_t callback) {
+    critical_declare();
+
+    critical_enter();
+    if (dev->busy) {
+        critical_exit();
+        return 0;
+    }
+    dev->busy = 1;
+    dev->callback = callback;
+    dev->group = 0;
+    dout_irq_enable(dev);
+    critical_exit();
+
+    // the conversion may have completed before the edge interrupt was armed
+    if (hx711_is_ready(dev)) {
+        dout_irq_handler(dev->dout_int, dev);
+    }
+    return 1;
+}
+
+void hx711_read_cancel(hx711_t *dev) {
+    critical_declare();
+
+    critical_enter();
+    dout_irq_disable(dev);
+    deadline_stop(dev);
+    dev->busy = 0;
+    dev->group = 0;
+    dev->measure.active = 0;
+    critical_exit();
+}
 
-    clock_low();
-    HX711_read();
+uint8_t hx711_get_faults(hx711_t *dev) {
+    return dev->faults;
 }
 
-long HX711_read() {
-    // wait for the chip to become ready
-    while (!HX711_is_ready()) {
+uint8_t hx711_is_busy(hx711_t *dev) {
+    return dev->busy;
+}
+
+uint8_t hx711_read(hx711_t *dev, long *value) {
+    PROFILE_START(PROFILE_HX711_READ);
+    DONE = 0;
+    // wait for any other read to finish, then for our own
+    while (!hx711_read_async(dev, read_done)) {
+        wait_until(!dev->busy);
+    }
+    uint32_t start = get_timestamp();
+    wakeup_start(HX711_READ_TIMEOUT_MS);
+    while (!DONE) {
+        if (get_timestamp() - start >= timestamp_from_ms(HX711_READ_TIMEOUT_MS)) {
+            hx711_read_cancel(dev);
+            dev->valid.health.timeouts++;
+            dev->valid.health.status = HX711_FAULT_TIMEOUT;
+            PROFILE_STOP(PROFILE_HX711_READ);
+            return 0;
+        }
+        wait_until(DONE);
+    }
+    wakeup_stop();
+    PROFILE_STOP(PROFILE_HX711_READ);
+    if (FAULTS) {
+        return 0;
+    }
+    *value = VALUE;
+    return 1;
+}
+
+uint8_t hx711_read_average(hx711_t *dev, uint8_t times, long *value) {
+    int64_t sum = 0;    // 255 readings of 24 bits overflow 32 bits
+    long reading;
+    for (uint8_t i = 0; i < times; i++) {
+        // a chip which did not answer is not waited for again
+        if (!hx711_read(dev, &reading)) {
+            return 0;
+        }
+        sum += reading;
     }
+    *value = (long)(sum / times);
+    return 1;
+}
+
+double hx711_get_value(hx711_t *dev) {
+    return hx711_get_mean_value(dev, 1);
+}
+
+double hx711_get_mean_value(hx711_t *dev, uint8_t times) {
+    long raw;
+    return hx711_read_average(dev, times, &raw) ? net_value(dev, raw) : NAN;
+}
+
+float hx711_get_units(hx711_t *dev) {
+    return hx711_get_mean_units(dev, 1);
+}
+
+float hx711_get_mean_units(hx711_t *dev, uint8_t times) {
+    long raw;
+    return hx711_read_average(dev, times, &raw) ? to_units(dev, raw) : NAN;
+}
+
+int32_t hx711_to_mg(hx711_t *dev, long raw) {
+    PROFILE_START(PROFILE_HX711_TO_MG);
+    const hx711_calibration_t *cal = dev->calibration;
+    int32_t net = (int32_t)net_value(dev, raw);
+    int64_t mg;
+
+    if (cal) {
+        uint8_t lo = 0;
+        uint8_t hi = cal->count - 1;
+        while (hi - lo > 1) {
+            uint8_t mid = (lo + hi) / 2;
+            if (net < cal->raw[mid]) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        mg = ((int64_t)cal->mg[lo] << HX711_MG_Q) + (int64_t)(net - cal->raw[lo]) * cal->slope[lo];
+    } else {
+        mg = (int64_t)net * dev->mg_per_count;
+    }
+
+    // span correction of the temperature compensation, Q16 as well
+    if (dev->temp.span_q16 != (1 << HX711_MG_Q)) {
+        mg = (mg >> HX711_MG_Q) * dev->temp.span_q16;
+    }
+
+    // round to nearest
+    int32_t result = (int32_t)((mg + (1 << (HX711_MG_Q - 1))) >> HX711_MG_Q);
+    PROFILE_STOP(PROFILE_HX711_TO_MG);
+    return result;
+}
+
+int32_t hx711_to_counts(hx711_t *dev, long raw) {
+    int64_t net = net_value(dev, raw);
+
+    // the span correction of hx711_to_mg(), applied to the counts
+    return (int32_t)((net * dev->temp.span_q16 + (1 << (HX711_MG_Q - 1))) >> HX711_MG_Q);
+}
+
+uint8_t hx711_get_mg(hx711_t *dev, int32_t *mg) {
+    return hx711_get_mean_mg(dev, 1, mg);
+}
+
+uint8_t hx711_get_mean_mg(hx711_t *dev, uint8_t times, int32_t *mg) {
+    long raw;
+    if (!hx711_read_average(dev, times, &raw)) {
+        return 0;
+    }
+    *mg = hx711_to_mg(dev, raw);
+    return 1;
+}
+
+uint8_t hx711_measure_async(hx711_t *dev, int32_t resolution_mg, uint8_t min_times, uint8_t max_times,
+                            hx711_measure_cb_t callback) {
+    if (min_times < 2) {
+        min_times = 2;
+    }
+    if (max_times < min_times) {
+        max_times = min_times;
+    }
+    // half width of the interval in counts, with z = 2
+    float limit = fabsf((float)resolution_mg * (1 << HX711_MG_Q) / dev->mg_per_count) / 2;
+    return measure_start(dev, min_times, max_times, limit, 0, callback);
+}
+
+uint8_t hx711_tare_async(hx711_t *dev, uint8_t times, hx711_measure_cb_t callback) {
+    if (times == 0) {
+        times = 1;
+    }
+    return measure_start(dev, times, times, 0, 1, callback);
+}
+
+uint8_t hx711_get_adaptive_mg(hx711_t *dev, int32_t resolution_mg, uint8_t min_times, uint8_t max_times,
+                              hx711_measurement_t *result) {
+    MEASURED = 0;
+    while (!hx711_measure_async(dev, resolution_mg, min_times, max_times, measure_done)) {
+        wait_until(!dev->busy && !dev->measure.active);
+    }
+    // the deadline of the measurement bounds the wait
+    while (!MEASURED) {
+        wait_until(MEASURED);
+    }
+    *result = MEASUREMENT;
+    return MEASUREMENT.status == 0;
+}
+
+void hx711_set_filter(hx711_t *dev, hx711_filter_t *filter) {
+    critical_declare();
+    critical_enter();
+    dev->filter = filter;
+    critical_exit();
+}
 
-    unsigned long value = 0;
-    uint8_t data[3] = { 0 };
-    uint8_t filler = 0x00;
+long hx711_get_filtered(hx711_t *dev) {
+    return dev->filter ? hx711_filter_output(dev->filter) : 0;
+}
+
+int32_t hx711_get_filtered_mg(hx711_t *dev) {
+    return hx711_to_mg(dev, hx711_get_filtered(dev));
+}
+
+void hx711_set_autozero(hx711_t *dev, int32_t window_mg, uint32_t hold_ms, uint8_t shift) {
+    critical_declare();
+    critical_enter();
+    dev->autozero.window_mg = window_mg;
+    dev->autozero.hold = timestamp_from_ms(hold_ms);
+    dev->autozero.shift = shift;
+    dev->autozero.in_window = 0;
+    critical_exit();
+}
+
+uint8_t hx711_tare(hx711_t *dev, uint8_t times) {
+    long raw;
+    sample_temperature(dev);
+    if (!hx711_read_average(dev, times, &raw)) {
+        return 0;
+    }
+    // the offset is kept at the reference temperature of the compensation
+    hx711_set_offset(dev, raw - dev->temp.zero);
+    return 1;
+}
+
+void hx711_set_scale(hx711_t *dev, float scale) {
+    dev->scale = scale;
+    // the only floating point division of the fixed-point pipeline, done once per calibration
+    dev->mg_per_count = (int32_t)lroundf(1000.0f * (1 << HX711_MG_Q) / scale);
+}
+
+uint8_t hx711_calibration_build(hx711_calibration_t *cal, const int32_t *raw, const int32_t *mg, uint8_t count) {
+    if (count == 0 || count >= HX711_CAL_POINTS) {
+        return 0;
+    }
+
+    // insertion sort of the points, starting with the zero point
+    cal->raw[0] = 0;
+    cal->mg[0] = 0;
+    cal->count = 1;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t pos = cal->count;
+        while (pos > 0 && cal->raw[pos - 1] > raw[i]) {
+            cal->raw[pos] = cal->raw[pos - 1];
+            cal->mg[pos] = cal->mg[pos - 1];
+            pos--;
+        }
+        if (pos > 0 && cal->raw[pos - 1] == raw[i]) {
+            return 0;
+        }
+        cal->raw[pos] = raw[i];
+        cal->mg[pos] = mg[i];
+        cal->count++;
+    }
+
+    // the divisions are done once here, the conversion only multiplies
+    for (uint8_t i = 0; i < cal->count - 1; i++) {
+        int64_t dmg = (int64_t)(cal->mg[i + 1] - cal->mg[i]) << HX711_MG_Q;
+        int32_t draw = cal->raw[i + 1] - cal->raw[i];
+        cal->slope[i] = (int32_t)((dmg + draw / 2) / draw);
+    }
+    return 1;
+}
+
+void hx711_set_calibration(hx711_t *dev, const hx711_calibration_t *cal) {
+    if (cal) {
+        int32_t raw = cal->raw[cal->count - 1] - cal->raw[0];
+        int32_t mg = cal->mg[cal->count - 1] - cal->mg[0];
+        if (mg != 0) {
+            hx711_set_scale(dev, raw * 1000.0f / mg);
+        }
+    }
+    dev->calibration = cal;
+}
+
+void hx711_set_validation(hx711_t *dev, long spike, uint8_t stuck_count) {
+    critical_declare();
+    critical_enter();
+    dev->valid.enabled = 1;
+    dev->valid.spike = spike;
+    dev->valid.stuck_count = stuck_count;
+    dev->valid.rejects = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        dev->valid.channels[i].repeats = 0;
+        dev->valid.channels[i].primed = 0;
+        dev->valid.channels[i].has_candidate = 0;
+    }
+    critical_exit();
+}
+
+void hx711_get_health(hx711_t *dev, hx711_health_t *health) {
+    critical_declare();
+    critical_enter();
+    *health = dev->valid.health;
+    critical_exit();
+}
+
+void hx711_set_tempco(hx711_t *dev, const hx711_tempco_t *tempco, uint32_t interval_ms) {
+    dev->temp.tempco = tempco;
+    dev->temp.interval = timestamp_from_ms(interval_ms);
+    dev->temp.valid = 0;
+    if (tempco) {
+        hx711_set_temperature(dev, tempco->ref_celsius);
+    } else {
+        dev->temp.celsius = 0;
+        dev->temp.zero = 0;
+        dev->temp.span = 1;
+        dev->temp.span_q16 = 1 << HX711_MG_Q;
+    }
+}
+
+void hx711_set_temperature(hx711_t *dev, float celsius) {
+    const hx711_tempco_t *tempco = dev->temp.tempco;
+    if (!tempco) {
+        return;
+    }
+    // the floating point operations are done here, once per temperature sample
+    float delta = celsius - tempco->ref_celsius;
+    float span = 1.0f / (1.0f + tempco->span_ppm_per_degree * delta * 1e-6f);
+
+    critical_declare();
+    critical_enter();
+    dev->temp.celsius = celsius;
+    dev->temp.zero = lroundf(tempco->zero_per_degree * delta);
+    dev->temp.span = span;
+    dev->temp.span_q16 = (int32_t)(span * (1 << HX711_MG_Q) + 0.5f);
+    critical_exit();
+}
+
+float hx711_get_temperature(hx711_t *dev) {
+    return dev->temp.celsius;
+}
+
+float hx711_get_scale(hx711_t *dev) {
+    return dev->scale;
+}
+
+void hx711_set_offset(hx711_t *dev, long offset) {
+    dev->offset = offset;
+}
+
+long hx711_get_offset(hx711_t *dev) {
+    return dev->offset;
+}
+
+void hx711_power_down(hx711_t *dev) {
+    hx711_read_cancel(dev);
+    clock_low(dev);
+    clock_high(dev);
+    dev->power.down = 1;
+}
+
+void hx711_power_up(hx711_t *dev) {
+    clock_low(dev);
+    if (dev->power.down) {
+        // the chip resets on wake up, its output settles like after a rate change
+        dev->power.down = 0;
+        dev->converting = 1;
+        start_settling(dev);
+    }
+}
+
+uint8_t hx711_is_powered_down(hx711_t *dev) {
+    return dev->power.down;
+}
+
+uint32_t hx711_get_settling_ms(hx711_t *dev) {
+    return dev->power.settle_ms;
+}
+
+uint8_t hx711_group_init(hx711_group_t *group, hx711_t *const *cells, uint8_t count) {
+    if (count == 0 || count > HX711_GROUP_MAX) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (cells[i]->sck_port != cells[0]->sck_port || cells[i]->sck_pin != cells[0]->sck_pin
+            || cells[i]->gain != cells[0]->gain) {
+            return 0;
+        }
+        group->cells[i] = cells[i];
+    }
+    group->count = count;
+    group->busy = 0;
+    group->pending = 0;
+    group->callback = 0;
+    return 1;
+}
+
+uint8_t hx711_group_read_async(hx711_group_t *group, hx711_group_cb_t callback) {
+    critical_declare();
+
+    critical_enter();
+    if (group->busy) {
+        critical_exit();
+        return 0;
+    }
+    for (uint8_t i = 0; i < group->count; i++) {
+        if (group->cells[i]->busy) {
+            critical_exit();
+            return 0;
+        }
+    }
+    group->busy = 1;
+    group->callback = callback;
+    group->rejects = 0;
+    for (uint8_t i = 0; i < group->count; i++) {
+        hx711_t *dev = group->cells[i];
+        dev->busy = 1;
+        dev->callback = 0;
+        dev->group = group;
+    }
+    critical_exit();
+
+    group_rearm(group);
+    return 1;
+}
+
+void hx711_group_read(hx711_group_t *group, hx711_group_result_t *result) {
+    DONE = 0;
+    while (!hx711_group_read_async(group, group_read_done)) {
+        wait_until(!group->busy);
+    }
+    while (!DONE) {
+        wait_until(DONE);
+    }
+    *result = group->result;
+}
+
+long HX711_decode(const uint16_t *frames, uint8_t frame_bits) {
+    uint16_t mask = (1 << frame_bits) - 1;
+    uint32_t data = 0;
+    uint8_t bits = 0;
+
+    // concatenate the first 24 received bits
+    for (uint8_t i = 0; bits < 24; i++) {
+        uint8_t take = (24 - bits < frame_bits) ? 24 - bits : frame_bits;
+        data = (data << take) | ((frames[i] & mask) >> (frame_bits - take));
+        bits += take;
+    }
+
+    // Replicate the most significant bit to pad out a 32-bit signed integer
+    if (data & 0x800000) {
+        data |= 0xFF000000;
+    }
+
+    return (long)(int32_t)(data);
+}
+
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART
+// the readout of the USART transport is complete
+static void transfer_done(void *ctx) {
+    hx711_t *dev = ctx;
+    deliver(dev, HX711_decode(dev->frames, dev->frame_bits));
+}
+#endif
+
+// clocks out the 24 bits of ready conversions and selects the gain of the next ones
+// the cells share the clock line of the first one, their DOUT pins are sampled on the same edges
+static void shift_in(hx711_t *const *cells, uint8_t count, long *values) {
+    uint16_t data[HX711_GROUP_MAX][3] = { 0 };
+    hx711_t *clock = cells[0];
 
     // pulse the clock pin 24 times to read the data
-    for(int8_t n = 2; n>=0; n--) {
+    for(uint8_t n = 0; n < 3; n++) {
         for(int8_t i=7; i>=0; i--) {
-            clock_high();
+            clock_high(clock);
             delay(); // let some time to hx711 to update output value
-            data[n] |= get_DOUT() << i;
-            clock_low();
+            for (uint8_t c = 0; c < count; c++) {
+                data[c][n] |= get_DOUT(cells[c]) << i;
+            }
+            clock_low(clock);
         }
     }
     // set the channel and the gain factor for the next reading using the clock pin
-    for (unsigned int i = 0; i < GAIN; i++) {
-        clock_high();
+    for (unsigned int i = 0; i < clock->gain; i++) {
+        clock_high(clock);
         delay(); // let some time to hx711 to understand the command
-        clock_low();
+        clock_low(clock);
     }
 
-    // Replicate the most significant bit to pad out a 32-bit signed integer
-    if (data[2] & 0x80) {
-        filler = 0xFF;
+    for (uint8_t c = 0; c < count; c++) {
+        values[c] = HX711_decode(data[c], 8);
+    }
+}
+
+// DOUT falling edge: the conversion is ready, clock it out and deliver it
+static void dout_irq_handler(uint8_t int_no, void *ctx) {
+    (void)int_no;
+    hx711_t *dev = ctx;
+    critical_declare();
+
+    critical_enter();
+    // DOUT also toggles while shifting out the data, ignore those edges
+    if (!dev->busy || !hx711_is_ready(dev)) {
+        critical_exit();
+        return;
+    }
+    dout_irq_disable(dev);
+
+    hx711_group_t *group = dev->group;
+    if (group) {
+        // the burst is clocked out once every cell of the group is ready
+        for (uint8_t i = 0; i < group->count; i++) {
+            if (group->cells[i] == dev) {
+                group->pending &= ~(1 << i);
+            }
+        }
+        if (group->pending) {
+            critical_exit();
+            return;
+        }
+        shift_in(group->cells, group->count, group->result.raw);
+        critical_exit();
+
+        group_deliver(group);
+        return;
+    }
+
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART
+    // the read stays busy until the transfer completes
+    // if another instance holds the USART, this one falls back to the GPIO transport
+    dev->frame_bits = FRAME_BITS[dev->gain - 1];
+    if (transport_start(dev, (24 + dev->gain) / dev->frame_bits, transfer_done)) {
+        critical_exit();
+        return;
+    }
+#endif
+    long value;
+    PROFILE_START(PROFILE_HX711_READOUT);
+    shift_in(&dev, 1, &value);
+    PROFILE_STOP(PROFILE_HX711_READOUT);
+    critical_exit();
+
+    deliver(dev, value);
+}
+
+// discards the conversions completing within the settling time from now
+static void start_settling(hx711_t *dev) {
+    critical_declare();
+
+    critical_enter();
+    dev->power.wake = get_timestamp();
+    dev->power.settle = timestamp_from_ms(dev->power.settle_ms);
+    dev->power.settling = 1;
+    critical_exit();
+}
+
+// completes the armed read
+static void deliver(hx711_t *dev, long value) {
+    // the value was converted with the pulses of the previous readout, this readout has programmed
+    // the conversion now in progress
+    dev->converted = dev->converting;
+    dev->converting = dev->gain;
+    if (dev->power.settling) {
+        if ((uint32_t)(get_timestamp() - dev->power.wake) < dev->power.settle) {
+            dev->power.discarded++;
+            rearm(dev);
+            return;
+        }
+        dev->power.settling = 0;
+    }
+    uint8_t faults = dev->valid.enabled ? validate(dev, value) : 0;
+    if (faults && ++dev->valid.rejects <= HX711_MAX_REJECTS) {
+        dev->valid.health.rejected++;
+        rearm(dev);
+        return;
+    }
+    dev->valid.rejects = 0;
+
+    // a faulty reading only completes the read, with its faults: it is not averaged or tracked
+    hx711_read_cb_t callback = dev->callback;
+    dev->faults = faults;
+    if (!faults) {
+        track(dev, value);
+    }
+    dev->busy = 0;
+    if (callback) {
+        callback(dev, value);
+    }
+}
+
+// checks a reading against the previous ones of its channel and gain, updates the health counters;
+// returns the faults found
+static uint8_t validate(hx711_t *dev, long value) {
+    hx711_valid_channel_t *channel = &dev->valid.channels[dev->converted - 1];
+    uint8_t faults = 0;
+
+    dev->valid.health.samples++;
+    if (value == 0x7FFFFF || value == -0x800000) {
+        faults |= HX711_FAULT_SATURATED;
+        dev->valid.health.saturated++;
+    }
+
+    if (channel->primed && value == channel->last) {
+        if (dev->valid.stuck_count && ++channel->repeats >= dev->valid.stuck_count - 1) {
+            faults |= HX711_FAULT_STUCK;
+            dev->valid.health.stuck++;
+        }
     } else {
-        filler = 0x00;
+        channel->repeats = 0;
     }
+    channel->last = value;
 
-    // Construct a 32-bit signed integer
-    value = ( (unsigned long)(filler) << 24
-            | (unsigned long)(data[2]) << 16
-            | (unsigned long)(data[1]) << 8
-            | (unsigned long)(data[0]) );
+    if (!faults && dev->valid.spike && channel->primed) {
+        long step = value - channel->estimate;
+        if (step > dev->valid.spike || step < -dev->valid.spike) {
+            long diff = value - channel->candidate;
+            if (channel->has_candidate && diff <= dev->valid.spike && diff >= -dev->valid.spike) {
+                // confirmed by the previous reading: the load has changed
+                channel->has_candidate = 0;
+            } else {
+                channel->candidate = value;
+                channel->has_candidate = 1;
+                faults |= HX711_FAULT_SPIKE;
+                dev->valid.health.spikes++;
+            }
+        } else {
+            channel->has_candidate = 0;
+        }
+    }
 
-    return (long)(value);
+    if (!faults) {
+        channel->estimate = value;
+        channel->primed = 1;
+    }
+    dev->valid.health.status = faults;
+    return faults;
 }
 
-long HX711_read_average(uint8_t times) {
-    long sum = 0;
-    for (uint8_t i = 0; i < times; i++) {
-        sum += HX711_read();
+// waits for the next conversion, the read stays busy
+static void rearm(hx711_t *dev) {
+    critical_declare();
+
+    critical_enter();
+    dout_irq_enable(dev);
+    critical_exit();
+    if (hx711_is_ready(dev)) {
+        dout_irq_handler(dev->dout_int, dev);
+    }
+}
+
+// waits for the next conversion of every cell, the group read stays busy
+static void group_rearm(hx711_group_t *group) {
+    critical_declare();
+
+    critical_enter();
+    group->pending = (1 << group->count) - 1;
+    for (uint8_t i = 0; i < group->count; i++) {
+        dout_irq_enable(group->cells[i]);
+    }
+    critical_exit();
+
+    // some conversions may have completed before the edge interrupts were armed
+    for (uint8_t i = 0; i < group->count; i++) {
+        hx711_t *dev = group->cells[i];
+        if (hx711_is_ready(dev)) {
+            dout_irq_handler(dev->dout_int, dev);
+        }
+    }
+}
+
+// feeds a reading to the filter and the auto-zero tracker of the instance
+static void track(hx711_t *dev, long value) {
+    hx711_autozero_t *autozero = &dev->autozero;
+
+    if (dev->filter) {
+        value = hx711_filter_update(dev->filter, value);
+    }
+    if (autozero->window_mg == 0) {
+        return;
+    }
+
+    int32_t mg = hx711_to_mg(dev, value);
+    if (mg > autozero->window_mg || mg < -autozero->window_mg) {
+        autozero->in_window = 0;
+        return;
+    }
+
+    uint32_t now = get_timestamp();
+    if (!autozero->in_window) {
+        autozero->in_window = 1;
+        autozero->since = now;
+    } else if (now - autozero->since >= autozero->hold) {
+        // round toward the reading, so that the offset eventually reaches it
+        long error = net_value(dev, value);
+        long step = error >> autozero->shift;
+        if (step == 0) {
+            step = (error > 0) - (error < 0);
+        }
+        dev->offset += step;
+    }
+}
+
+// reading without the tare and the zero drift of the temperature compensation
+static long net_value(hx711_t *dev, long raw) {
+    return raw - dev->offset - dev->temp.zero;
+}
+
+static float to_units(hx711_t *dev, long raw) {
+    return (float)net_value(dev, raw) / dev->scale * dev->temp.span;
+}
+
+// samples the temperature for the compensation, piggybacking on the measurements on a slow schedule
+static void sample_temperature(hx711_t *dev) {
+    if (!dev->temp.tempco) {
+        return;
+    }
+    uint32_t now = get_timestamp();
+    if (dev->temp.valid && now - dev->temp.time < dev->temp.interval) {
+        return;
+    }
+    dev->temp.valid = 1;
+    dev->temp.time = now;
+    hx711_set_temperature(dev, get_temperature());
+}
+
+// completes the armed group read
+static void group_deliver(hx711_group_t *group) {
+    hx711_group_result_t *result = &group->result;
+    uint8_t failed = 0;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        hx711_t *dev = group->cells[i];
+        dev->converted = dev->converting;
+        dev->converting = dev->gain;
+        result->faults[i] = dev->valid.enabled ? validate(dev, result->raw[i]) : 0;
+        failed |= result->faults[i];
+    }
+    // a faulty cell rejects the whole burst, so that the cells stay read on the same clock edges
+    if (failed && ++group->rejects <= HX711_MAX_REJECTS) {
+        for (uint8_t i = 0; i < group->count; i++) {
+            if (result->faults[i]) {
+                group->cells[i]->valid.health.rejected++;
+            }
+        }
+        group_rearm(group);
+        return;
+    }
+    group->rejects = 0;
+
+    result->total = 0;
+    for (uint8_t i = 0; i < group->count; i++) {
+        hx711_t *dev = group->cells[i];
+        dev->faults = result->faults[i];
+        if (result->faults[i]) {
+            result->units[i] = 0;
+        } else {
+            track(dev, result->raw[i]);
+            result->units[i] = to_units(dev, result->raw[i]);
+            result->total += result->units[i];
+        }
+        dev->group = 0;
+        dev->busy = 0;
+    }
+
+    hx711_group_cb_t callback = group->callback;
+    group->busy = 0;
+    if (callback) {
+        callback(group, result);
+    }
+}
+
+static void read_done(hx711_t *dev, long value) {
+    VALUE = value;
+    FAULTS = dev->faults;
+    DONE = 1;
+}
+
+static void group_read_done(hx711_group_t *group, const hx711_group_result_t *result) {
+    (void)group;
+    (void)result;
+    DONE = 1;
+}
+
+static void measure_done(hx711_t *dev, const hx711_measurement_t *result) {
+    (void)dev;
+    MEASUREMENT = *result;
+    memory_barrier();
+    MEASURED = 1;
+}
+
+// Asynchronous measurement engine
+// Every reading is delivered to measure_sample() from interrupt context, which updates the running mean
+// and variance (Welford) and re-arms the read until enough readings are taken.
+
+static uint8_t measure_start(hx711_t *dev, uint8_t min_times, uint8_t max_times, float limit, uint8_t tare,
+                             hx711_measure_cb_t callback) {
+    sample_temperature(dev);
+
+    critical_declare();
+    critical_enter();
+    if (dev->busy || dev->measure.active) {
+        critical_exit();
+        return 0;
+    }
+    dev->measure.active = 1;
+    dev->measure.callback = callback;
+    dev->measure.min_times = min_times;
+    dev->measure.max_times = max_times;
+    dev->measure.limit = limit;
+    dev->measure.tare = tare;
+    dev->measure.count = 0;
+    critical_exit();
+
+    // armed first: the reading may be delivered right away
+    deadline_start(dev, HX711_READ_TIMEOUT_MS, measure_timeout);
+    if (!hx711_read_async(dev, measure_sample)) {
+        deadline_stop(dev);
+        dev->measure.active = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static void measure_sample(hx711_t *dev, long value) {
+    if (dev->faults) {
+        // the reading failed the validation: the measurement fails with its faults
+        hx711_measurement_t result = { 0 };
+        hx711_measure_cb_t callback = dev->measure.callback;
+        deadline_stop(dev);
+        result.count = dev->measure.count;
+        result.status = dev->faults;
+        dev->measure.active = 0;
+        if (callback) {
+            callback(dev, &result);
+        }
+        return;
+    }
+    uint8_t n = ++dev->measure.count;
+
+    // the readings are accumulated relative to the first one, so that single precision is enough
+    if (n == 1) {
+        dev->measure.first = value;
+        dev->measure.mean = 0;
+        dev->measure.m2 = 0;
+    } else {
+        float x = (float)(value - dev->measure.first);
+        float delta = x - dev->measure.mean;
+        dev->measure.mean += delta / n;
+        dev->measure.m2 += delta * (x - dev->measure.mean);
+    }
+
+    // var / n <= limit^2, with var = m2 / (n - 1)
+    float limit = dev->measure.limit;
+    if (n < dev->measure.max_times
+        && (n < dev->measure.min_times || dev->measure.m2 > limit * limit * n * (n - 1))) {
+        deadline_start(dev, HX711_READ_TIMEOUT_MS, measure_timeout);
+        hx711_read_async(dev, measure_sample);
+        return;
+    }
+    deadline_stop(dev);
+
+    hx711_measurement_t result;
+    long mean = dev->measure.first + lroundf(dev->measure.mean);
+    float stddev = n > 1 ? sqrtf(dev->measure.m2 / (n - 1)) : 0;
+    if (dev->measure.tare) {
+        dev->offset = mean - dev->temp.zero;
+    }
+    result.mg = hx711_to_mg(dev, mean);
+    result.stddev_mg = (int32_t)(stddev * fabsf((float)dev->mg_per_count) / (1 << HX711_MG_Q) + 0.5f);
+    result.count = n;
+    result.status = 0;
+
+    dev->measure.active = 0;
+    if (dev->measure.callback) {
+        dev->measure.callback(dev, &result);
+    }
+}
+
+// no reading came in time: the measurement is cancelled and completes with the timeout status
+static void measure_timeout(void *ctx) {
+    hx711_t *dev = ctx;
+    hx711_measure_cb_t callback = dev->measure.callback;
+    hx711_measurement_t result = { 0 };
+    critical_declare();
+
+    critical_enter();
+    if (!dev->measure.active) {
+        critical_exit();
+        return;
+    }
+    result.count = dev->measure.count;
+    hx711_read_cancel(dev);
+    dev->valid.health.timeouts++;
+    dev->valid.health.status = HX711_FAULT_TIMEOUT;
+    critical_exit();
+
+    result.status = HX711_FAULT_TIMEOUT;
+    if (callback) {
+        callback(dev, &result);
+    }
+}
+
+// Single cell API
+
+static hx711_t DEFAULT;
+static HX711_read_cb_t DEFAULT_CALLBACK = 0;
+
+static void default_read_done(hx711_t *dev, long value) {
+    (void)dev;
+    if (DEFAULT_CALLBACK) {
+        DEFAULT_CALLBACK(value);
+    }
+}
+
+hx711_t *HX711_get_default() {
+    return &DEFAULT;
+}
+
+void HX711_init(uint8_t gain) {
+    hx711_init(&DEFAULT, HX711_SCK_PORT, HX711_SCK_PIN, HX711_DOUT_PORT, HX711_DOUT_PIN, gain);
+#if defined(HX711_RATE_PORT)
+    hx711_set_rate_pin(&DEFAULT, HX711_RATE_PORT, HX711_RATE_PIN);
+#endif
+}
+
+uint8_t HX711_is_ready() {
+    return hx711_is_ready(&DEFAULT);
+}
+
+void HX711_set_gain(uint8_t gain) {
+    hx711_set_gain(&DEFAULT, gain);
+}
+
+uint8_t HX711_read_async(HX711_read_cb_t callback) {
+    if (DEFAULT.busy) {
+        return 0;
     }
-    return sum / times;
+    DEFAULT_CALLBACK = callback;
+    return hx711_read_async(&DEFAULT, default_read_done);
+}
+
+void HX711_read_cancel() {
+    hx711_read_cancel(&DEFAULT);
+}
+
+uint8_t HX711_is_busy() {
+    return hx711_is_busy(&DEFAULT);
+}
+
+uint8_t HX711_read(long *value) {
+    return hx711_read(&DEFAULT, value);
+}
+
+uint8_t HX711_read_average(uint8_t times, long *value) {
+    return hx711_read_average(&DEFAULT, times, value);
 }
 
 double HX711_get_value() {
-    return HX711_read_average(1) - OFFSET;
+    return hx711_get_value(&DEFAULT);
 }
 
 double HX711_get_mean_value(uint8_t times) {
-    return HX711_read_average(times) - OFFSET;
+    return hx711_get_mean_value(&DEFAULT, times);
 }
 
 float HX711_get_units() {
-    return HX711_get_value() / SCALE;
+    return hx711_get_units(&DEFAULT);
 }
 
 float HX711_get_mean_units(uint8_t times) {
-    return HX711_get_mean_value(times) / SCALE;
+    return hx711_get_mean_units(&DEFAULT, times);
 }
 
-void HX711_tare(uint8_t times) {
-    double sum = HX711_read_average(times);
-    HX711_set_offset(sum);
+uint8_t HX711_get_mg(int32_t *mg) {
+    return hx711_get_mg(&DEFAULT, mg);
+}
+
+uint8_t HX711_get_mean_mg(uint8_t times, int32_t *mg) {
+    return hx711_get_mean_mg(&DEFAULT, times, mg);
+}
+
+uint8_t HX711_get_adaptive_mg(int32_t resolution_mg, uint8_t min_times, uint8_t max_times, hx711_measurement_t *result) {
+    return hx711_get_adaptive_mg(&DEFAULT, resolution_mg, min_times, max_times, result);
+}
+
+uint8_t HX711_measure_async(int32_t resolution_mg, uint8_t min_times, uint8_t max_times, hx711_measure_cb_t callback) {
+    return hx711_measure_async(&DEFAULT, resolution_mg, min_times, max_times, callback);
+}
+
+uint8_t HX711_tare_async(uint8_t times, hx711_measure_cb_t callback) {
+    return hx711_tare_async(&DEFAULT, times, callback);
+}
+
+void HX711_set_tempco(const hx711_tempco_t *tempco, uint32_t interval_ms) {
+    hx711_set_tempco(&DEFAULT, tempco, interval_ms);
+}
+
+float HX711_get_temperature() {
+    return hx711_get_temperature(&DEFAULT);
+}
+
+void HX711_set_validation(long spike, uint8_t stuck_count) {
+    hx711_set_validation(&DEFAULT, spike, stuck_count);
+}
+
+void HX711_get_health(hx711_health_t *health) {
+    hx711_get_health(&DEFAULT, health);
+}
+
+void HX711_set_autozero(int32_t window_mg, uint32_t hold_ms, uint8_t shift) {
+    hx711_set_autozero(&DEFAULT, window_mg, hold_ms, shift);
+}
+
+uint8_t HX711_tare(uint8_t times) {
+    return hx711_tare(&DEFAULT, times);
 }
 
 void HX711_set_scale(float scale) {
-    SCALE = scale;
+    hx711_set_scale(&DEFAULT, scale);
+}
+
+void HX711_set_calibration(const hx711_calibration_t *cal) {
+    hx711_set_calibration(&DEFAULT, cal);
 }
 
 float HX711_get_scale() {
-    return SCALE;
+    return hx711_get_scale(&DEFAULT);
 }
 
 void HX711_set_offset(long offset) {
-    OFFSET = offset;
+    hx711_set_offset(&DEFAULT, offset);
 }
 
 long HX711_get_offset() {
-    return OFFSET;
+    return hx711_get_offset(&DEFAULT);
 }
 
 void HX711_power_down() {
-    clock_low();
-    clock_high();
+    hx711_power_down(&DEFAULT);
 }
 
 void HX711_power_up() {
-    clock_low();
+    hx711_power_up(&DEFAULT);
 }
@@ -2,55 +2,436 @@
 #define HX711_h
 
 #include <stdint.h>
+#include "hx711_filter.h"
 
-// define channel, and gain factor
+// maximum number of HX711 chips in a group sharing one clock line
+#ifndef HX711_GROUP_MAX
+#define HX711_GROUP_MAX 4
+#endif
+
+// fraction bits of the fixed-point reciprocal scale
+#define HX711_MG_Q 16
+
+// maximum number of points of a calibration table, the zero point included
+#ifndef HX711_CAL_POINTS
+#define HX711_CAL_POINTS 8
+#endif
+
+// blocking reads give up when the conversion does not complete in time, e.g. the sensor is disconnected;
+// the asynchronous measurements and tares give up when a reading does not come within this time either
+#ifndef HX711_READ_TIMEOUT_MS
+#define HX711_READ_TIMEOUT_MS 1000
+#endif
+
+// consecutive rejected readings after which the next faulty one completes the read as a failure, so that
+// reads always complete: it is delivered with its faults (hx711_get_faults()) and kept out of the filter,
+// the auto-zero tracking and the averages
+#ifndef HX711_MAX_REJECTS
+#define HX711_MAX_REJECTS 3
+#endif
+
+// output settling time after power up or a rate change; the conversions completing earlier are discarded
+#define HX711_SETTLE_MS_10SPS 400
+#define HX711_SETTLE_MS_80SPS 50
+
+// faults of a reading
+#define HX711_FAULT_SATURATED 0x01      // the ADC is at the end of its range
+#define HX711_FAULT_SPIKE     0x02      // single reading away from the running estimate
+#define HX711_FAULT_STUCK     0x04      // the same value keeps coming, the sensor is likely disconnected
+#define HX711_FAULT_TIMEOUT   0x08      // the conversion did not complete
+
+// pin number of a signal that is not connected
+#define HX711_NO_PIN 0xFF
+
+typedef struct hx711 hx711_t;
+typedef struct hx711_group hx711_group_t;
+
+// callback delivering the reading of an asynchronous read
+// note: it is called from interrupt context, keep it short
+typedef void (*hx711_read_cb_t)(hx711_t *dev, long value);
+
+// piecewise-linear calibration table, built by hx711_calibration_build()
+// the conversion to milligrams interpolates between the points, and extrapolates the first and last segments
+typedef struct hx711_calibration {
+    uint8_t count;                          // number of points
+    int32_t raw[HX711_CAL_POINTS];          // readings without the offset, ascending
+    int32_t mg[HX711_CAL_POINTS];           // weight of each point
+    int32_t slope[HX711_CAL_POINTS - 1];    // milligrams per count in Q16 between point i and i + 1
+} hx711_calibration_t;
+
+// health counters of the read path
+typedef struct hx711_health {
+    uint32_t samples;               // readings validated
+    uint32_t rejected;              // readings dropped
+    uint32_t saturated;
+    uint32_t spikes;
+    uint32_t stuck;
+    uint32_t timeouts;
+    uint8_t status;                 // faults of the last reading
+} hx711_health_t;
+
+// temperature coefficients of a load cell, relative to the temperature of the calibration
+typedef struct hx711_tempco {
+    float ref_celsius;              // temperature of the tare and the calibration
+    float zero_per_degree;          // zero drift [counts / degC]
+    float span_ppm_per_degree;      // span drift [ppm / degC]
+} hx711_tempco_t;
+
+// result of an adaptive measurement
+typedef struct hx711_measurement {
+    int32_t mg;                     // mean weight
+    int32_t stddev_mg;              // standard deviation of the readings
+    uint8_t count;                  // readings taken
+    uint8_t status;                 // 0, or the faults of a failed measurement, e.g. HX711_FAULT_TIMEOUT:
+                                    // the weight is not valid then, and a tare left the offset unchanged
+} hx711_measurement_t;
+
+// callback delivering the result of an asynchronous measurement or tare, called from interrupt context
+typedef void (*hx711_measure_cb_t)(hx711_t *dev, const hx711_measurement_t *result);
+
+// auto-zero tracking state
+typedef struct hx711_autozero {
+    int32_t window_mg;              // readings within +/- window_mg are considered zero, 0 disables tracking
+    uint32_t hold;                  // time the readings must stay in the window, in timestamp units
+    uint8_t shift;                  // the offset moves by 1 / 2^shift of the remaining error per reading
+    uint8_t in_window;
+    uint32_t since;                 // timestamp of the first reading in the window
+} hx711_autozero_t;
+
+// validation state of the readings of one channel and gain
+typedef struct hx711_valid_channel {
+    uint8_t repeats;                // identical readings so far
+    uint8_t primed;
+    uint8_t has_candidate;
+    long last;                      // last reading
+    long estimate;                  // last accepted reading
+    long candidate;                 // spike that may turn out to be a step
+} hx711_valid_channel_t;
+
+// HX711 instance: pins, gain and calibration of one load cell
+struct hx711 {
+    uint8_t sck_port;
+    uint8_t sck_pin;
+    uint8_t dout_port;
+    uint8_t dout_pin;
+    uint8_t rate_port;              // RATE pin, HX711_NO_PIN if it is hardwired
+    uint8_t rate_pin;
+    uint8_t gain;                   // clock pulses after the data bits, select channel and gain of the next conversion
+    long offset;                    // used for tare weight
+    float scale;                    // used to return weight in grams, kg, ounces, whatever
+    int32_t mg_per_count;           // 1000 / scale in Q16, converts to milligrams when scale is in counts per gram
+    const hx711_calibration_t *calibration; // used instead of the scale by the milligram pipeline, 0 if not used
+
+    // asynchronous read state, managed by the driver
+    unsigned int dout_int;          // DOUT falling edge interrupt number
+    uint8_t converting;             // clock pulses which programmed the conversion in progress
+    uint8_t converted;              // clock pulses the last delivered reading was converted with
+    volatile uint8_t busy;          // a read is armed
+    hx711_read_cb_t callback;       // delivers the reading of the armed read
+    uint8_t faults;                 // faults of the delivered reading, 0 if it was accepted
+    hx711_group_t *group;           // group read the instance takes part in
+    hx711_filter_t *filter;         // fed with every reading, 0 if not used
+    hx711_autozero_t autozero;
+
+    // validation of the readings
+    struct {
+        uint8_t enabled;
+        long spike;                 // largest step from the estimate accepted at once [counts], 0 disables
+        uint8_t stuck_count;        // identical readings considered stuck, 0 disables
+        uint8_t rejects;            // consecutive readings rejected
+        hx711_valid_channel_t channels[3]; // indexed by the clock pulses of the conversion - 1
+        hx711_health_t health;
+    } valid;
+
+    // temperature compensation, the corrections are computed when the temperature is sampled
+    struct {
+        const hx711_tempco_t *tempco;   // 0 if not used
+        uint32_t interval;          // temperature sampling period, in timestamp units
+        uint32_t time;              // timestamp of the last sample
+        uint8_t valid;
+        float celsius;
+        long zero;                  // zero drift to subtract [counts]
+        float span;                 // span correction factor
+        int32_t span_q16;
+    } temp;
+
+    // asynchronous measurement state, managed by the driver
+    struct {
+        volatile uint8_t active;    // a measurement is in progress
+        hx711_measure_cb_t callback;
+        long first;                 // first reading, the others are accumulated relative to it
+        float mean;
+        float m2;                   // sum of squared differences from the mean
+        float limit;                // half width of the confidence interval in counts
+        uint8_t count;
+        uint8_t min_times;
+        uint8_t max_times;
+        uint8_t tare;               // the mean becomes the offset
+    } measure;
+    // power state, managed by the driver
+    struct {
+        uint8_t down;               // the chip is in power down mode
+        volatile uint8_t settling;  // the output is not settled since the last power up
+        uint32_t settle_ms;         // output settling time at the selected rate
+        uint32_t wake;              // timestamp of the last power up
+        uint32_t settle;            // settling time, in timestamp units
+        volatile uint32_t discarded; // conversions discarded while settling
+    } power;
+    uint16_t frames[5];             // frames received by the hardware transport
+    uint8_t frame_bits;
+    void *user;                     // free for the owner of the instance, e.g. to find its context in callbacks
+};
+
+// result of a group read
+typedef struct hx711_group_result {
+    long raw[HX711_GROUP_MAX];      // reading of each cell
+    float units[HX711_GROUP_MAX];   // weight on each cell, using its own offset and scale
+    float total;                    // summed weight of the cells without faults
+    uint8_t faults[HX711_GROUP_MAX]; // faults of each cell, 0 if its reading was accepted; a faulty cell has
+                                    // no units and is left out of the total
+} hx711_group_result_t;
+
+// callback delivering the result of an asynchronous group read, called from interrupt context
+typedef void (*hx711_group_cb_t)(hx711_group_t *group, const hx711_group_result_t *result);
+
+// HX711 chips sharing one SCK line: all DOUT pins are sampled on the same clock edges,
+// so reading N cells costs one burst instead of N
+struct hx711_group {
+    hx711_t *cells[HX711_GROUP_MAX];
+    uint8_t count;
+
+    // asynchronous read state, managed by the driver
+    volatile uint8_t busy;
+    volatile uint8_t pending;       // bitmask of the cells whose conversion is not ready yet
+    uint8_t rejects;                // consecutive bursts rejected
+    hx711_group_cb_t callback;
+    hx711_group_result_t result;
+};
+
+// set up an instance on the given pins; define channel, and gain factor
 // channel selection is made by passing the appropriate gain: 128 or 64 for channel A, 32 for channel B
-void HX711_init(uint8_t gain);
+void hx711_init(hx711_t *dev, uint8_t sck_port, uint8_t sck_pin, uint8_t dout_port, uint8_t dout_pin, uint8_t gain);
 
 // check if HX711 is ready
 // from the datasheet: When output data is not ready for retrieval, digital output pin DOUT is high. Serial clock
 // input PD_SCK should be low. When DOUT goes to low, it indicates data is ready for retrieval.
-uint8_t HX711_is_ready();
+uint8_t hx711_is_ready(hx711_t *dev);
 
 // set the gain factor; takes effect only after a call to read()
 // channel A can be set for a 128 or 64 gain; channel B has a fixed 32 gain
 // depending on the parameter, the channel is also set to either A or B
-void HX711_set_gain(uint8_t gain);
+void hx711_set_gain(hx711_t *dev, uint8_t gain);
 
-// waits for the chip to be ready and returns a reading
-long HX711_read();
+// selects the channel and gain without the throwaway read: the next readout programs them with its extra
+// clock pulses, so they apply to the conversion after it
+void hx711_select_gain(hx711_t *dev, uint8_t gain);
 
-// returns an average reading; times = how many times to read
-long HX711_read_average(uint8_t times);
+// connects the RATE pin of the chip; by default it is considered hardwired
+void hx711_set_rate_pin(hx711_t *dev, uint8_t rate_port, uint8_t rate_pin);
 
-// returns (read_average() - OFFSET), that is the current value without the tare weight; times = how many readings to do
-double HX711_get_value();
-double HX711_get_mean_value(uint8_t times);
+// selects the output data rate through the RATE pin: 10 or 80 samples per second
+// returns 0 if the RATE pin is not connected
+uint8_t hx711_set_rate(hx711_t *dev, uint8_t sps);
 
-// returns get_value() divided by SCALE, that is the raw value divided by a value obtained via calibration
-// times = how many readings to do
-float HX711_get_units();
-float HX711_get_mean_units(uint8_t times);
+// starts an asynchronous read; the data is clocked out from the DOUT falling edge interrupt
+// and delivered through the callback, so the caller does not have to wait for the conversion
+// returns 0 if another read is already in progress
+uint8_t hx711_read_async(hx711_t *dev, hx711_read_cb_t callback);
 
-// set the OFFSET value for tare weight; times = how many times to read the tare value
-void HX711_tare(uint8_t times);
+// cancels a pending asynchronous read or measurement; the callback will not be called
+void hx711_read_cancel(hx711_t *dev);
 
-// set the SCALE value; this value is used to convert the raw data to "human readable" data (measure units)
-void HX711_set_scale(float scale);
+// returns the faults of the reading last delivered, e.g. from the read callback: 0 if it was accepted,
+// otherwise the validation rejected HX711_MAX_REJECTS readings in a row before it and the read failed
+uint8_t hx711_get_faults(hx711_t *dev);
 
-// get the current SCALE
-float HX711_get_scale();
+// check if an asynchronous read is in progress
+uint8_t hx711_is_busy(hx711_t *dev);
 
-// set OFFSET, the value that's subtracted from the actual reading (tare weight)
-void HX711_set_offset(long offset);
+// waits for the chip to be ready and stores a reading in value
+// this is a blocking wrapper over read_async()
+// returns 0 if no reading came within HX711_READ_TIMEOUT_MS: the read is cancelled, counted as a timeout in
+// the health counters, and value is left unchanged. It also returns 0 when the read failed the validation
+// (hx711_get_faults())
+uint8_t hx711_read(hx711_t *dev, long *value);
 
-// get the current OFFSET
-long HX711_get_offset();
+// stores an average reading in value; times = how many times to read
+// returns 0 on the first read that timed out or failed
+uint8_t hx711_read_average(hx711_t *dev, uint8_t times, long *value);
+
+// returns (read_average() - offset), that is the current value without the tare weight; times = how many readings to do
+// returns NAN if a read timed out or failed
+double hx711_get_value(hx711_t *dev);
+double hx711_get_mean_value(hx711_t *dev, uint8_t times);
+
+// returns get_value() divided by scale, that is the raw value divided by a value obtained via calibration
+// times = how many readings to do; returns NAN if a read timed out or failed
+float hx711_get_units(hx711_t *dev);
+float hx711_get_mean_units(hx711_t *dev, uint8_t times);
+
+// fixed-point pipeline: returns the weight in milligrams, provided the scale converts to grams
+// only integer operations are used, the reciprocal of the scale is computed by set_scale()
+// with a calibration table, the segment is found by binary search and interpolated
+// note: the scale must be larger than 0.016 for the reciprocal to fit in 32 bits
+// get_mg() and get_mean_mg() store the weight of new readings, they return 0 if a read timed out or failed
+int32_t hx711_to_mg(hx711_t *dev, long raw);
+uint8_t hx711_get_mg(hx711_t *dev, int32_t *mg);
+uint8_t hx711_get_mean_mg(hx711_t *dev, uint8_t times, int32_t *mg);
+
+// returns the reading without the offset, with the zero and span corrections of the temperature
+// compensation: the counts at the reference temperature, which the scale and the calibration table convert
+int32_t hx711_to_counts(hx711_t *dev, long raw);
+
+// asynchronous adaptive measurement: the readings are taken from the DOUT interrupt, one after the other,
+// and the result is delivered through the callback, see hx711_get_adaptive_mg()
+// when no reading comes within HX711_READ_TIMEOUT_MS, e.g. the sensor is disconnected or powered down, the
+// measurement is cancelled, counted as a timeout in the health counters, and the callback gets the status
+// HX711_FAULT_TIMEOUT; a reading failing the validation cancels it the same way, with its faults as the status
+// returns 0 if a read is already in progress
+uint8_t hx711_measure_async(hx711_t *dev, int32_t resolution_mg, uint8_t min_times, uint8_t max_times,
+                            hx711_measure_cb_t callback);
+
+// asynchronous tare: averages times readings, sets the offset and delivers the result through the callback
+// it times out like measure_async(), the offset is left unchanged then
+// returns 0 if a read is already in progress
+uint8_t hx711_tare_async(hx711_t *dev, uint8_t times, hx711_measure_cb_t callback);
+
+// adaptive averaging: reads until the 95% confidence interval of the mean is within +/- resolution_mg,
+// taking at least min_times and at most max_times readings; a still load needs only a few conversions
+// the running mean and variance are updated with Welford's algorithm; blocking wrapper over measure_async()
+// returns 0 if the measurement failed like in measure_async(): result then holds the status
+uint8_t hx711_get_adaptive_mg(hx711_t *dev, int32_t resolution_mg, uint8_t min_times, uint8_t max_times,
+                              hx711_measurement_t *result);
+
+// attaches a filter stage between the readings and the units; every reading, asynchronous ones included,
+// updates the filter, so the filtered value is available without reading again. Pass 0 to detach it.
+void hx711_set_filter(hx711_t *dev, hx711_filter_t *filter);
+
+// returns the output of the attached filter, raw or in milligrams; no new reading is done
+long hx711_get_filtered(hx711_t *dev);
+int32_t hx711_get_filtered_mg(hx711_t *dev);
+
+// enables auto-zero tracking: when the (filtered) weight stays within +/- window_mg for hold_ms,
+// the offset is slowly moved toward the current reading, correcting the drift without a tare cycle
+// it works on the readings done anyway, no extra conversion is needed; window_mg = 0 disables it
+void hx711_set_autozero(hx711_t *dev, int32_t window_mg, uint32_t hold_ms, uint8_t shift);
+
+// builds a calibration table from reference points: readings without the offset, and their weight
+// the zero point is added; returns 0 if there are too many points or two of them have the same reading
+uint8_t hx711_calibration_build(hx711_calibration_t *cal, const int32_t *raw, const int32_t *mg, uint8_t count);
+
+// uses a calibration table for the milligram pipeline, the table must stay valid while in use
+// the scale is set to the slope of the last point, for the floating point functions; pass 0 to detach it
+void hx711_set_calibration(hx711_t *dev, const hx711_calibration_t *cal);
+
+// enables the temperature compensation: the chip temperature is sampled at the start of the measurements
+// and tares (measure_async(), tare_async(), get_adaptive_mg(), tare()), at most every interval_ms, and the zero and span
+// corrections are computed then, so each reading costs only a subtraction and a multiplication
+// the coefficients must stay valid while in use; pass 0 to disable the compensation
+void hx711_set_tempco(hx711_t *dev, const hx711_tempco_t *tempco, uint32_t interval_ms);
+
+// updates the corrections for the given temperature, e.g. from an external sensor
+void hx711_set_temperature(hx711_t *dev, float celsius);
+
+// returns the last temperature sample
+float hx711_get_temperature(hx711_t *dev);
+
+// enables the validation of the readings: saturated readings, spikes larger than spike counts from the
+// last accepted reading, and stuck_count identical readings in a row are dropped and a new conversion is
+// read instead; a spike confirmed by the next reading is accepted as a step. Each channel and gain is
+// checked against its own readings. After HX711_MAX_REJECTS rejects in a row the read fails.
+// In a group read, a faulty cell rejects the whole burst; when the group fails, the result holds the
+// faults of each cell.
+void hx711_set_validation(hx711_t *dev, long spike, uint8_t stuck_count);
+
+// copies the health counters
+void hx711_get_health(hx711_t *dev, hx711_health_t *health);
+
+// set the offset value for tare weight; times = how many times to read the tare value
+// returns 0 if a read timed out or failed, the offset is left unchanged
+uint8_t hx711_tare(hx711_t *dev, uint8_t times);
+
+// set the scale value; this value is used to convert the raw data to "human readable" data (measure units)
+void hx711_set_scale(hx711_t *dev, float scale);
+
+// get the current scale
+float hx711_get_scale(hx711_t *dev);
+
+// set offset, the value that's subtracted from the actual reading (tare weight)
+void hx711_set_offset(hx711_t *dev, long offset);
+
+// get the current offset
+long hx711_get_offset(hx711_t *dev);
 
 // puts the chip into power down mode
-void HX711_power_down();
+// note: in a group it powers down all the chips sharing the clock line
+void hx711_power_down(hx711_t *dev);
+
+// wakes up the chip after power down mode; the reads discard the conversions completing within the
+// settling time, so the first reading comes one settling time after the wake up
+// note: the group reads do not discard them
+void hx711_power_up(hx711_t *dev);
+
+// returns 1 if the chip is in power down mode
+uint8_t hx711_is_powered_down(hx711_t *dev);
 
-// wakes up the chip after power down mode
+// returns the output settling time after a wake up at the selected rate [ms]
+uint32_t hx711_get_settling_ms(hx711_t *dev);
+
+// set up a group of initialized instances; they must share the same SCK pin and gain
+// returns 0 if the cells cannot form a group
+uint8_t hx711_group_init(hx711_group_t *group, hx711_t *const *cells, uint8_t count);
+
+// starts an asynchronous group read; the burst is clocked out when all the cells are ready
+// returns 0 if a read is already in progress on the group or on any of its cells
+uint8_t hx711_group_read_async(hx711_group_t *group, hx711_group_cb_t callback);
+
+// waits for all the cells to be ready and reads them with a single burst
+void hx711_group_read(hx711_group_t *group, hx711_group_result_t *result);
+
+// assembles the 24-bit conversion result from the serial frames received MSB first, and sign-extends it
+// each frame holds frame_bits bits, right-aligned; used by both the GPIO and the USART transport
+long HX711_decode(const uint16_t *frames, uint8_t frame_bits);
+
+// Single cell API
+// The functions below operate on the default instance wired to the pins configured by the
+// hx711_sck and hx711_dt GPIO init components.
+
+// returns the default instance
+hx711_t *HX711_get_default();
+
+// callback delivering the reading of an asynchronous read of the default instance
+typedef void (*HX711_read_cb_t)(long value);
+
+void HX711_init(uint8_t gain);
+uint8_t HX711_is_ready();
+void HX711_set_gain(uint8_t gain);
+uint8_t HX711_read_async(HX711_read_cb_t callback);
+void HX711_read_cancel();
+uint8_t HX711_is_busy();
+uint8_t HX711_read(long *value);
+uint8_t HX711_read_average(uint8_t times, long *value);
+double HX711_get_value();
+double HX711_get_mean_value(uint8_t times);
+float HX711_get_units();
+float HX711_get_mean_units(uint8_t times);
+uint8_t HX711_get_mg(int32_t *mg);
+uint8_t HX711_get_mean_mg(uint8_t times, int32_t *mg);
+uint8_t HX711_get_adaptive_mg(int32_t resolution_mg, uint8_t min_times, uint8_t max_times, hx711_measurement_t *result);
+uint8_t HX711_measure_async(int32_t resolution_mg, uint8_t min_times, uint8_t max_times, hx711_measure_cb_t callback);
+uint8_t HX711_tare_async(uint8_t times, hx711_measure_cb_t callback);
+void HX711_set_tempco(const hx711_tempco_t *tempco, uint32_t interval_ms);
+float HX711_get_temperature();
+void HX711_set_validation(long spike, uint8_t stuck_count);
+void HX711_get_health(hx711_health_t *health);
+void HX711_set_autozero(int32_t window_mg, uint32_t hold_ms, uint8_t shift);
+uint8_t HX711_tare(uint8_t times);
+void HX711_set_scale(float scale);
+void HX711_set_calibration(const hx711_calibration_t *cal);
+float HX711_get_scale();
+void HX711_set_offset(long offset);
+long HX711_get_offset();
+void HX711_power_down();
 void HX711_power_up();
 
 #endif /* HX711_h */
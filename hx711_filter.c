@@ -0,0 +1,173 @@
+#include "hx711_filter.h"
+
+static int32_t window_update(hx711_filter_t *filter, int32_t sample);
+
+void hx711_filter_init_none(hx711_filter_t *filter) {
+    filter->type = HX711_FILTER_NONE;
+    hx711_filter_reset(filter);
+}
+
+void hx711_filter_init_iir(hx711_filter_t *filter, uint8_t shift) {
+    filter->type = HX711_FILTER_IIR;
+    filter->iir.shift = shift;
+    hx711_filter_reset(filter);
+}
+
+void hx711_filter_init_median(hx711_filter_t *filter, uint8_t size) {
+    hx711_filter_init_trimmed_mean(filter, size, 0);
+    filter->type = HX711_FILTER_MEDIAN;
+}
+
+void hx711_filter_init_trimmed_mean(hx711_filter_t *filter, uint8_t size, uint8_t trim) {
+    if (size > HX711_FILTER_WINDOW_MAX) {
+        size = HX711_FILTER_WINDOW_MAX;
+    } else if (size == 0) {
+        size = 1;
+    }
+    if (2 * trim >= size) {
+        trim = (size - 1) / 2;
+    }
+    filter->type = HX711_FILTER_TRIMMED_MEAN;
+    filter->window.size = size;
+    filter->window.trim = trim;
+    hx711_filter_reset(filter);
+}
+
+void hx711_filter_init_kalman(hx711_filter_t *filter, float q, float r) {
+    filter->type = HX711_FILTER_KALMAN;
+    filter->kalman.q = q;
+    filter->kalman.r = r;
+    hx711_filter_reset(filter);
+}
+
+void hx711_filter_reset(hx711_filter_t *filter) {
+    filter->primed = 0;
+    filter->output = 0;
+    if (filter->type == HX711_FILTER_MEDIAN || filter->type == HX711_FILTER_TRIMMED_MEAN) {
+        filter->window.count = 0;
+        filter->window.oldest = 0;
+    }
+}
+
+int32_t hx711_filter_update(hx711_filter_t *filter, int32_t sample) {
+    switch (filter->type) {
+        case HX711_FILTER_IIR:
+            if (!filter->primed) {
+                filter->iir.state = (int64_t)sample << 8;
+            } else {
+                filter->iir.state += (((int64_t)sample << 8) - filter->iir.state) >> filter->iir.shift;
+            }
+            filter->output = (int32_t)((filter->iir.state + 128) >> 8);
+            break;
+        case HX711_FILTER_MEDIAN:
+        case HX711_FILTER_TRIMMED_MEAN:
+            filter->output = window_update(filter, sample);
+            break;
+        case HX711_FILTER_KALMAN:
+            if (!filter->primed) {
+                filter->kalman.x = sample;
+                filter->kalman.p = filter->kalman.r;
+            } else {
+                float p = filter->kalman.p + filter->kalman.q;
+                float k = p / (p + filter->kalman.r);
+                filter->kalman.x += k * (sample - filter->kalman.x);
+                filter->kalman.p = (1.0f - k) * p;
+            }
+            filter->output = (int32_t)(filter->kalman.x + (filter->kalman.x < 0 ? -0.5f : 0.5f));
+            break;
+        default:
+            filter->output = sample;
+            break;
+    }
+    filter->primed = 1;
+    return filter->output;
+}
+
+int32_t hx711_filter_output(const hx711_filter_t *filter) {
+    return filter->output;
+}
+
+// keeps the window sorted: the oldest sample is removed and the new one inserted in place,
+// moving only the samples between the two positions
+// once the window is full, the sum of the trimmed mean is adjusted by the samples entering and leaving
+// the kept range of the sorted window, instead of summing the kept range on every sample
+static int32_t window_update(hx711_filter_t *filter, int32_t sample) {
+    uint8_t size = filter->window.size;
+    int32_t *sorted = filter->window.sorted;
+    uint8_t count = filter->window.count;
+    uint8_t trim = filter->window.trim;
+    uint8_t pos;
+
+    if (count < size) {
+        // filling up: insertion sort step
+        filter->window.history[count] = sample;
+        pos = count;
+        while (pos > 0 && sorted[pos - 1] > sample) {
+            sorted[pos] = sorted[pos - 1];
+            pos--;
+        }
+        sorted[pos] = sample;
+        filter->window.count = ++count;
+
+        if (filter->type == HX711_FILTER_TRIMMED_MEAN) {
+            // trim proportionally while the window is filling up
+            trim = (uint8_t)((uint16_t)trim * count / size);
+            int64_t sum = 0;
+            for (uint8_t i = trim; i < count - trim; i++) {
+                sum += sorted[i];
+            }
+            filter->window.sum = sum;
+        }
+    } else {
+        int32_t old = filter->window.history[filter->window.oldest];
+        filter->window.history[filter->window.oldest] = sample;
+        filter->window.oldest = (filter->window.oldest + 1) % size;
+
+        // find the slot of the removed sample, then slide it to the position of the new one
+        uint8_t removed = 0;
+        while (sorted[removed] != old) {
+            removed++;
+        }
+        pos = removed;
+        while (pos > 0 && sorted[pos - 1] > sample) {
+            sorted[pos] = sorted[pos - 1];
+            pos--;
+        }
+        while (pos < size - 1 && sorted[pos + 1] < sample) {
+            sorted[pos] = sorted[pos + 1];
+            pos++;
+        }
+        sorted[pos] = sample;
+
+        if (filter->type == HX711_FILTER_TRIMMED_MEAN) {
+            // only the slots between the removed and the inserted sample have changed: within the kept
+            // range [trim, size - trim), the sum gains the sample now at one end of the changed slots and
+            // loses the one that was at the other end
+            uint8_t first = trim;
+            uint8_t last = size - 1 - trim;
+            if (removed <= pos) {
+                uint8_t lo = removed > first ? removed : first;
+                uint8_t hi = pos < last ? pos : last;
+                if (lo <= hi) {
+                    filter->window.sum += sorted[hi] - (lo == removed ? old : sorted[lo - 1]);
+                }
+            } else {
+                uint8_t lo = pos > first ? pos : first;
+                uint8_t hi = removed < last ? removed : last;
+                if (lo <= hi) {
+                    filter->window.sum += sorted[lo] - (hi == removed ? old : sorted[hi + 1]);
+                }
+            }
+        }
+    }
+
+    if (filter->type == HX711_FILTER_MEDIAN) {
+        if (count & 1) {
+            return sorted[count / 2];
+        }
+        return (int32_t)(((int64_t)sorted[count / 2 - 1] + sorted[count / 2]) / 2);
+    }
+
+    trim = (uint8_t)((uint16_t)filter->window.trim * count / size);
+    return (int32_t)(filter->window.sum / (count - 2 * trim));
+}
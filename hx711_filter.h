@@ -0,0 +1,67 @@
+#ifndef HX711_FILTER_h
+#define HX711_FILTER_h
+
+#include <stdint.h>
+
+// Stateful filters for the raw HX711 samples
+// Each new sample updates the filter state incrementally, so the filtered value is available at any
+// time without re-reading N samples. The filters work on integer counts; the only floating point
+// one is the Kalman filter, in single precision which the FPU handles natively.
+
+// maximum window of the moving median and the trimmed mean
+#ifndef HX711_FILTER_WINDOW_MAX
+#define HX711_FILTER_WINDOW_MAX 16
+#endif
+
+typedef enum hx711_filter_type {
+    HX711_FILTER_NONE,              // passes the samples through
+    HX711_FILTER_IIR,               // first-order low-pass: y += (x - y) / 2^shift
+    HX711_FILTER_MEDIAN,            // median of the last size samples
+    HX711_FILTER_TRIMMED_MEAN,      // mean of the last size samples without the trim lowest and trim highest ones
+    HX711_FILTER_KALMAN             // 1-D Kalman filter for a constant value with random walk
+} hx711_filter_type_t;
+
+typedef struct hx711_filter {
+    hx711_filter_type_t type;
+    uint8_t primed;                 // the state has been seeded with a sample
+    int32_t output;                 // last filtered value
+    union {
+        struct {
+            uint8_t shift;
+            int64_t state;          // Q8 to keep the fraction between samples
+        } iir;
+        struct {
+            uint8_t size;
+            uint8_t trim;
+            uint8_t count;          // samples in the window
+            uint8_t oldest;         // index of the oldest sample in history
+            int32_t history[HX711_FILTER_WINDOW_MAX];   // samples in arrival order
+            int32_t sorted[HX711_FILTER_WINDOW_MAX];    // the same samples in ascending order
+            int64_t sum;            // sum of the samples kept by the trimmed mean, once the window is full
+        } window;
+        struct {
+            float q;                // process noise variance [counts^2 per sample]
+            float r;                // measurement noise variance [counts^2]
+            float x;                // estimate
+            float p;                // estimate variance
+        } kalman;
+    };
+} hx711_filter_t;
+
+// set up the filters; the state is seeded with the first sample
+void hx711_filter_init_none(hx711_filter_t *filter);
+void hx711_filter_init_iir(hx711_filter_t *filter, uint8_t shift);
+void hx711_filter_init_median(hx711_filter_t *filter, uint8_t size);
+void hx711_filter_init_trimmed_mean(hx711_filter_t *filter, uint8_t size, uint8_t trim);
+void hx711_filter_init_kalman(hx711_filter_t *filter, float q, float r);
+
+// forgets the past samples, e.g. after a step change of the load
+void hx711_filter_reset(hx711_filter_t *filter);
+
+// feeds a sample and returns the filtered value
+int32_t hx711_filter_update(hx711_filter_t *filter, int32_t sample);
+
+// returns the last filtered value
+int32_t hx711_filter_output(const hx711_filter_t *filter);
+
+#endif /* HX711_FILTER_h */
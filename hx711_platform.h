@@ -1,12 +1,205 @@
 // Platform abstraction header for the HX711 driver
 
+#ifndef HX711_PLATFORM_h
+#define HX711_PLATFORM_h
+
+#include "hx711.h"
+
+// transport of the readout: bit-banged GPIO, or PD_SCK generated by a USART in synchronous mode
+// with LDMA moving the received frames (hx711_usart.c)
+#define HX711_TRANSPORT_GPIO  0
+#define HX711_TRANSPORT_USART 1
+
+#ifndef HX711_TRANSPORT
+#define HX711_TRANSPORT HX711_TRANSPORT_GPIO
+#endif
+
+#if defined(HX711_PLATFORM_HOST)
+
+// Host simulation backend, used to run the driver off-target
+#include "hx711_sim.h"
+
+// pins of the default instance: simulated chip 0
+#define HX711_SCK_PORT               0
+#define HX711_SCK_PIN                0
+#define HX711_DOUT_PORT              0
+#define HX711_DOUT_PIN               0
+#define HX711_RATE_PORT              0
+#define HX711_RATE_PIN               0
+
+#define pins_init(dev)
+#define clock_high(dev)              hx711_sim_clock_high((dev)->sck_pin)
+#define clock_low(dev)               hx711_sim_clock_low((dev)->sck_pin)
+#define get_DOUT(dev)                hx711_sim_get_dout((dev)->dout_pin)
+#define rate_pin_init(dev)
+#define rate_high(dev)               hx711_sim_set_rate(80)
+#define rate_low(dev)                hx711_sim_set_rate(10)
+
+// timestamp of the samples: virtual microseconds
+#define get_timestamp()              ((uint32_t)hx711_sim_time_us())
+#define timestamp_from_ms(ms)        ((uint32_t)(ms) * 1000)
+
+#define delay()                      hx711_sim_delay()
+
+// chip temperature for the compensation [degC]
+#define get_temperature()            hx711_sim_temperature()
+
+// DOUT falling edge interrupt; init returns the interrupt number, the interrupt is left disabled
+#define dout_irq_init(dev, handler)  hx711_sim_irq_init((dev)->dout_pin, handler, dev)
+#define dout_irq_enable(dev)         hx711_sim_irq_enable((dev)->dout_int)
+#define dout_irq_disable(dev)        hx711_sim_irq_disable((dev)->dout_int)
+
+// called while waiting for an asynchronous read to complete: the virtual time jumps to the next conversion,
+// or to the wakeup time if it comes first
+#define wait_until(cond)             do {if (!(cond)) {hx711_sim_wait();}} while(0)
+#define wakeup_start(ms)             hx711_sim_wakeup(ms)
+#define wakeup_stop()                hx711_sim_wakeup(0)
+
+// deadline of the asynchronous measurements of an instance: handler(dev) is called ms from now, from the
+// time advance; a start replaces the running deadline
+#define deadline_start(dev, ms, handler) hx711_sim_timer_start((dev)->dout_int, ms, handler, dev)
+#define deadline_stop(dev)           hx711_sim_timer_stop((dev)->dout_int)
+
+// hardware transport: the USART peripheral is modeled by the simulation
+#define transport_init()
+#define transport_start(dev, count, done) \
+    hx711_sim_transfer((dev)->sck_pin, (dev)->dout_pin, (dev)->frames, (dev)->frame_bits, count, done, dev)
+
+#define critical_declare()
+#define critical_enter()
+#define critical_exit()
+#define memory_barrier()             __sync_synchronize()
+
+#else
+
 #include "em_gpio.h"
+#include "em_core.h"
+#include "em_emu.h"
+#include "gpiointerrupt.h"
 #include "sl_emlib_gpio_init_hx711_dt_config.h"
 #include "sl_emlib_gpio_init_hx711_sck_config.h"
+#if __has_include("sl_emlib_gpio_init_hx711_rate_config.h")
+#include "sl_emlib_gpio_init_hx711_rate_config.h"
+#endif
+#include "sl_sleeptimer.h"
+#include "sl_component_catalog.h"
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
+#include "sl_power_manager.h"
+#endif
 #include "cmsis_compiler.h"
 
-#define clock_high() GPIO_PinOutSet(SL_EMLIB_GPIO_INIT_HX711_SCK_PORT, SL_EMLIB_GPIO_INIT_HX711_SCK_PIN)
-#define clock_low()  GPIO_PinOutClear(SL_EMLIB_GPIO_INIT_HX711_SCK_PORT, SL_EMLIB_GPIO_INIT_HX711_SCK_PIN)
-#define get_DOUT()   GPIO_PinInGet(SL_EMLIB_GPIO_INIT_HX711_DT_PORT, SL_EMLIB_GPIO_INIT_HX711_DT_PIN)
+// pins of the default instance
+#define HX711_SCK_PORT               SL_EMLIB_GPIO_INIT_HX711_SCK_PORT
+#define HX711_SCK_PIN                SL_EMLIB_GPIO_INIT_HX711_SCK_PIN
+#define HX711_DOUT_PORT              SL_EMLIB_GPIO_INIT_HX711_DT_PORT
+#define HX711_DOUT_PIN               SL_EMLIB_GPIO_INIT_HX711_DT_PIN
+#if defined(SL_EMLIB_GPIO_INIT_HX711_RATE_PORT)
+#define HX711_RATE_PORT              SL_EMLIB_GPIO_INIT_HX711_RATE_PORT
+#define HX711_RATE_PIN               SL_EMLIB_GPIO_INIT_HX711_RATE_PIN
+#endif
+
+#define pins_init(dev)               do {GPIO_PinModeSet((GPIO_Port_TypeDef)(dev)->sck_port, (dev)->sck_pin, gpioModePushPull, 0); \
+                                         GPIO_PinModeSet((GPIO_Port_TypeDef)(dev)->dout_port, (dev)->dout_pin, gpioModeInput, 0);} while(0)
+#define clock_high(dev)              GPIO_PinOutSet((GPIO_Port_TypeDef)(dev)->sck_port, (dev)->sck_pin)
+#define clock_low(dev)               GPIO_PinOutClear((GPIO_Port_TypeDef)(dev)->sck_port, (dev)->sck_pin)
+#define get_DOUT(dev)                GPIO_PinInGet((GPIO_Port_TypeDef)(dev)->dout_port, (dev)->dout_pin)
+#define rate_pin_init(dev)           GPIO_PinModeSet((GPIO_Port_TypeDef)(dev)->rate_port, (dev)->rate_pin, gpioModePushPull, 0)
+#define rate_high(dev)               GPIO_PinOutSet((GPIO_Port_TypeDef)(dev)->rate_port, (dev)->rate_pin)
+#define rate_low(dev)                GPIO_PinOutClear((GPIO_Port_TypeDef)(dev)->rate_port, (dev)->rate_pin)
+
+// timestamp of the samples: sleeptimer ticks
+#define get_timestamp()              sl_sleeptimer_get_tick_count()
+#define timestamp_from_ms(ms)        ((uint32_t)((uint64_t)(ms) * sl_sleeptimer_get_timer_frequency() / 1000))
+
+#define delay()                      do {__NOP(); __NOP(); __NOP();} while(0)
+
+// chip temperature for the compensation [degC], measured periodically by the EMU in EM0 to EM2
+#define get_temperature()            EMU_TemperatureGet()
+
+// DOUT falling edge interrupt; init returns the interrupt number, the interrupt is left disabled
+#define dout_irq_init(dev, handler)  dout_irq_config(dev, GPIOINT_CallbackRegisterExt((dev)->dout_pin, handler, dev))
+#define dout_irq_enable(dev)         do {GPIO_IntClear(1 << (dev)->dout_int); GPIO_IntEnable(1 << (dev)->dout_int);} while(0)
+#define dout_irq_disable(dev)        GPIO_IntDisable(1 << (dev)->dout_int)
+
+static inline unsigned int dout_irq_config(hx711_t *dev, unsigned int int_no) {
+    if (int_no != INTERRUPT_UNAVAILABLE) {
+        GPIO_ExtIntConfig((GPIO_Port_TypeDef)dev->dout_port, dev->dout_pin, int_no, false, true, false);
+    }
+    return int_no;
+}
+
+// called while waiting for an asynchronous read to complete: sleeps until an interrupt, unless cond is
+// already true. cond is checked with the interrupts masked, so the interrupt setting it cannot fire between
+// the check and the sleep: the core wakes up on the pending interrupt, which runs after the atomic section.
+// The DOUT interrupt wakes the core up from EM2; with the power manager, the deepest energy mode allowed
+// by all the components is entered.
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
+#define enter_sleep()                sl_power_manager_sleep()
+#else
+#define enter_sleep()                __WFI()
+#endif
+#define wait_until(cond)             do {CORE_DECLARE_IRQ_STATE; CORE_ENTER_ATOMIC(); \
+                                         if (!(cond)) {enter_sleep();} CORE_EXIT_ATOMIC();} while(0)
+
+// wakes the core up after ms, so that a blocking read can time out while sleeping
+static inline sl_sleeptimer_timer_handle_t *wakeup_timer(void) {
+    static sl_sleeptimer_timer_handle_t timer;
+    return &timer;
+}
+
+static inline void wakeup_timeout(sl_sleeptimer_timer_handle_t *handle, void *data) {
+    (void)handle;
+    (void)data;
+}
+
+#define wakeup_start(ms)             sl_sleeptimer_start_timer_ms(wakeup_timer(), ms, wakeup_timeout, 0, 0, 0)
+#define wakeup_stop()                sl_sleeptimer_stop_timer(wakeup_timer())
+
+// deadline of the asynchronous measurements of an instance: handler(dev) is called from the sleeptimer
+// interrupt ms from now; a start replaces the running deadline. One timer per DOUT interrupt number.
+#define DEADLINE_TIMERS              16
+
+typedef struct {
+    sl_sleeptimer_timer_handle_t timer;
+    void (*handler)(void *ctx);
+} deadline_t;
+
+static inline deadline_t *deadline(hx711_t *dev) {
+    static deadline_t deadlines[DEADLINE_TIMERS];
+    return &deadlines[dev->dout_int % DEADLINE_TIMERS];
+}
+
+static inline void deadline_expired(sl_sleeptimer_timer_handle_t *handle, void *data) {
+    (void)handle;
+    hx711_t *dev = data;
+    deadline(dev)->handler(dev);
+}
+
+static inline void deadline_start(hx711_t *dev, uint32_t ms, void (*handler)(void *ctx)) {
+    deadline(dev)->handler = handler;
+    (void)sl_sleeptimer_restart_timer_ms(&deadline(dev)->timer, ms, deadline_expired, dev, 0, 0);
+}
+
+#define deadline_stop(dev)           sl_sleeptimer_stop_timer(&deadline(dev)->timer)
+
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART
+#include "hx711_usart.h"
+
+// hardware transport: clocks count frames of dev->frame_bits bits into dev->frames, done is called
+// from the LDMA interrupt; returns 0 if the USART is busy with another instance
+#define transport_init()             hx711_usart_init()
+#define transport_start(dev, count, done) \
+    hx711_usart_start((dev)->sck_port, (dev)->sck_pin, (dev)->dout_port, (dev)->dout_pin, \
+                      (dev)->frames, (dev)->frame_bits, count, done, dev)
+#else
+#define transport_init()
+#endif
+
+#define critical_declare()           CORE_DECLARE_IRQ_STATE
+#define critical_enter()             CORE_ENTER_ATOMIC()
+#define critical_exit()              CORE_EXIT_ATOMIC()
+#define memory_barrier()             __DMB()
+
+#endif
 
-#define delay()      do {__NOP(); __NOP(); __NOP();} while(0)
+#endif /* HX711_PLATFORM_h */
@@ -0,0 +1,52 @@
+#include "hx711_power.h"
+#include "hx711_platform.h"
+
+void hx711_power_init(hx711_power_t *policy, hx711_t *dev) {
+    policy->dev = dev;
+    policy->wakes = 0;
+    policy->early_wakes = 0;
+    policy->keeps = 0;
+}
+
+uint32_t hx711_power_acquire(hx711_power_t *policy) {
+    hx711_t *dev = policy->dev;
+
+    if (hx711_is_powered_down(dev)) {
+        policy->wakes++;
+        hx711_power_up(dev);
+    } else if (!dev->power.settling) {
+        return 0;
+    }
+    // the chip may be woken up already but not settled yet
+    uint32_t elapsed = get_timestamp() - dev->power.wake;
+    if (elapsed >= dev->power.settle) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)(dev->power.settle - elapsed) * 1000 / timestamp_from_ms(1000));
+}
+
+void hx711_power_wake(hx711_power_t *policy) {
+    if (hx711_is_powered_down(policy->dev)) {
+        policy->early_wakes++;
+        policy->wakes++;
+        hx711_power_up(policy->dev);
+    }
+}
+
+uint32_t hx711_power_release(hx711_power_t *policy, uint32_t next_ms) {
+    uint32_t settle = hx711_get_settling_ms(policy->dev);
+
+    // powered down, the chip draws about nothing; powered up, it draws the same current whether it is
+    // settling or idle: staying up until the deadline costs less than a wake up when the gap is shorter
+    // than the settling time
+    if (next_ms != HX711_POWER_NO_DEADLINE && next_ms <= settle) {
+        if (hx711_is_powered_down(policy->dev)) {
+            hx711_power_wake(policy);
+        } else {
+            policy->keeps++;
+        }
+        return HX711_POWER_NO_DEADLINE;
+    }
+    hx711_power_down(policy->dev);
+    return next_ms == HX711_POWER_NO_DEADLINE ? HX711_POWER_NO_DEADLINE : next_ms - settle;
+}
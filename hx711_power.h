@@ -0,0 +1,39 @@
+#ifndef HX711_POWER_h
+#define HX711_POWER_h
+
+#include <stdint.h>
+#include "hx711.h"
+
+// Power policy of an HX711 instance
+// Waking the chip up costs one settling time with the chip powered and no usable conversion. Given the
+// next measurement deadline, the policy powers the chip down between measurements and tells when to wake
+// it up again: one settling time before the deadline, so that the measurement starts on a settled chip.
+// When the deadline is closer than the wake cost, the chip stays powered: powering it down would save
+// nothing and delay the measurement.
+
+// no measurement deadline is known
+#define HX711_POWER_NO_DEADLINE 0xFFFFFFFFUL
+
+typedef struct hx711_power {
+    hx711_t *dev;
+    uint32_t wakes;                 // power ups
+    uint32_t early_wakes;           // power ups ahead of a deadline
+    uint32_t keeps;                 // power downs skipped, the next deadline was too close
+} hx711_power_t;
+
+// sets up the policy of an initialized instance
+void hx711_power_init(hx711_power_t *policy, hx711_t *dev);
+
+// the chip is needed now: powers it up if it is down
+// returns the delay until its first settled conversion [ms], 0 if it is already settled
+uint32_t hx711_power_acquire(hx711_power_t *policy);
+
+// wakes the chip up ahead of a deadline, when the delay returned by hx711_power_release() expires
+void hx711_power_wake(hx711_power_t *policy);
+
+// the chip is no longer needed and the next measurement is due in next_ms, or HX711_POWER_NO_DEADLINE
+// returns the delay after which hx711_power_wake() must be called [ms], HX711_POWER_NO_DEADLINE if the chip
+// stays powered or no deadline is known
+uint32_t hx711_power_release(hx711_power_t *policy, uint32_t next_ms);
+
+#endif /* HX711_POWER_h */
@@ -0,0 +1,137 @@
+#include "hx711_sched.h"
+#include "hx711_platform.h"
+
+static void sample_ready(hx711_t *dev, long value);
+static uint8_t program_next(hx711_sched_t *sched);
+
+void hx711_sched_init(hx711_sched_t *sched, hx711_t *dev, uint8_t settle, hx711_sched_cb_t callback) {
+    sched->dev = dev;
+    sched->slot_count = 0;
+    sched->settle = settle;
+    sched->callback = callback;
+    sched->discarded = 0;
+    sched->running = 0;
+}
+
+uint8_t hx711_sched_add(hx711_sched_t *sched, uint8_t gain, uint8_t count) {
+    uint8_t pulses;
+
+    switch (gain) {
+        case 128:
+            pulses = 1;
+            break;
+        case 32:
+            pulses = 2;
+            break;
+        case 64:
+            pulses = 3;
+            break;
+        default:
+            return HX711_NO_PIN;
+    }
+    if (sched->slot_count == HX711_SCHED_SLOTS || count == 0) {
+        return HX711_NO_PIN;
+    }
+
+    hx711_sched_slot_t *slot = &sched->slots[sched->slot_count];
+    slot->pulses = pulses;
+    slot->count = count;
+    slot->samples = 0;
+    hx711_filter_init_none(&slot->filter);
+    return sched->slot_count++;
+}
+
+hx711_filter_t *hx711_sched_filter(hx711_sched_t *sched, uint8_t channel) {
+    return &sched->slots[channel].filter;
+}
+
+uint8_t hx711_sched_start(hx711_sched_t *sched) {
+    hx711_t *dev = sched->dev;
+
+    // the owner of a read in progress still finds its context in dev->user, and its channel in dev->gain
+    if (sched->slot_count == 0 || hx711_is_busy(dev)) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < sched->slot_count; i++) {
+        hx711_filter_reset(&sched->slots[i].filter);
+    }
+    sched->slot = 0;
+    sched->programmed = 0;
+    // the conversion in progress was programmed by the last readout; as its history is unknown,
+    // it is treated as following a switch
+    sched->last = 0;
+    sched->running = 1;
+    dev->user = sched;
+
+    dev->gain = program_next(sched);
+    if (!hx711_read_async(dev, sample_ready)) {
+        sched->running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void hx711_sched_stop(hx711_sched_t *sched) {
+    sched->running = 0;
+    hx711_read_cancel(sched->dev);
+}
+
+long hx711_sched_value(hx711_sched_t *sched, uint8_t channel) {
+    return hx711_filter_output(&sched->slots[channel].filter);
+}
+
+uint32_t hx711_sched_samples(hx711_sched_t *sched, uint8_t channel) {
+    return sched->slots[channel].samples;
+}
+
+// returns the pulses of the next conversion to program
+// each turn of a slot programs count conversions, plus the settling ones when the channel switches
+static uint8_t program_next(hx711_sched_t *sched) {
+    hx711_sched_slot_t *slot = &sched->slots[sched->slot];
+    uint8_t turn = slot->count + (sched->slot_count > 1 ? sched->settle : 0);
+
+    if (sched->programmed == turn) {
+        sched->slot = (sched->slot + 1) % sched->slot_count;
+        sched->programmed = 0;
+        slot = &sched->slots[sched->slot];
+    }
+    sched->programmed++;
+    return slot->pulses;
+}
+
+// called from the DOUT interrupt with each conversion, re-arms the next read
+static void sample_ready(hx711_t *dev, long value) {
+    hx711_sched_t *sched = dev->user;
+
+    if (!sched->running) {
+        return;
+    }
+
+    // the driver tracks the pulses of each conversion, including the readouts it did not deliver
+    uint8_t pulses = dev->converted;
+    dev->gain = program_next(sched);
+
+    if (pulses != sched->last) {
+        sched->last = pulses;
+        sched->settle_left = sched->settle;
+    }
+
+    if (sched->settle_left) {
+        sched->settle_left--;
+        sched->discarded++;
+    } else if (!dev->faults) {
+        // a reading which failed the validation is not a valid sample
+        for (uint8_t i = 0; i < sched->slot_count; i++) {
+            hx711_sched_slot_t *slot = &sched->slots[i];
+            if (slot->pulses == pulses) {
+                hx711_filter_update(&slot->filter, value);
+                slot->samples++;
+                if (sched->callback) {
+                    sched->callback(sched, i, value);
+                }
+                break;
+            }
+        }
+    }
+    hx711_read_async(dev, sample_ready);
+}
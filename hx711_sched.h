@@ -0,0 +1,75 @@
+#ifndef HX711_SCHED_h
+#define HX711_SCHED_h
+
+#include <stdint.h>
+#include "hx711.h"
+#include "hx711_filter.h"
+
+// Interleaved channel A/B acquisition
+// The HX711 selects the channel and gain of the next conversion from the extra clock pulses that
+// follow the 24 data bits, so the scheduler programs the channel of the conversion after next from
+// the DOUT interrupt, with no throwaway read. Each channel gets count valid samples per turn; after
+// a switch the first conversions are discarded while the input settles. Every valid sample feeds the
+// filter of its channel. The driver tags each reading with the pulses it was converted with, so the
+// readings it rejects or discards (validation, settling) do not shift the channels.
+
+// maximum number of channel/gain combinations: A/128, A/64 and B/32
+#define HX711_SCHED_SLOTS 3
+
+// conversions discarded after a channel or gain switch: the output settles in 4 conversions
+#ifndef HX711_SCHED_SETTLE
+#define HX711_SCHED_SETTLE 3
+#endif
+
+typedef struct hx711_sched hx711_sched_t;
+
+// callback delivering each valid sample with its channel index, called from interrupt context
+typedef void (*hx711_sched_cb_t)(hx711_sched_t *sched, uint8_t channel, long value);
+
+typedef struct hx711_sched_slot {
+    uint8_t pulses;                 // extra clock pulses selecting the channel and gain
+    uint8_t count;                  // valid samples per turn
+    hx711_filter_t filter;          // filtered stream of the channel
+    volatile uint32_t samples;      // valid samples delivered
+} hx711_sched_slot_t;
+
+struct hx711_sched {
+    hx711_t *dev;
+    hx711_sched_slot_t slots[HX711_SCHED_SLOTS];
+    uint8_t slot_count;
+    uint8_t settle;                 // conversions discarded after a switch
+    hx711_sched_cb_t callback;
+    volatile uint32_t discarded;    // settling conversions discarded
+    volatile uint8_t running;
+
+    // pipeline state, managed by the scheduler
+    uint8_t slot;                   // slot being programmed
+    uint8_t programmed;             // conversions programmed in the current turn of the slot
+    uint8_t last;                   // pulses of the last delivered conversion
+    uint8_t settle_left;
+};
+
+// sets up a scheduler on an initialized instance; settle conversions are discarded after each switch
+void hx711_sched_init(hx711_sched_t *sched, hx711_t *dev, uint8_t settle, hx711_sched_cb_t callback);
+
+// adds a channel by its gain (128 or 64 for channel A, 32 for channel B), sampled count times per turn
+// its filter passes the samples through until set up with hx711_sched_filter()
+// returns the channel index, or HX711_NO_PIN if the scheduler is full or the gain is invalid
+uint8_t hx711_sched_add(hx711_sched_t *sched, uint8_t gain, uint8_t count);
+
+// returns the filter of a channel, to set it up before starting
+hx711_filter_t *hx711_sched_filter(hx711_sched_t *sched, uint8_t channel);
+
+// starts the interleaved acquisition; returns 0 if the instance is busy with another read
+uint8_t hx711_sched_start(hx711_sched_t *sched);
+
+// stops the acquisition
+void hx711_sched_stop(hx711_sched_t *sched);
+
+// returns the filtered value of a channel
+long hx711_sched_value(hx711_sched_t *sched, uint8_t channel);
+
+// returns the number of valid samples delivered on a channel
+uint32_t hx711_sched_samples(hx711_sched_t *sched, uint8_t channel);
+
+#endif /* HX711_SCHED_h */
@@ -0,0 +1,515 @@
+#include <assert.h>
+#include <math.h>
+#include "hx711_sim.h"
+
+// M_PI is not part of standard C
+#define PI 3.14159265f
+
+// state of a simulated chip
+typedef struct {
+    uint8_t connected;
+    uint8_t sck_pin;
+    uint8_t dout_pin;
+    uint64_t next_ready;             // end of the conversion in progress [us]
+    uint8_t gain;                    // gain of the last completed conversion
+    uint8_t dout;
+    uint32_t data;                   // 24-bit result being shifted out
+    uint8_t pulses;                  // clock pulses since the last conversion completed
+    void (*irq_handler)(uint8_t int_no, void *ctx);
+    void *irq_ctx;
+    uint8_t irq_enabled;
+    float ref_celsius;               // temperature drift model
+    float zero_per_degree;
+    float span_ppm_per_degree;
+    uint8_t down;                    // power down mode
+    uint8_t settling;                // the output is settling since the last reset
+    uint64_t wake;                   // time of the last reset [us]
+    hx711_sim_load_t load;
+    uint8_t primed;
+    float lagged;                    // load followed with the creep time constant
+    uint64_t last_conversion;        // [us]
+} chip_t;
+
+static chip_t CHIPS[HX711_SIM_CHIPS];
+static uint64_t TIME = 0;            // virtual time [us]
+static uint32_t PERIOD = 100000;     // conversion period [us]
+static hx711_sim_input_t INPUT = 0;
+static uint8_t SCK[256];             // level of the clock pins
+static uint64_t SCK_RISE[256];       // time of the last rising edge of the clock pins [us]
+static float CELSIUS = 25;
+static uint32_t SEED = 1;            // state of the noise generator
+static uint64_t WAKEUP = 0;          // time of the wakeup timer, 0 if not running [us]
+
+// one-shot timers of the platform
+typedef struct {
+    uint64_t due;                    // [us], 0 if not running
+    void (*handler)(void *ctx);
+    void *ctx;
+} sim_timer_t;
+
+static sim_timer_t TIMERS[HX711_SIM_CHIPS];
+
+// energy accounting
+static uint64_t START = 0;           // start of the accounting [us]
+static uint64_t EM0_NS = 0;
+static uint64_t EM1_NS = 0;
+static uint64_t HX711_ON_US = 0;
+static uint64_t HX711_DOWN_US = 0;
+static uint32_t READOUTS = 0;
+static uint8_t TRANSFER = 0;         // the clock pulses come from the USART model
+
+static void complete_conversion(uint8_t chip);
+static uint32_t settle_us(void);
+static long convert(uint8_t chip);
+static float gaussian(void);
+static void account(uint64_t us);
+static chip_t *find_dout(uint8_t dout_pin);
+
+void hx711_sim_reset(uint16_t rate_sps) {
+    PERIOD = 1000000UL / rate_sps;
+    TIME = 0;
+    CELSIUS = 25;
+    SEED = 1;
+    WAKEUP = 0;
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        TIMERS[i].due = 0;
+    }
+    INPUT = 0;
+    hx711_sim_energy_reset();
+    for (uint16_t i = 0; i < 256; i++) {
+        SCK[i] = 0;
+    }
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        CHIPS[i] = (chip_t){ 0 };
+        CHIPS[i].next_ready = PERIOD;
+        CHIPS[i].gain = 128;
+        CHIPS[i].dout = 1;
+        CHIPS[i].load.creep_tau_s = 1;
+    }
+    hx711_sim_connect(0, 0, 0);
+}
+
+void hx711_sim_connect(uint8_t chip, uint8_t sck_pin, uint8_t dout_pin) {
+    CHIPS[chip].connected = 1;
+    CHIPS[chip].sck_pin = sck_pin;
+    CHIPS[chip].dout_pin = dout_pin;
+    CHIPS[chip].next_ready = TIME + PERIOD;
+}
+
+void hx711_sim_disconnect(uint8_t chip) {
+    CHIPS[chip].connected = 0;
+    CHIPS[chip].dout = 1;
+    CHIPS[chip].pulses = 0;
+}
+
+void hx711_sim_set_input(hx711_sim_input_t input) {
+    INPUT = input;
+}
+
+void hx711_sim_set_load(uint8_t chip, const hx711_sim_load_t *load) {
+    CHIPS[chip].load = *load;
+    CHIPS[chip].primed = 0;
+}
+
+void hx711_sim_seed(uint32_t seed) {
+    SEED = seed ? seed : 1;
+}
+
+void hx711_sim_set_temperature(float celsius) {
+    CELSIUS = celsius;
+}
+
+float hx711_sim_temperature() {
+    return CELSIUS;
+}
+
+void hx711_sim_set_tempco(uint8_t chip, float ref_celsius, float zero_per_degree, float span_ppm_per_degree) {
+    CHIPS[chip].ref_celsius = ref_celsius;
+    CHIPS[chip].zero_per_degree = zero_per_degree;
+    CHIPS[chip].span_ppm_per_degree = span_ppm_per_degree;
+}
+
+void hx711_sim_energy(hx711_sim_energy_t *energy) {
+    uint64_t elapsed = TIME - START;
+    energy->em0_us = EM0_NS / 1000;
+    energy->em1_us = EM1_NS / 1000;
+    // the readouts take no virtual time, they are taken out of the sleep time
+    energy->em2_us = elapsed > energy->em0_us + energy->em1_us ? elapsed - energy->em0_us - energy->em1_us : 0;
+    energy->hx711_on_us = HX711_ON_US;
+    energy->hx711_down_us = HX711_DOWN_US;
+    energy->readouts = READOUTS;
+}
+
+void hx711_sim_energy_reset() {
+    START = TIME;
+    EM0_NS = 0;
+    EM1_NS = 0;
+    HX711_ON_US = 0;
+    HX711_DOWN_US = 0;
+    READOUTS = 0;
+}
+
+float hx711_sim_average_ua(const hx711_sim_energy_t *energy) {
+    uint64_t elapsed = energy->em0_us + energy->em1_us + energy->em2_us;
+    if (elapsed == 0) {
+        return 0;
+    }
+    float charge = energy->em0_us * HX711_SIM_EM0_UA + energy->em1_us * HX711_SIM_EM1_UA
+                   + energy->em2_us * HX711_SIM_EM2_UA + energy->hx711_on_us * HX711_SIM_HX711_ON_UA
+                   + energy->hx711_down_us * HX711_SIM_HX711_DOWN_UA;
+    return charge / elapsed;
+}
+
+uint64_t hx711_sim_time_us() {
+    return TIME;
+}
+
+void hx711_sim_advance(uint32_t us) {
+    uint64_t end = TIME + us;
+    for (;;) {
+        // complete the conversions and the power downs in time order
+        uint8_t next = HX711_SIM_CHIPS;
+        uint64_t time = end;
+        uint8_t power_down = 0;
+        for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+            chip_t *c = &CHIPS[i];
+            if (!c->connected || c->down) {
+                continue;
+            }
+            if (SCK[c->sck_pin] && SCK_RISE[c->sck_pin] + HX711_SIM_POWER_DOWN_US <= time) {
+                next = i;
+                time = SCK_RISE[c->sck_pin] + HX711_SIM_POWER_DOWN_US;
+                power_down = 1;
+            }
+            if (c->next_ready <= time && (next == HX711_SIM_CHIPS || c->next_ready < time)) {
+                next = i;
+                time = c->next_ready;
+                power_down = 0;
+            }
+        }
+        // a timer due at the same time as a conversion expires after it
+        uint8_t timer = HX711_SIM_CHIPS;
+        for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+            uint64_t due = TIMERS[i].due;
+            if (due && due <= time && (due < time || next == HX711_SIM_CHIPS)
+                && (timer == HX711_SIM_CHIPS || due < TIMERS[timer].due)) {
+                timer = i;
+                time = due;
+            }
+        }
+        if (next == HX711_SIM_CHIPS && timer == HX711_SIM_CHIPS) {
+            break;
+        }
+        account(time - TIME);
+        TIME = time;
+        if (timer != HX711_SIM_CHIPS) {
+            TIMERS[timer].due = 0;
+            EM0_NS += HX711_SIM_ISR_NS;
+            TIMERS[timer].handler(TIMERS[timer].ctx);
+        } else if (power_down) {
+            // the conversion in progress is lost, DOUT stays high
+            CHIPS[next].down = 1;
+            CHIPS[next].dout = 1;
+            CHIPS[next].pulses = 0;
+        } else {
+            CHIPS[next].next_ready += PERIOD;
+            complete_conversion(next);
+        }
+    }
+    account(end - TIME);
+    TIME = end;
+}
+
+uint8_t hx711_sim_gain(uint8_t chip) {
+    return CHIPS[chip].gain;
+}
+
+uint8_t hx711_sim_powered_down(uint8_t chip) {
+    return CHIPS[chip].down;
+}
+
+void hx711_sim_clock_high(uint8_t sck_pin) {
+    if (SCK[sck_pin]) {
+        return;
+    }
+    SCK[sck_pin] = 1;
+    SCK_RISE[sck_pin] = TIME;
+    if (TRANSFER) {
+        EM1_NS += HX711_SIM_USART_PULSE_NS;
+    } else {
+        EM0_NS += HX711_SIM_GPIO_PULSE_NS;
+    }
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        chip_t *c = &CHIPS[i];
+        // pulses count only once a conversion is ready to be read
+        if (!c->connected || c->sck_pin != sck_pin || c->down || (c->pulses == 0 && c->dout)) {
+            continue;
+        }
+        c->pulses++;
+        if (c->pulses <= 24) {
+            // data is shifted out MSB first on the rising edges
+            c->dout = (c->data >> (24 - c->pulses)) & 1;
+        } else if (c->pulses == 25) {
+            // the 25th pulse pulls DOUT back to high and starts the next conversion
+            c->dout = 1;
+            c->next_ready = TIME + PERIOD;
+        }
+    }
+}
+
+void hx711_sim_clock_low(uint8_t sck_pin) {
+    SCK[sck_pin] = 0;
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        chip_t *c = &CHIPS[i];
+        if (c->connected && c->sck_pin == sck_pin && c->down) {
+            // reset: channel A, gain 128, a new conversion starts and the output settles
+            c->down = 0;
+            c->gain = 128;
+            c->wake = TIME;
+            c->settling = 1;
+            c->next_ready = TIME + PERIOD;
+        }
+    }
+}
+
+uint8_t hx711_sim_get_dout(uint8_t dout_pin) {
+    chip_t *c = find_dout(dout_pin);
+    // an unconnected DOUT pin floats high
+    return c ? c->dout : 1;
+}
+
+void hx711_sim_set_rate(uint16_t rate_sps) {
+    if (PERIOD == 1000000UL / rate_sps) {
+        return;
+    }
+    PERIOD = 1000000UL / rate_sps;
+    // the output settles again at the new rate
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        chip_t *c = &CHIPS[i];
+        if (c->connected && !c->down) {
+            c->wake = TIME;
+            c->settling = 1;
+        }
+    }
+}
+
+void hx711_sim_delay() {
+}
+
+unsigned int hx711_sim_irq_init(uint8_t dout_pin, void (*handler)(uint8_t int_no, void *ctx), void *ctx) {
+    chip_t *c = find_dout(dout_pin);
+    if (!c) {
+        return 0xFF;
+    }
+    c->irq_handler = handler;
+    c->irq_ctx = ctx;
+    c->irq_enabled = 0;
+    return (unsigned int)(c - CHIPS);
+}
+
+void hx711_sim_irq_enable(unsigned int int_no) {
+    if (int_no < HX711_SIM_CHIPS) {
+        CHIPS[int_no].irq_enabled = 1;
+    }
+}
+
+void hx711_sim_irq_disable(unsigned int int_no) {
+    if (int_no < HX711_SIM_CHIPS) {
+        CHIPS[int_no].irq_enabled = 0;
+    }
+}
+
+void hx711_sim_wait() {
+    // nothing else happens in the simulation, jump to the end of the next conversion, to the next timer or
+    // to the wakeup
+    uint64_t next = WAKEUP;
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        if (CHIPS[i].connected && !CHIPS[i].down && (next == 0 || CHIPS[i].next_ready < next)) {
+            next = CHIPS[i].next_ready;
+        }
+        if (TIMERS[i].due && (next == 0 || TIMERS[i].due < next)) {
+            next = TIMERS[i].due;
+        }
+    }
+    // with no conversion running and no timer or wakeup pending, the wait would never end
+    assert(next != 0 && "no chip is converting and no timer or wakeup is pending");
+    if (next == WAKEUP) {
+        WAKEUP = 0;
+    }
+    if (next > TIME) {
+        hx711_sim_advance((uint32_t)(next - TIME));
+    }
+}
+
+void hx711_sim_wakeup(uint32_t ms) {
+    WAKEUP = ms ? TIME + (uint64_t)ms * 1000 : 0;
+}
+
+void hx711_sim_timer_start(uint8_t id, uint32_t ms, void (*handler)(void *ctx), void *ctx) {
+    if (id < HX711_SIM_CHIPS) {
+        TIMERS[id].handler = handler;
+        TIMERS[id].ctx = ctx;
+        TIMERS[id].due = TIME + (uint64_t)ms * 1000;
+    }
+}
+
+void hx711_sim_timer_stop(uint8_t id) {
+    if (id < HX711_SIM_CHIPS) {
+        TIMERS[id].due = 0;
+    }
+}
+
+uint8_t hx711_sim_transfer(uint8_t sck_pin, uint8_t dout_pin, uint16_t *frames, uint8_t frame_bits, uint8_t count,
+                           void (*done)(void *ctx), void *ctx) {
+    TRANSFER = 1;
+    for (uint8_t n = 0; n < count; n++) {
+        frames[n] = 0;
+        for (uint8_t i = 0; i < frame_bits; i++) {
+            hx711_sim_clock_high(sck_pin);
+            hx711_sim_clock_low(sck_pin);
+            frames[n] = (frames[n] << 1) | hx711_sim_get_dout(dout_pin);
+        }
+    }
+    TRANSFER = 0;
+    done(ctx);
+    return 1;
+}
+
+static void complete_conversion(uint8_t chip) {
+    chip_t *c = &CHIPS[chip];
+    uint8_t falling_edge = c->dout;
+
+    // the number of pulses in the last readout selects the gain of this conversion
+    switch (c->pulses) {
+        case 25:
+            c->gain = 128;
+            break;
+        case 26:
+            c->gain = 32;
+            break;
+        case 27:
+            c->gain = 64;
+            break;
+    }
+    c->pulses = 0;
+
+    long value = convert(chip);
+    if (value > 0x7FFFFF) {
+        value = 0x7FFFFF;
+    } else if (value < -0x800000) {
+        value = -0x800000;
+    }
+    c->data = (uint32_t)value & 0xFFFFFF;
+    c->dout = 0;
+
+    if (falling_edge && c->irq_enabled && c->irq_handler) {
+        EM0_NS += HX711_SIM_ISR_NS;
+        READOUTS++;
+        c->irq_handler(chip, c->irq_ctx);
+    }
+}
+
+// output of the load cell and the ADC at the end of a conversion
+static long convert(uint8_t chip) {
+    chip_t *c = &CHIPS[chip];
+    const hx711_sim_load_t *load = &c->load;
+    float value;
+
+    if (INPUT) {
+        value = INPUT(chip, TIME, c->gain);
+    } else {
+        float t = TIME >= load->start_us ? (float)(TIME - load->start_us) : -1;
+        float phase = load->period_us ? fmodf(t, load->period_us) / load->period_us : 0;
+        value = load->base;
+        switch (load->waveform) {
+            case HX711_SIM_CONSTANT:
+                break;
+            case HX711_SIM_STEP:
+                value += t >= 0 ? load->amplitude : 0;
+                break;
+            case HX711_SIM_RAMP:
+                if (t >= load->period_us) {
+                    value += load->amplitude;
+                } else if (t >= 0) {
+                    value += load->amplitude * t / load->period_us;
+                }
+                break;
+            case HX711_SIM_SINE:
+                value += t >= 0 ? load->amplitude * sinf(2 * PI * phase) : 0;
+                break;
+            case HX711_SIM_SQUARE:
+                value += t >= 0 && phase >= 0.5f ? load->amplitude : 0;
+                break;
+        }
+        value = value * c->gain / 128;
+    }
+
+    // creep: part of each load change appears slowly, the output follows the load with a lag
+    if (!c->primed) {
+        c->primed = 1;
+        c->lagged = value;
+    } else if (load->creep_tau_s > 0) {
+        float dt = (TIME - c->last_conversion) * 1e-6f;
+        c->lagged += (value - c->lagged) * (1 - expf(-dt / load->creep_tau_s));
+    }
+    c->last_conversion = TIME;
+    value -= load->creep * (value - c->lagged);
+
+    float delta = CELSIUS - c->ref_celsius;
+    value += value * c->span_ppm_per_degree * delta * 1e-6f + c->zero_per_degree * delta;
+    value += load->drift * TIME * 1e-6f;
+    if (load->noise > 0) {
+        value += load->noise * gaussian();
+    }
+
+    // after a reset the output rises while the input filter settles
+    if (c->settling) {
+        uint64_t elapsed = TIME - c->wake;
+        if (elapsed < settle_us()) {
+            value = value * elapsed / settle_us();
+        } else {
+            c->settling = 0;
+        }
+    }
+    return lroundf(value);
+}
+
+// standard normal deviate from a xorshift generator, Box-Muller transform
+static float gaussian(void) {
+    float u[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        SEED ^= SEED << 13;
+        SEED ^= SEED >> 17;
+        SEED ^= SEED << 5;
+        u[i] = (SEED >> 8) * (1.0f / 16777216.0f);
+    }
+    return sqrtf(-2 * logf(u[0] + 1e-9f)) * cosf(2 * PI * u[1]);
+}
+
+static chip_t *find_dout(uint8_t dout_pin) {
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        if (CHIPS[i].connected && CHIPS[i].dout_pin == dout_pin) {
+            return &CHIPS[i];
+        }
+    }
+    return 0;
+}
+
+// accounts the power state of the chips over a time step
+static void account(uint64_t us) {
+    for (uint8_t i = 0; i < HX711_SIM_CHIPS; i++) {
+        if (!CHIPS[i].connected) {
+            continue;
+        }
+        if (CHIPS[i].down) {
+            HX711_DOWN_US += us;
+        } else {
+            HX711_ON_US += us;
+        }
+    }
+}
+
+// output settling time at the current rate
+static uint32_t settle_us(void) {
+    return PERIOD < 100000 ? HX711_SIM_SETTLE_US_80SPS : HX711_SIM_SETTLE_US_10SPS;
+}
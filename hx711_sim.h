@@ -0,0 +1,144 @@
+#ifndef HX711_SIM_h
+#define HX711_SIM_h
+
+#include <stdint.h>
+
+// Host simulation of the HX711 serial interface
+// Builds the driver with -DHX711_PLATFORM_HOST and replaces the GPIO accesses of hx711_platform.h,
+// so the driver can be exercised and timed on a PC. Time is virtual and advances only through
+// hx711_sim_advance() and hx711_sim_wait().
+// Several chips can be simulated; pins are identified by their number only, chips connected to
+// the same SCK pin receive the same clock pulses.
+// Like the real chip, a simulated chip enters power down mode when its SCK pin stays high for more than
+// 60 us, and resets when SCK goes low again: channel A, gain 128, and the output settles during the
+// settling time, the conversions completing meanwhile only carry part of the input. A change of the rate
+// settles the output the same way.
+
+#ifndef HX711_SIM_CHIPS
+#define HX711_SIM_CHIPS 4
+#endif
+
+// SCK high time after which the chip enters power down mode [us]
+#define HX711_SIM_POWER_DOWN_US     60
+
+// output settling time after a power up or a rate change [us]
+#define HX711_SIM_SETTLE_US_10SPS   400000
+#define HX711_SIM_SETTLE_US_80SPS   50000
+
+// returns the raw conversion result of the simulated load cell at the given time
+// gain is the gain factor selected for the conversion (128, 64 or 32)
+typedef long (*hx711_sim_input_t)(uint8_t chip, uint64_t time_us, uint8_t gain);
+
+// load waveforms of the built-in load cell model, in counts at gain 128
+typedef enum hx711_sim_waveform {
+    HX711_SIM_CONSTANT,             // base
+    HX711_SIM_STEP,                 // base, then base + amplitude from start_us
+    HX711_SIM_RAMP,                 // base, rising to base + amplitude over period_us from start_us
+    HX711_SIM_SINE,                 // base + amplitude * sin(2 pi (t - start_us) / period_us)
+    HX711_SIM_SQUARE,               // base for the first half of period_us, base + amplitude for the second
+} hx711_sim_waveform_t;
+
+// built-in load cell model of a chip; the impairments also apply to the input set by hx711_sim_set_input()
+typedef struct hx711_sim_load {
+    hx711_sim_waveform_t waveform;
+    long base;
+    long amplitude;
+    uint64_t start_us;
+    uint32_t period_us;
+    float noise;                    // RMS of the Gaussian noise [counts]
+    float drift;                    // zero drift since the reset [counts/s]
+    float creep;                    // fraction of a load change that appears with the creep time constant
+    float creep_tau_s;
+} hx711_sim_load_t;
+
+// resets the simulation; rate_sps is the output data rate (10 or 80)
+// only chip 0 is connected, to SCK pin 0 and DOUT pin 0 (the pins of the default instance)
+void hx711_sim_reset(uint16_t rate_sps);
+
+// connects a chip to the given pins
+void hx711_sim_connect(uint8_t chip, uint8_t sck_pin, uint8_t dout_pin);
+
+// unplugs a chip: its DOUT pin floats high, no conversion completes until it is connected again
+void hx711_sim_disconnect(uint8_t chip);
+
+// sets the input signal of all chips, instead of the waveforms of the load cell model
+// the default input is the waveform of each chip, constant 0 by default
+void hx711_sim_set_input(hx711_sim_input_t input);
+
+// sets the load cell model of a chip
+void hx711_sim_set_load(uint8_t chip, const hx711_sim_load_t *load);
+
+// seeds the noise generator; the reset seeds it with a fixed value, so the runs are repeatable
+void hx711_sim_seed(uint32_t seed);
+
+// temperature model: the simulated chips and load cells sit at the given temperature [degC]
+// each chip drifts by zero_per_degree counts and span_ppm_per_degree ppm of its input per degree
+// away from ref_celsius; there is no drift by default
+void hx711_sim_set_temperature(float celsius);
+float hx711_sim_temperature();
+void hx711_sim_set_tempco(uint8_t chip, float ref_celsius, float zero_per_degree, float span_ppm_per_degree);
+
+// Energy accounting
+// The readouts are accounted as active CPU time (EM0) when bit-banged, and as EM1 time when clocked by the
+// USART; the rest of the time the CPU sleeps in EM2, waiting for the DOUT interrupt. The typical currents below (EFR32BG22 at 38.4 MHz, HX711 at 3.3 V) turn the
+// times into an average current; the radio is not included.
+#define HX711_SIM_EM0_UA            1040.0f     // 27 uA/MHz
+#define HX711_SIM_EM1_UA            700.0f      // 17 uA/MHz, plus the USART and the LDMA
+#define HX711_SIM_EM2_UA            1.4f
+#define HX711_SIM_HX711_ON_UA       1500.0f
+#define HX711_SIM_HX711_DOWN_UA     1.0f
+#define HX711_SIM_GPIO_PULSE_NS     500         // bit-banged clock period
+#define HX711_SIM_USART_PULSE_NS    1000        // 1 MHz USART clock
+#define HX711_SIM_ISR_NS            10000       // DOUT interrupt entry, decoding and callback
+
+typedef struct hx711_sim_energy {
+    uint64_t em0_us;                // CPU active
+    uint64_t em1_us;                // CPU sleeping, USART and LDMA running
+    uint64_t em2_us;                // CPU in deep sleep
+    uint64_t hx711_on_us;           // summed over the connected chips
+    uint64_t hx711_down_us;
+    uint32_t readouts;
+} hx711_sim_energy_t;
+
+// returns the time spent in each mode since the last reset
+void hx711_sim_energy(hx711_sim_energy_t *energy);
+void hx711_sim_energy_reset();
+
+// returns the average current of the accounted time [uA]
+float hx711_sim_average_ua(const hx711_sim_energy_t *energy);
+
+// returns the virtual time in microseconds
+uint64_t hx711_sim_time_us();
+
+// advances the virtual time, completing conversions and firing the DOUT interrupts on the way
+void hx711_sim_advance(uint32_t us);
+
+// returns the gain factor of the last completed conversion of a chip
+uint8_t hx711_sim_gain(uint8_t chip);
+
+// returns 1 if a chip is in power down mode
+uint8_t hx711_sim_powered_down(uint8_t chip);
+
+// platform backend, see hx711_platform.h
+void hx711_sim_clock_high(uint8_t sck_pin);
+void hx711_sim_clock_low(uint8_t sck_pin);
+uint8_t hx711_sim_get_dout(uint8_t dout_pin);
+void hx711_sim_set_rate(uint16_t rate_sps);
+void hx711_sim_delay();
+unsigned int hx711_sim_irq_init(uint8_t dout_pin, void (*handler)(uint8_t int_no, void *ctx), void *ctx);
+void hx711_sim_irq_enable(unsigned int int_no);
+void hx711_sim_irq_disable(unsigned int int_no);
+// asserts that a conversion, a timer or a wakeup is pending: otherwise the wait would never end
+void hx711_sim_wait();
+void hx711_sim_wakeup(uint32_t ms);
+// one-shot timer calling handler(ctx) ms from now, from the time advance; a start replaces the running timer
+// of the same id, which ranges up to HX711_SIM_CHIPS - 1
+void hx711_sim_timer_start(uint8_t id, uint32_t ms, void (*handler)(void *ctx), void *ctx);
+void hx711_sim_timer_stop(uint8_t id);
+
+// model of the USART transport: clocks count frames of frame_bits bits, sampling DOUT on the
+// falling edges like the synchronous USART does, then calls done with ctx
+uint8_t hx711_sim_transfer(uint8_t sck_pin, uint8_t dout_pin, uint16_t *frames, uint8_t frame_bits, uint8_t count,
+                           void (*done)(void *ctx), void *ctx);
+
+#endif /* HX711_SIM_h */
@@ -0,0 +1,90 @@
+#include "hx711_stream.h"
+#include "hx711_platform.h"
+
+#define MASK (HX711_STREAM_SIZE - 1)
+
+#if (HX711_STREAM_SIZE & MASK) != 0
+#error "HX711_STREAM_SIZE must be a power of 2"
+#endif
+
+static void sample_ready(hx711_t *dev, long value);
+
+uint8_t hx711_stream_start(hx711_stream_t *stream, hx711_t *dev, uint8_t sps) {
+    // the owner of a read in progress still finds its context in dev->user
+    if (hx711_is_busy(dev)) {
+        return 0;
+    }
+    stream->dev = dev;
+    stream->head = 0;
+    stream->tail = 0;
+    stream->overruns = 0;
+    stream->running = 1;
+    dev->user = stream;
+
+    hx711_set_rate(dev, sps);
+    if (!hx711_read_async(dev, sample_ready)) {
+        stream->running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void hx711_stream_stop(hx711_stream_t *stream) {
+    stream->running = 0;
+    hx711_read_cancel(stream->dev);
+}
+
+uint32_t hx711_stream_count(hx711_stream_t *stream) {
+    return stream->head - stream->tail;
+}
+
+uint32_t hx711_stream_read(hx711_stream_t *stream, hx711_sample_t *samples, uint32_t max) {
+    uint32_t tail = stream->tail;
+    uint32_t count = stream->head - tail;
+
+    if (count > max) {
+        count = max;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        samples[i] = stream->samples[(tail + i) & MASK];
+    }
+    // release the slots only after they have been copied
+    memory_barrier();
+    stream->tail = tail + count;
+    return count;
+}
+
+void hx711_stream_flush(hx711_stream_t *stream) {
+    stream->tail = stream->head;
+}
+
+uint32_t hx711_stream_overruns(hx711_stream_t *stream) {
+    critical_declare();
+
+    critical_enter();
+    uint32_t overruns = stream->overruns;
+    stream->overruns = 0;
+    critical_exit();
+    return overruns;
+}
+
+// producer: called from the DOUT interrupt with each new sample, re-arms the next read
+static void sample_ready(hx711_t *dev, long value) {
+    hx711_stream_t *stream = dev->user;
+    uint32_t head = stream->head;
+
+    if (!stream->running) {
+        return;
+    }
+    if (head - stream->tail < HX711_STREAM_SIZE) {
+        stream->samples[head & MASK].value = value;
+        stream->samples[head & MASK].timestamp = get_timestamp();
+        stream->samples[head & MASK].faults = dev->faults;
+        // publish the sample only after it has been written
+        memory_barrier();
+        stream->head = head + 1;
+    } else {
+        stream->overruns++;
+    }
+    hx711_read_async(dev, sample_ready);
+}
@@ -0,0 +1,52 @@
+#ifndef HX711_STREAM_h
+#define HX711_STREAM_h
+
+#include <stdint.h>
+#include "hx711.h"
+
+// Continuous acquisition: the HX711 keeps converting and every sample is pushed by the DOUT
+// interrupt into a single-producer/single-consumer lock-free ring buffer. Consumers drain batches
+// of samples instead of triggering their own conversions; they all have to run in the same
+// context (e.g. the main loop: app_process_action() and the Bluetooth event handlers).
+
+// capacity of the ring buffer, must be a power of 2
+#ifndef HX711_STREAM_SIZE
+#define HX711_STREAM_SIZE 32
+#endif
+
+// timestamped sample
+typedef struct hx711_sample {
+    long value;                     // raw reading
+    uint32_t timestamp;             // end of the readout, in platform ticks (sleeptimer ticks on target)
+    uint8_t faults;                 // 0, or the faults of a reading which failed the validation
+} hx711_sample_t;
+
+typedef struct hx711_stream {
+    hx711_t *dev;
+    hx711_sample_t samples[HX711_STREAM_SIZE];
+    volatile uint32_t head;         // written by the producer only
+    volatile uint32_t tail;         // written by the consumer only
+    volatile uint32_t overruns;     // samples dropped because the buffer was full
+    volatile uint8_t running;
+} hx711_stream_t;
+
+// starts streaming the instance at the given rate (10 or 80 SPS; ignored if the RATE pin is hardwired)
+// returns 0 if the instance is busy with another read
+uint8_t hx711_stream_start(hx711_stream_t *stream, hx711_t *dev, uint8_t sps);
+
+// stops streaming; samples already in the buffer can still be drained
+void hx711_stream_stop(hx711_stream_t *stream);
+
+// returns the number of samples waiting in the buffer
+uint32_t hx711_stream_count(hx711_stream_t *stream);
+
+// moves up to max samples, oldest first, out of the buffer; returns the number of samples moved
+uint32_t hx711_stream_read(hx711_stream_t *stream, hx711_sample_t *samples, uint32_t max);
+
+// drops the samples waiting in the buffer
+void hx711_stream_flush(hx711_stream_t *stream);
+
+// returns the number of samples dropped because the buffer was full, and clears it
+uint32_t hx711_stream_overruns(hx711_stream_t *stream);
+
+#endif /* HX711_STREAM_h */
@@ -0,0 +1,105 @@
+#include "hx711_platform.h"
+
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART && !defined(HX711_PLATFORM_HOST)
+
+#include <stdbool.h>
+#include "em_cmu.h"
+#include "em_usart.h"
+#include "dmadrv.h"
+#include "sl_component_catalog.h"
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
+#include "sl_power_manager.h"
+#endif
+
+static uint8_t INITIALIZED = 0;
+static unsigned int RX_CHANNEL = 0;
+static unsigned int TX_CHANNEL = 0;
+static volatile uint8_t BUSY = 0;
+static void (*DONE)(void *ctx) = 0;
+static void *DONE_CTX = 0;
+
+// the transmitted data is don't care, only the clock is used
+static const uint16_t DUMMY[5] = { 0 };
+
+static bool rx_done(unsigned int channel, unsigned int sequence_no, void *user_param);
+
+void hx711_usart_init() {
+    USART_InitSync_TypeDef init = USART_INITSYNC_DEFAULT;
+
+    if (INITIALIZED) {
+        return;
+    }
+    INITIALIZED = 1;
+
+    CMU_ClockEnable(HX711_USART_CLOCK, true);
+
+    init.baudrate = HX711_USART_BAUDRATE;
+    init.msbf = true;
+    init.clockMode = usartClockMode1; // PD_SCK idles low, DOUT is sampled on the falling edge
+    USART_InitSync(HX711_USART, &init);
+
+    DMADRV_Init();
+    DMADRV_AllocateChannel(&RX_CHANNEL, NULL);
+    DMADRV_AllocateChannel(&TX_CHANNEL, NULL);
+}
+
+uint8_t hx711_usart_start(uint8_t sck_port, uint8_t sck_pin, uint8_t dout_port, uint8_t dout_pin,
+                          uint16_t *frames, uint8_t frame_bits, uint8_t count, void (*done)(void *ctx), void *ctx) {
+    if (BUSY) {
+        return 0;
+    }
+    BUSY = 1;
+    DONE = done;
+    DONE_CTX = ctx;
+
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
+    // the USART clock does not run in EM2, stay in EM1 until the transfer completes
+    sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+#endif
+
+    // DATABITS: 4 bits is 1, 16 bits is 13
+    HX711_USART->FRAME = (HX711_USART->FRAME & ~_USART_FRAME_DATABITS_MASK)
+                         | ((uint32_t)(frame_bits - 3) << _USART_FRAME_DATABITS_SHIFT);
+    HX711_USART->CMD = USART_CMD_CLEARRX | USART_CMD_CLEARTX;
+
+    // PD_SCK is routed to the USART only during a transfer, otherwise the GPIO driver keeps control
+    // of it, e.g. to hold it high in power down mode
+    GPIO->USARTROUTE[HX711_USART_NUM].CLKROUTE = ((uint32_t)sck_port << _GPIO_USART_CLKROUTE_PORT_SHIFT)
+                                                 | ((uint32_t)sck_pin << _GPIO_USART_CLKROUTE_PIN_SHIFT);
+    GPIO->USARTROUTE[HX711_USART_NUM].RXROUTE = ((uint32_t)dout_port << _GPIO_USART_RXROUTE_PORT_SHIFT)
+                                                | ((uint32_t)dout_pin << _GPIO_USART_RXROUTE_PIN_SHIFT);
+    GPIO->USARTROUTE[HX711_USART_NUM].ROUTEEN = GPIO_USART_ROUTEEN_CLKPEN;
+
+    if (frame_bits > 9) {
+        // frames longer than 9 bits go through the double buffer registers
+        DMADRV_PeripheralMemory(RX_CHANNEL, HX711_USART_RX_SIGNAL, frames, (void *)&HX711_USART->RXDOUBLE,
+                                true, count, dmadrvDataSize2, rx_done, NULL);
+        DMADRV_MemoryPeripheral(TX_CHANNEL, HX711_USART_TX_SIGNAL, (void *)&HX711_USART->TXDOUBLE, (void *)DUMMY,
+                                true, count, dmadrvDataSize2, NULL, NULL);
+    } else {
+        DMADRV_PeripheralMemory(RX_CHANNEL, HX711_USART_RX_SIGNAL, frames, (void *)&HX711_USART->RXDATAX,
+                                true, count, dmadrvDataSize2, rx_done, NULL);
+        DMADRV_MemoryPeripheral(TX_CHANNEL, HX711_USART_TX_SIGNAL, (void *)&HX711_USART->TXDATAX, (void *)DUMMY,
+                                true, count, dmadrvDataSize2, NULL, NULL);
+    }
+    return 1;
+}
+
+// all frames are received: give PD_SCK back to the GPIO driver, it idles low in both cases
+static bool rx_done(unsigned int channel, unsigned int sequence_no, void *user_param) {
+    (void)channel;
+    (void)sequence_no;
+    (void)user_param;
+
+    GPIO->USARTROUTE[HX711_USART_NUM].ROUTEEN = 0;
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
+    sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+#endif
+    BUSY = 0;
+    if (DONE) {
+        DONE(DONE_CTX);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HX711_USART_h
+#define HX711_USART_h
+
+#include <stdint.h>
+
+// Hardware-clocked readout of the HX711: the USART in synchronous master mode generates the PD_SCK
+// pulses and samples DOUT, LDMA moves the frames, so the CPU is free during the readout and the
+// timing does not depend on interrupt latency. Selected with HX711_TRANSPORT in hx711_platform.h.
+
+#ifndef HX711_USART
+#define HX711_USART              USART0
+#define HX711_USART_NUM          0
+#define HX711_USART_CLOCK        cmuClock_USART0
+#define HX711_USART_RX_SIGNAL    dmadrvPeripheralSignal_USART0_RXDATAV
+#define HX711_USART_TX_SIGNAL    dmadrvPeripheralSignal_USART0_TXBL
+#endif
+
+// PD_SCK high time is 0.5 us at 1 MHz; the datasheet allows 0.2 to 50 us
+#ifndef HX711_USART_BAUDRATE
+#define HX711_USART_BAUDRATE     1000000
+#endif
+
+// configures the USART and allocates the DMA channels; later calls do nothing
+void hx711_usart_init();
+
+// routes the USART to the given pins and clocks count frames of frame_bits bits (4..16) into frames
+// done is called with ctx from the LDMA interrupt; returns 0 if a transfer is already in progress
+uint8_t hx711_usart_start(uint8_t sck_port, uint8_t sck_pin, uint8_t dout_port, uint8_t dout_pin,
+                          uint16_t *frames, uint8_t frame_bits, uint8_t count, void (*done)(void *ctx), void *ctx);
+
+#endif /* HX711_USART_h */
@@ -0,0 +1,216 @@
+/***************************************************************************//**
+ * @file profile.c
+ * @brief Cycle-accurate profiling of the hot paths.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include "profile.h"
+
+#if defined(HX711_PLATFORM_HOST)
+#include <stdio.h>
+#define app_log(...) printf(__VA_ARGS__)
+#define CORE_DECLARE_IRQ_STATE
+#define CORE_ENTER_ATOMIC()
+#define CORE_EXIT_ATOMIC()
+#else
+#include "em_core.h"
+#include "sl_component_catalog.h"
+#if defined(SL_CATALOG_APP_LOG_PRESENT)
+#include "app_log.h"
+#else
+#define app_log(...)
+#endif // SL_CATALOG_APP_LOG_PRESENT
+#endif
+
+#if PROFILE_ENABLED
+
+static const char *const probe_names[PROFILE_PROBE_COUNT] = {
+  "hx711_read",
+  "hx711_readout",
+  "hx711_to_mg",
+  "measurement_ready",
+  "bthome_build",
+};
+
+static profile_stats_t stats[PROFILE_PROBE_COUNT];
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value);
+
+/**************************************************************************//**
+ * Start the cycle counter and clear the statistics.
+ *****************************************************************************/
+void profile_init(void)
+{
+#if !defined(HX711_PLATFORM_HOST)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  profile_reset();
+}
+
+void profile_reset(void)
+{
+  CORE_DECLARE_IRQ_STATE;
+
+  CORE_ENTER_ATOMIC();
+  memset(stats, 0, sizeof(stats));
+  for (uint8_t i = 0; i < PROFILE_PROBE_COUNT; i++) {
+    stats[i].min = UINT32_MAX;
+  }
+  CORE_EXIT_ATOMIC();
+}
+
+/**************************************************************************//**
+ * Account a duration to a probe. The bucket is the position of the highest set
+ * bit divided by two, so the histogram covers the whole 32-bit range.
+ *****************************************************************************/
+void profile_record(profile_probe_t probe, uint32_t ticks)
+{
+  profile_stats_t *s = &stats[probe];
+  uint8_t bucket = ticks ? (31 - __builtin_clz(ticks)) / 2 : 0;
+  CORE_DECLARE_IRQ_STATE;
+
+  CORE_ENTER_ATOMIC();
+  s->count++;
+  s->sum += ticks;
+  if (ticks < s->min) {
+    s->min = ticks;
+  }
+  if (ticks > s->max) {
+    s->max = ticks;
+  }
+  s->histogram[bucket]++;
+  CORE_EXIT_ATOMIC();
+}
+
+void profile_get(profile_probe_t probe, profile_stats_t *out)
+{
+  CORE_DECLARE_IRQ_STATE;
+
+  CORE_ENTER_ATOMIC();
+  *out = stats[probe];
+  CORE_EXIT_ATOMIC();
+}
+
+/**************************************************************************//**
+ * Log the statistics of all probes, in microseconds.
+ *****************************************************************************/
+void profile_dump(void)
+{
+  uint32_t ticks_per_us = PROFILE_TICKS_PER_SECOND / 1000000;
+  profile_stats_t s;
+
+  app_log("profile [us]: count min mean max\n");
+  for (uint8_t i = 0; i < PROFILE_PROBE_COUNT; i++) {
+    profile_get((profile_probe_t)i, &s);
+    if (s.count == 0) {
+      app_log("  %-18s -\n", probe_names[i]);
+      continue;
+    }
+    app_log("  %-18s %lu %lu %lu %lu\n",
+            probe_names[i],
+            (unsigned long)s.count,
+            (unsigned long)(s.min / ticks_per_us),
+            (unsigned long)(s.sum / s.count / ticks_per_us),
+            (unsigned long)(s.max / ticks_per_us));
+    app_log("   ");
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {
+      app_log(" %lu", (unsigned long)s.histogram[b]);
+    }
+    app_log("\n");
+  }
+}
+
+size_t profile_serialize(uint8_t *buf, size_t size)
+{
+  uint8_t *p = buf;
+  profile_stats_t s;
+
+  if (size < PROFILE_SERIALIZED_LEN) {
+    return 0;
+  }
+  p = put_u32(p, PROFILE_TICKS_PER_SECOND);
+  for (uint8_t i = 0; i < PROFILE_PROBE_COUNT; i++) {
+    profile_get((profile_probe_t)i, &s);
+    p = put_u32(p, s.count);
+    p = put_u32(p, s.count ? s.min : 0);
+    p = put_u32(p, s.max);
+    p = put_u32(p, s.count ? (uint32_t)(s.sum / s.count) : 0);
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {
+      uint16_t n = s.histogram[b] > UINT16_MAX ? UINT16_MAX : (uint16_t)s.histogram[b];
+      *p++ = (uint8_t)n;
+      *p++ = (uint8_t)(n >> 8);
+    }
+  }
+  return (size_t)(p - buf);
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+  for (uint8_t i = 0; i < 4; i++) {
+    *p++ = (uint8_t)(value >> (8 * i));
+  }
+  return p;
+}
+
+#else
+
+void profile_init(void)
+{
+}
+
+void profile_reset(void)
+{
+}
+
+void profile_record(profile_probe_t probe, uint32_t ticks)
+{
+  (void)probe;
+  (void)ticks;
+}
+
+void profile_get(profile_probe_t probe, profile_stats_t *stats)
+{
+  (void)probe;
+  memset(stats, 0, sizeof(*stats));
+}
+
+void profile_dump(void)
+{
+  app_log("profiling disabled\n");
+}
+
+size_t profile_serialize(uint8_t *buf, size_t size)
+{
+  (void)buf;
+  (void)size;
+  return 0;
+}
+
+#endif // PROFILE_ENABLED
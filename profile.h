@@ -0,0 +1,145 @@
+/***************************************************************************//**
+ * @file profile.h
+ * @brief Cycle-accurate profiling of the hot paths.
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2024 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * SPDX-License-Identifier: Zlib
+ *
+ * The licensor of this software is Silicon Laboratories Inc.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ *
+ ******************************************************************************/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Profiling is compiled in only when PROFILE_ENABLED is defined to 1, e.g. in
+// the project defines. Otherwise the probes expand to nothing.
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+// Histogram buckets: bucket i counts the durations in [4^i, 4^(i+1)) ticks.
+#define PROFILE_BUCKETS         16
+
+// Size of the serialized table: tick rate, then one record per probe.
+#define PROFILE_RECORD_LEN      (4 * sizeof(uint32_t) + PROFILE_BUCKETS * sizeof(uint16_t))
+#define PROFILE_SERIALIZED_LEN  (sizeof(uint32_t) + PROFILE_PROBE_COUNT * PROFILE_RECORD_LEN)
+
+// Probed code paths.
+typedef enum {
+  PROFILE_HX711_READ,         // blocking read, hx711_read()
+  PROFILE_HX711_READOUT,      // clocking out a conversion in the DOUT interrupt
+  PROFILE_HX711_TO_MG,        // conversion of a reading to milligrams
+  PROFILE_MEASUREMENT_READY,  // serving the requests waiting for a measurement
+  PROFILE_BTHOME_BUILD,       // bthome_v2_build_packet()
+  PROFILE_PROBE_COUNT
+} profile_probe_t;
+
+// Statistics of a probe, in ticks.
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t histogram[PROFILE_BUCKETS];
+} profile_stats_t;
+
+#if PROFILE_ENABLED
+
+// Ticks are core clock cycles counted by the DWT on target, nanoseconds of the
+// C11 UTC clock on host. The DWT counter stops with the core clock, so the
+// time spent sleeping in EM2 is not counted.
+#if defined(HX711_PLATFORM_HOST)
+#include <time.h>
+
+static inline uint32_t profile_now(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+#define PROFILE_TICKS_PER_SECOND 1000000000UL
+#else
+#include "em_device.h"
+
+static inline uint32_t profile_now(void)
+{
+  return DWT->CYCCNT;
+}
+
+#define PROFILE_TICKS_PER_SECOND SystemCoreClock
+#endif
+
+// Time the code between PROFILE_START and PROFILE_STOP of the same probe, in
+// the same scope.
+#define PROFILE_START(probe)  uint32_t profile_start_##probe = profile_now()
+#define PROFILE_STOP(probe)   profile_record(probe, profile_now() - profile_start_##probe)
+
+#else
+
+#define PROFILE_START(probe)
+#define PROFILE_STOP(probe)
+
+#endif // PROFILE_ENABLED
+
+/**************************************************************************//**
+ * Start the cycle counter and clear the statistics.
+ *****************************************************************************/
+void profile_init(void);
+
+/**************************************************************************//**
+ * Clear the statistics.
+ *****************************************************************************/
+void profile_reset(void);
+
+/**************************************************************************//**
+ * Account a duration to a probe. Safe to call from interrupt context.
+ *
+ * @param[in] probe Probe.
+ * @param[in] ticks Duration.
+ *****************************************************************************/
+void profile_record(profile_probe_t probe, uint32_t ticks);
+
+/**************************************************************************//**
+ * Copy the statistics of a probe.
+ *****************************************************************************/
+void profile_get(profile_probe_t probe, profile_stats_t *stats);
+
+/**************************************************************************//**
+ * Log the statistics of all probes.
+ *****************************************************************************/
+void profile_dump(void);
+
+/**************************************************************************//**
+ * Serialize the statistics as little endian integers: the tick rate in Hz as
+ * uint32, then for each probe the count, min, max and mean as uint32 and the
+ * histogram as uint16, saturated.
+ *
+ * @return Number of bytes written, 0 if profiling is disabled.
+ *****************************************************************************/
+size_t profile_serialize(uint8_t *buf, size_t size);
+
+#endif // PROFILE_H
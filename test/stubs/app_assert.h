@@ -0,0 +1,11 @@
+// host stand-in of the Silicon Labs SDK header: a failed assertion aborts the test
+#ifndef APP_ASSERT_H
+#define APP_ASSERT_H
+
+#include <assert.h>
+#include "sl_status.h"
+
+#define app_assert(expr, ...)  assert(expr)
+#define app_assert_status(sc)  assert((sc) == SL_STATUS_OK)
+
+#endif // APP_ASSERT_H
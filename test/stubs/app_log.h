@@ -0,0 +1,9 @@
+// host stand-in of the Silicon Labs SDK header
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+#include <stdio.h>
+
+#define app_log(...)  printf(__VA_ARGS__)
+
+#endif // APP_LOG_H
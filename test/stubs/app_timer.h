@@ -0,0 +1,27 @@
+// host stand-in of the Silicon Labs SDK header: the timers expire on the simulated time, the
+// tests run their callbacks from stubs_timer_due()
+#ifndef APP_TIMER_H
+#define APP_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+typedef struct app_timer app_timer_t;
+
+typedef void (*app_timer_callback_t)(app_timer_t *timer, void *data);
+
+struct app_timer {
+    app_timer_callback_t callback;
+    void *callback_data;
+    uint64_t deadline_us;
+    uint32_t period_ms; // 0 for a one-shot timer
+    bool running;
+    app_timer_t *next;
+};
+
+sl_status_t app_timer_start(app_timer_t *timer, uint32_t timeout_ms, app_timer_callback_t callback,
+                            void *callback_data, bool is_periodic);
+sl_status_t app_timer_stop(app_timer_t *timer);
+
+#endif // APP_TIMER_H
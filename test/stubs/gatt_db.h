@@ -0,0 +1,10 @@
+// host stand-in of the header generated from gatt_configuration.btconf
+#ifndef GATT_DB_H
+#define GATT_DB_H
+
+#define gattdb_mass         20
+#define gattdb_calibration  23
+#define gattdb_health       26
+#define gattdb_profile      29
+
+#endif // GATT_DB_H
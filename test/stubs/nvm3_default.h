@@ -0,0 +1,24 @@
+// host stand-in of the Silicon Labs SDK header: the objects are kept in RAM
+#ifndef NVM3_DEFAULT_H
+#define NVM3_DEFAULT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t Ecode_t;
+typedef uint32_t nvm3_ObjectKey_t;
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+#define ECODE_NVM3_OK                 ((Ecode_t)0)
+#define ECODE_NVM3_ERR_WRITE_FAILED   ((Ecode_t)0xF0000009)
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND  ((Ecode_t)0xF000000E)
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+Ecode_t nvm3_readCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *value);
+Ecode_t nvm3_writeCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t value);
+
+#endif // NVM3_DEFAULT_H
@@ -0,0 +1,9 @@
+// host stand-in of the Silicon Labs SDK header
+#ifndef SL_BLUETOOTH_H
+#define SL_BLUETOOTH_H
+
+#include "sl_bt_api.h"
+
+void sl_bt_on_event(sl_bt_msg_t *evt);
+
+#endif // SL_BLUETOOTH_H
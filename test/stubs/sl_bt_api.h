@@ -0,0 +1,137 @@
+// host stand-in of the Bluetooth stack API, with the commands and events the application uses
+#ifndef SL_BT_API_H
+#define SL_BT_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define SL_BT_MSG_ID(header)  (header)
+
+enum {
+    sl_bt_evt_system_boot_id = 1,
+    sl_bt_evt_system_external_signal_id,
+    sl_bt_evt_connection_opened_id,
+    sl_bt_evt_connection_closed_id,
+    sl_bt_evt_gatt_server_characteristic_status_id,
+    sl_bt_evt_gatt_server_user_read_request_id,
+    sl_bt_evt_gatt_server_user_write_request_id,
+};
+
+typedef struct {
+    uint8_t addr[6];
+} bd_addr;
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[255];
+} uint8array;
+
+typedef struct {
+    uint16_t major;
+    uint16_t minor;
+    uint16_t patch;
+    uint16_t build;
+} sl_bt_evt_system_boot_t;
+
+typedef struct {
+    uint32_t extsignals;
+} sl_bt_evt_system_external_signal_t;
+
+typedef struct {
+    uint8_t connection;
+} sl_bt_evt_connection_opened_t;
+
+typedef struct {
+    uint16_t reason;
+    uint8_t connection;
+} sl_bt_evt_connection_closed_t;
+
+typedef struct {
+    uint8_t connection;
+    uint16_t characteristic;
+    uint8_t status_flags;
+    uint16_t client_config_flags;
+} sl_bt_evt_gatt_server_characteristic_status_t;
+
+typedef struct {
+    uint8_t connection;
+    uint16_t characteristic;
+    uint8_t att_opcode;
+    uint16_t offset;
+} sl_bt_evt_gatt_server_user_read_request_t;
+
+typedef struct {
+    uint8_t connection;
+    uint16_t characteristic;
+    uint8_t att_opcode;
+    uint16_t offset;
+    uint8array value;
+} sl_bt_evt_gatt_server_user_write_request_t;
+
+typedef struct {
+    uint32_t header;
+    union {
+        sl_bt_evt_system_boot_t evt_system_boot;
+        sl_bt_evt_system_external_signal_t evt_system_external_signal;
+        sl_bt_evt_connection_opened_t evt_connection_opened;
+        sl_bt_evt_connection_closed_t evt_connection_closed;
+        sl_bt_evt_gatt_server_characteristic_status_t evt_gatt_server_characteristic_status;
+        sl_bt_evt_gatt_server_user_read_request_t evt_gatt_server_user_read_request;
+        sl_bt_evt_gatt_server_user_write_request_t evt_gatt_server_user_write_request;
+    } data;
+} sl_bt_msg_t;
+
+typedef enum {
+    sl_bt_gatt_disable = 0x0,
+    sl_bt_gatt_notification = 0x1,
+    sl_bt_gatt_indication = 0x2,
+} sl_bt_gatt_client_config_flag_t;
+
+typedef enum {
+    sl_bt_gatt_server_client_config = 0x1,
+    sl_bt_gatt_server_confirmation = 0x2,
+} sl_bt_gatt_server_characteristic_status_flag_t;
+
+enum {
+    sl_bt_advertiser_advertising_data_packet = 0x0,
+    sl_bt_advertiser_scan_response_packet = 0x1,
+};
+
+enum {
+    sl_bt_advertiser_general_discoverable = 0x2,
+};
+
+enum {
+    sl_bt_legacy_advertiser_non_connectable = 0x0,
+    sl_bt_legacy_advertiser_connectable = 0x2,
+};
+
+enum {
+    sl_bt_extended_advertiser_non_connectable = 0x0,
+};
+
+sl_status_t sl_bt_system_get_identity_address(bd_addr *address, uint8_t *type);
+sl_status_t sl_bt_system_data_buffer_write(size_t data_len, const uint8_t *data);
+sl_status_t sl_bt_system_data_buffer_clear(void);
+void sl_bt_external_signal(uint32_t signals);
+
+sl_status_t sl_bt_advertiser_create_set(uint8_t *handle);
+sl_status_t sl_bt_advertiser_set_timing(uint8_t handle, uint32_t interval_min, uint32_t interval_max,
+                                        uint16_t duration, uint8_t maxevents);
+sl_status_t sl_bt_advertiser_stop(uint8_t handle);
+sl_status_t sl_bt_legacy_advertiser_set_data(uint8_t handle, uint8_t type, size_t data_len, const uint8_t *data);
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t handle, uint8_t discover);
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t handle, uint8_t connect);
+sl_status_t sl_bt_extended_advertiser_set_data(uint8_t handle, size_t data_len, const uint8_t *data);
+sl_status_t sl_bt_extended_advertiser_set_long_data(uint8_t handle);
+sl_status_t sl_bt_extended_advertiser_start(uint8_t handle, uint8_t connect, uint32_t flags);
+
+sl_status_t sl_bt_gatt_server_send_user_read_response(uint8_t connection, uint16_t characteristic,
+                                                      uint8_t att_errorcode, size_t value_len,
+                                                      const uint8_t *value, uint16_t *sent_len);
+sl_status_t sl_bt_gatt_server_send_user_write_response(uint8_t connection, uint16_t characteristic,
+                                                       uint8_t att_errorcode);
+sl_status_t sl_bt_gatt_server_notify_all(uint16_t characteristic, size_t value_len, const uint8_t *value);
+
+#endif // SL_BT_API_H
@@ -0,0 +1,11 @@
+// host stand-in of the generated component catalog, with the components of bt_soc_bthome_v2_scale.slcp
+// the application uses; STUBS_LEGACY_ADVERTISING builds without the extended advertiser
+#ifndef SL_COMPONENT_CATALOG_H
+#define SL_COMPONENT_CATALOG_H
+
+#define SL_CATALOG_APP_LOG_PRESENT
+#if !defined(STUBS_LEGACY_ADVERTISING)
+#define SL_CATALOG_BLUETOOTH_FEATURE_EXTENDED_ADVERTISER_PRESENT
+#endif
+
+#endif // SL_COMPONENT_CATALOG_H
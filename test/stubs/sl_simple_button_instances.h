@@ -0,0 +1,22 @@
+// host stand-in of the Silicon Labs SDK header: the tests press the buttons with stubs_press()
+#ifndef SL_SIMPLE_BUTTON_INSTANCES_H
+#define SL_SIMPLE_BUTTON_INSTANCES_H
+
+#include <stdint.h>
+
+#define SL_SIMPLE_BUTTON_RELEASED  0
+#define SL_SIMPLE_BUTTON_PRESSED   1
+
+typedef uint8_t sl_button_state_t;
+
+typedef struct {
+    sl_button_state_t state;
+} sl_button_t;
+
+extern const sl_button_t sl_button_btn0;
+extern const sl_button_t sl_button_btn1;
+
+sl_button_state_t sl_button_get_state(const sl_button_t *handle);
+void sl_button_on_change(const sl_button_t *handle);
+
+#endif // SL_SIMPLE_BUTTON_INSTANCES_H
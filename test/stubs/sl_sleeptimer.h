@@ -0,0 +1,12 @@
+// host stand-in of the Silicon Labs SDK header: the ticks count the simulated time at 32768 Hz
+#ifndef SL_SLEEPTIMER_H
+#define SL_SLEEPTIMER_H
+
+#include <stdint.h>
+#include "sl_status.h"
+
+uint64_t sl_sleeptimer_get_tick_count64(void);
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms);
+sl_status_t sl_sleeptimer_tick64_to_ms(uint64_t tick, uint64_t *ms);
+
+#endif // SL_SLEEPTIMER_H
@@ -0,0 +1,21 @@
+// host stand-in of the Silicon Labs SDK header, with what the application uses
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                ((sl_status_t)0x0000)
+#define SL_STATUS_FAIL              ((sl_status_t)0x0001)
+#define SL_STATUS_INVALID_STATE     ((sl_status_t)0x0002)
+#define SL_STATUS_NOT_READY         ((sl_status_t)0x0003)
+#define SL_STATUS_BUSY              ((sl_status_t)0x0004)
+#define SL_STATUS_TIMEOUT           ((sl_status_t)0x0007)
+#define SL_STATUS_NOT_FOUND         ((sl_status_t)0x000C)
+#define SL_STATUS_NOT_SUPPORTED     ((sl_status_t)0x000F)
+#define SL_STATUS_FULL              ((sl_status_t)0x0019)
+#define SL_STATUS_INVALID_PARAMETER ((sl_status_t)0x0021)
+#define SL_STATUS_NO_MORE_RESOURCE  ((sl_status_t)0x0022)
+
+#endif // SL_STATUS_H
@@ -0,0 +1,11 @@
+// host stand-in of the Silicon Labs SDK header, with what the application uses
+#ifndef SL_STRING_H
+#define SL_STRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool sl_str_is_empty(const char *str);
+size_t sl_strlen(char *str);
+
+#endif // SL_STRING_H
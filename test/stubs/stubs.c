@@ -0,0 +1,394 @@
+#include <string.h>
+#include "stubs.h"
+#include "app_timer.h"
+#include "hx711_sim.h"
+#include "nvm3_default.h"
+#include "sl_bluetooth.h"
+#include "sl_simple_button_instances.h"
+#include "sl_sleeptimer.h"
+#include "sl_string.h"
+
+#define TICK_HZ           32768
+#define NVM3_MAX_OBJECTS  16
+#define NVM3_MAX_LEN      128
+
+static stubs_advertiser_t advertisers[STUBS_MAX_ADVERTISERS];
+static uint8_t advertiser_count;
+static bool advertiser_failing;
+static uint32_t signals;
+static app_timer_t *timers;
+static stubs_response_t responses[STUBS_MAX_RESPONSES];
+static size_t response_count;
+static uint32_t notifications;
+static uint8_t data_buffer[256];
+static size_t data_buffer_len;
+
+typedef struct {
+    bool used;
+    bool counter;
+    nvm3_ObjectKey_t key;
+    size_t len;
+    uint8_t data[NVM3_MAX_LEN];
+} nvm3_object_t;
+
+static nvm3_object_t objects[NVM3_MAX_OBJECTS];
+static bool nvm3_failing;
+static uint32_t nvm3_writes;
+nvm3_Handle_t *nvm3_defaultHandle;
+
+const sl_button_t sl_button_btn0;
+const sl_button_t sl_button_btn1;
+static const sl_button_t *pressed;
+
+void stubs_reset(void) {
+    app_timer_t *timer;
+
+    memset(advertisers, 0, sizeof(advertisers));
+    advertiser_count = 0;
+    advertiser_failing = false;
+    signals = 0;
+    for (timer = timers; timer; timer = timer->next) {
+        timer->running = false;
+    }
+    timers = 0;
+    response_count = 0;
+    notifications = 0;
+    data_buffer_len = 0;
+    memset(objects, 0, sizeof(objects));
+    nvm3_failing = false;
+    nvm3_writes = 0;
+}
+
+stubs_advertiser_t *stubs_advertiser(uint8_t handle) {
+    return handle < advertiser_count ? &advertisers[handle] : 0;
+}
+
+uint32_t stubs_take_signals(void) {
+    uint32_t taken = signals;
+
+    signals = 0;
+    return taken;
+}
+
+app_timer_t *stubs_timer_due(void) {
+    uint64_t now = hx711_sim_time_us();
+
+    for (app_timer_t *timer = timers; timer; timer = timer->next) {
+        if (timer->running && timer->deadline_us <= now) {
+            if (timer->period_ms) {
+                timer->deadline_us += (uint64_t)timer->period_ms * 1000;
+            } else {
+                timer->running = false;
+            }
+            return timer;
+        }
+    }
+    return 0;
+}
+
+size_t stubs_take_responses(stubs_response_t *taken, size_t max) {
+    size_t count = response_count < max ? response_count : max;
+
+    memcpy(taken, responses, count * sizeof(*taken));
+    response_count = 0;
+    return count;
+}
+
+uint32_t stubs_notifications(void) {
+    return notifications;
+}
+
+void stubs_advertiser_fail_start(bool fail) {
+    advertiser_failing = fail;
+}
+
+void stubs_press(const sl_button_t *button) {
+    pressed = button;
+    sl_button_on_change(button);
+    pressed = 0;
+}
+
+// sdk
+
+bool sl_str_is_empty(const char *str) {
+    return str == 0 || *str == 0;
+}
+
+size_t sl_strlen(char *str) {
+    return strlen(str);
+}
+
+sl_button_state_t sl_button_get_state(const sl_button_t *handle) {
+    return handle == pressed ? SL_SIMPLE_BUTTON_PRESSED : SL_SIMPLE_BUTTON_RELEASED;
+}
+
+uint64_t sl_sleeptimer_get_tick_count64(void) {
+    return hx711_sim_time_us() * TICK_HZ / 1000000;
+}
+
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms) {
+    return (uint32_t)time_ms * TICK_HZ / 1000;
+}
+
+sl_status_t sl_sleeptimer_tick64_to_ms(uint64_t tick, uint64_t *ms) {
+    *ms = tick * 1000 / TICK_HZ;
+    return SL_STATUS_OK;
+}
+
+sl_status_t app_timer_start(app_timer_t *timer, uint32_t timeout_ms, app_timer_callback_t callback,
+                            void *callback_data, bool is_periodic) {
+    app_timer_t *t = timers;
+
+    while (t && t != timer) {
+        t = t->next;
+    }
+    if (!t) {
+        timer->next = timers;
+        timers = timer;
+    }
+    timer->callback = callback;
+    timer->callback_data = callback_data;
+    timer->deadline_us = hx711_sim_time_us() + (uint64_t)timeout_ms * 1000;
+    timer->period_ms = is_periodic ? timeout_ms : 0;
+    timer->running = true;
+    return SL_STATUS_OK;
+}
+
+sl_status_t app_timer_stop(app_timer_t *timer) {
+    timer->running = false;
+    return SL_STATUS_OK;
+}
+
+// bluetooth stack
+
+sl_status_t sl_bt_system_get_identity_address(bd_addr *address, uint8_t *type) {
+    static const bd_addr ADDRESS = { { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 } };
+
+    *address = ADDRESS;
+    *type = 0;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_system_data_buffer_write(size_t data_len, const uint8_t *data) {
+    // a single command carries as much as the extended advertising data
+    if (data_len > 191 || data_buffer_len + data_len > sizeof(data_buffer)) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(&data_buffer[data_buffer_len], data, data_len);
+    data_buffer_len += data_len;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_system_data_buffer_clear(void) {
+    data_buffer_len = 0;
+    return SL_STATUS_OK;
+}
+
+void sl_bt_external_signal(uint32_t raised) {
+    signals |= raised;
+}
+
+sl_status_t sl_bt_advertiser_create_set(uint8_t *handle) {
+    if (advertiser_count == STUBS_MAX_ADVERTISERS) {
+        return SL_STATUS_FULL;
+    }
+    advertisers[advertiser_count].created = true;
+    *handle = advertiser_count++;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_set_timing(uint8_t handle, uint32_t interval_min, uint32_t interval_max,
+                                        uint16_t duration, uint8_t maxevents) {
+    (void)duration;
+    (void)maxevents;
+    if (handle >= advertiser_count || interval_min > interval_max) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    advertisers[handle].interval_min = interval_min;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_stop(uint8_t handle) {
+    if (handle >= advertiser_count) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    advertisers[handle].started = false;
+    return SL_STATUS_OK;
+}
+
+static sl_status_t set_data(uint8_t handle, size_t max_len, size_t data_len, const uint8_t *data) {
+    if (handle >= advertiser_count || data_len > max_len) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(advertisers[handle].data, data, data_len);
+    advertisers[handle].len = data_len;
+    advertisers[handle].updates++;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_set_data(uint8_t handle, uint8_t type, size_t data_len, const uint8_t *data) {
+    (void)type;
+    return set_data(handle, 31, data_len, data);
+}
+
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t handle, uint8_t discover) {
+    // the flags only, as the stack does without a name in the GATT database
+    static const uint8_t FLAGS[] = { 0x02, 0x01, 0x06 };
+
+    (void)discover;
+    if (handle >= advertiser_count) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(advertisers[handle].data, FLAGS, sizeof(FLAGS));
+    advertisers[handle].len = sizeof(FLAGS);
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t handle, uint8_t connect) {
+    (void)connect;
+    if (handle >= advertiser_count) {
+        return SL_STATUS_INVALID_PARAMETER;
+    }
+    if (advertiser_failing) {
+        return SL_STATUS_NO_MORE_RESOURCE;
+    }
+    advertisers[handle].started = true;
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_extended_advertiser_set_data(uint8_t handle, size_t data_len, const uint8_t *data) {
+    // the data of a single command, longer data goes through the system data buffer
+    return set_data(handle, 191, data_len, data);
+}
+
+sl_status_t sl_bt_extended_advertiser_set_long_data(uint8_t handle) {
+    sl_status_t sc = set_data(handle, sizeof(data_buffer), data_buffer_len, data_buffer);
+
+    data_buffer_len = 0;
+    return sc;
+}
+
+sl_status_t sl_bt_extended_advertiser_start(uint8_t handle, uint8_t connect, uint32_t flags) {
+    (void)flags;
+    return sl_bt_legacy_advertiser_start(handle, connect);
+}
+
+static sl_status_t respond(uint8_t connection, uint16_t characteristic, uint8_t att_errorcode,
+                           size_t value_len, const uint8_t *value) {
+    if (response_count == STUBS_MAX_RESPONSES) {
+        return SL_STATUS_FULL;
+    }
+    stubs_response_t *response = &responses[response_count++];
+    response->connection = connection;
+    response->characteristic = characteristic;
+    response->att_errorcode = att_errorcode;
+    response->len = value_len < sizeof(response->value) ? value_len : sizeof(response->value);
+    if (value_len) {
+        memcpy(response->value, value, response->len);
+    }
+    return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_send_user_read_response(uint8_t connection, uint16_t characteristic,
+                                                      uint8_t att_errorcode, size_t value_len,
+                                                      const uint8_t *value, uint16_t *sent_len) {
+    if (sent_len) {
+        *sent_len = (uint16_t)value_len;
+    }
+    return respond(connection, characteristic, att_errorcode, value_len, value);
+}
+
+sl_status_t sl_bt_gatt_server_send_user_write_response(uint8_t connection, uint16_t characteristic,
+                                                       uint8_t att_errorcode) {
+    return respond(connection, characteristic, att_errorcode, 0, 0);
+}
+
+sl_status_t sl_bt_gatt_server_notify_all(uint16_t characteristic, size_t value_len, const uint8_t *value) {
+    (void)characteristic;
+    (void)value_len;
+    (void)value;
+    notifications++;
+    return SL_STATUS_OK;
+}
+
+// nvm3
+
+void stubs_nvm3_fail_writes(bool fail) {
+    nvm3_failing = fail;
+}
+
+uint32_t stubs_nvm3_writes(void) {
+    return nvm3_writes;
+}
+
+static nvm3_object_t *find(nvm3_ObjectKey_t key) {
+    for (int i = 0; i < NVM3_MAX_OBJECTS; i++) {
+        if (objects[i].used && objects[i].key == key) {
+            return &objects[i];
+        }
+    }
+    return 0;
+}
+
+static Ecode_t store(nvm3_ObjectKey_t key, bool counter, const void *value, size_t len) {
+    nvm3_object_t *object = find(key);
+
+    for (int i = 0; !object && i < NVM3_MAX_OBJECTS; i++) {
+        if (!objects[i].used) {
+            object = &objects[i];
+        }
+    }
+    if (!object || len > NVM3_MAX_LEN || nvm3_failing) {
+        return ECODE_NVM3_ERR_WRITE_FAILED;
+    }
+    nvm3_writes++;
+    object->used = true;
+    object->counter = counter;
+    object->key = key;
+    object->len = len;
+    memcpy(object->data, value, len);
+    return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len) {
+    nvm3_object_t *object = find(key);
+
+    (void)h;
+    if (!object || object->counter || object->len < len) {
+        return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+    }
+    memcpy(value, object->data, len);
+    return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len) {
+    (void)h;
+    return store(key, false, value, len);
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key) {
+    nvm3_object_t *object = find(key);
+
+    (void)h;
+    if (!object) {
+        return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+    }
+    object->used = false;
+    return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_readCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *value) {
+    nvm3_object_t *object = find(key);
+
+    (void)h;
+    if (!object || !object->counter) {
+        return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+    }
+    memcpy(value, object->data, sizeof(*value));
+    return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t value) {
+    (void)h;
+    return store(key, true, &value, sizeof(value));
+}
@@ -0,0 +1,63 @@
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "app_timer.h"
+#include "sl_bt_api.h"
+#include "sl_simple_button_instances.h"
+
+// host stand-ins of the Bluetooth stack, timers, buttons and NVM3 the application runs on; the
+// time is the time of the HX711 simulation
+
+#define STUBS_MAX_ADVERTISERS  4
+#define STUBS_MAX_RESPONSES    16
+
+typedef struct {
+    bool created;
+    bool started;
+    uint32_t interval_min; // 0.625 ms units
+    uint8_t data[256];
+    size_t len;
+    uint32_t updates; // data set by the application since the reset
+} stubs_advertiser_t;
+
+typedef struct {
+    uint8_t connection;
+    uint16_t characteristic;
+    uint8_t att_errorcode;
+    uint8_t value[64];
+    size_t len;
+} stubs_response_t;
+
+// forgets the advertising sets, timers, signals, responses and NVM3 objects
+void stubs_reset(void);
+
+stubs_advertiser_t *stubs_advertiser(uint8_t handle);
+
+// makes the advertising sets fail to start, as with the stack out of resources
+void stubs_advertiser_fail_start(bool fail);
+
+// the external signals raised since the last call
+uint32_t stubs_take_signals(void);
+
+// the first expired timer, rearmed if periodic and stopped otherwise; 0 if none
+app_timer_t *stubs_timer_due(void);
+
+// the user read responses sent since the last call
+size_t stubs_take_responses(stubs_response_t *responses, size_t max);
+
+// notifications sent since the reset
+uint32_t stubs_notifications(void);
+
+// makes the NVM3 writes fail, as on a worn out flash or with the supply too low
+void stubs_nvm3_fail_writes(bool fail);
+
+// NVM3 writes done since the reset
+uint32_t stubs_nvm3_writes(void);
+
+// the button reads as pressed during its change callback
+void stubs_press(const sl_button_t *button);
+
+#endif // STUBS_H
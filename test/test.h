@@ -0,0 +1,36 @@
+#ifndef TEST_h
+#define TEST_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Minimal checks of the host tests: a failed check is reported with its location and the test goes on,
+// the exit status of test_result() tells CTest whether any check failed.
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+    do {if (!(cond)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); test_failures++;}} while(0)
+
+// compares two integers, printing both values when they differ
+#define CHECK_EQ(a, b) \
+    do {long long a_ = (long long)(a); long long b_ = (long long)(b); \
+        if (a_ != b_) {printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+                       test_failures++;}} while(0)
+
+// checks that |a - b| <= tolerance
+#define CHECK_NEAR(a, b, tolerance) \
+    do {double a_ = (double)(a); double b_ = (double)(b); \
+        if (a_ - b_ > (tolerance) || b_ - a_ > (tolerance)) { \
+            printf("%s:%d: check failed: %s ~ %s (%g, %g)\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+            test_failures++;}} while(0)
+
+static inline int test_result(void) {
+    if (test_failures) {
+        printf("%d check(s) failed\n", test_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif /* TEST_h */
@@ -0,0 +1,120 @@
+#include <math.h>
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// adaptive averaging: a still load stops at the minimum number of readings, a noisy or a moving load takes
+// the maximum; the running mean and standard deviation (Welford) against a double precision reference
+
+#define SCALE           100     // counts per gram: 10 mg per count
+#define RESOLUTION_MG   1000    // +/- 50 counts
+#define MIN_TIMES       2
+#define MAX_TIMES       16
+#define HISTORY         64
+
+// the conversions of the reference input, the last one at history[(count - 1) % HISTORY]
+static long history[HISTORY];
+static uint32_t count;
+static uint32_t random_state = 1;
+
+// far from zero with a large spread, so that the accumulation is not exact in single precision
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    (void)time_us;
+    (void)gain;
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    long value = 7000000 + (long)(random_state % 6001) - 3000;
+    history[count++ % HISTORY] = value;
+    return value;
+}
+
+static hx711_measurement_t measure(const hx711_sim_load_t *load) {
+    hx711_measurement_t result;
+
+    hx711_sim_set_load(0, load);
+    CHECK(hx711_get_adaptive_mg(HX711_get_default(), RESOLUTION_MG, MIN_TIMES, MAX_TIMES, &result));
+    return result;
+}
+
+int main(void) {
+    hx711_measurement_t result;
+
+    hx711_sim_reset(10);
+    HX711_init(128);
+    HX711_set_scale(SCALE);
+    hx711_t *dev = HX711_get_default();
+
+    // a still load: the minimum is enough
+    hx711_sim_load_t still = { .waveform = HX711_SIM_CONSTANT, .base = 50000, .noise = 1, .creep_tau_s = 1 };
+    result = measure(&still);
+    CHECK_EQ(result.count, MIN_TIMES);
+    CHECK_NEAR(result.mg, 500000, 50);
+
+    // noise of 500 counts would need 100 readings for +/- 50 counts: the maximum is taken
+    hx711_sim_load_t noisy = still;
+    noisy.noise = 500;
+    result = measure(&noisy);
+    CHECK_EQ(result.count, MAX_TIMES);
+    CHECK_NEAR(result.mg, 500000, 3 * 5000 / 4);
+    CHECK_NEAR(result.stddev_mg, 5000, 2000);
+
+    // a load moving by 1000 counts per conversion
+    hx711_sim_load_t ramp = { .waveform = HX711_SIM_RAMP, .base = 50000, .amplitude = 100000,
+                              .start_us = hx711_sim_time_us(), .period_us = 10000000, .creep_tau_s = 1 };
+    result = measure(&ramp);
+    CHECK_EQ(result.count, MAX_TIMES);
+    CHECK(result.stddev_mg > 20000);
+
+    // back to still, the count drops again
+    result = measure(&still);
+    CHECK_EQ(result.count, MIN_TIMES);
+
+    // the mean and the standard deviation of the readings taken against a two-pass reference in double
+    // without the noise of the load model, which applies to the input too
+    hx711_sim_load_t clean = { .waveform = HX711_SIM_CONSTANT, .creep_tau_s = 1 };
+    hx711_sim_set_load(0, &clean);
+    hx711_sim_set_input(input);
+    for (uint8_t times = MIN_TIMES; times <= 40; times += 19) {
+        CHECK(hx711_get_adaptive_mg(dev, 1, times, times, &result));
+        CHECK_EQ(result.count, times);
+
+        double mean = 0;
+        double m2 = 0;
+        for (uint32_t i = count - times; i < count; i++) {
+            mean += history[i % HISTORY];
+        }
+        mean /= times;
+        for (uint32_t i = count - times; i < count; i++) {
+            m2 += (history[i % HISTORY] - mean) * (history[i % HISTORY] - mean);
+        }
+        double stddev_mg = sqrt(m2 / (times - 1)) * 1000 / SCALE;
+        // the mean is rounded to a count before the conversion
+        CHECK_NEAR(result.mg, mean * 1000 / SCALE, 1000 / SCALE);
+        CHECK_NEAR(result.stddev_mg, stddev_mg, 1);
+        printf("%u readings: mean %ld mg (%.1f), std dev %ld mg (%.1f)\n", times, (long)result.mg,
+               mean * 1000 / SCALE, (long)result.stddev_mg, stddev_mg);
+    }
+
+    // a chip which does not answer: the wait ends at the deadline of the reading with an error, counted as
+    // a timeout
+    hx711_health_t health;
+    hx711_get_health(dev, &health);
+    uint32_t timeouts = health.timeouts;
+    hx711_sim_disconnect(0);
+    uint64_t start = hx711_sim_time_us();
+    CHECK(!hx711_get_adaptive_mg(dev, RESOLUTION_MG, MIN_TIMES, MAX_TIMES, &result));
+    CHECK_EQ(hx711_sim_time_us(), start + HX711_READ_TIMEOUT_MS * 1000);
+    CHECK_EQ(result.status, HX711_FAULT_TIMEOUT);
+    hx711_get_health(dev, &health);
+    CHECK_EQ(health.timeouts, timeouts + 1);
+    CHECK_EQ(health.status, HX711_FAULT_TIMEOUT);
+    CHECK(!hx711_is_busy(dev));
+    // and measures again once it is back
+    hx711_sim_connect(0, 0, 0);
+    CHECK(hx711_get_adaptive_mg(dev, RESOLUTION_MG, MIN_TIMES, MAX_TIMES, &result));
+    CHECK_EQ(result.status, 0);
+
+    return test_result();
+}
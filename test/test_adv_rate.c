@@ -0,0 +1,166 @@
+#include <string.h>
+#include "adv_rate.h"
+#include "adv_rate_sim.h"
+#include "test.h"
+
+// the advertising rate controller: burst at the fast interval after a change, doubling back-off up to the
+// idle interval; then the simulation of a day of advertising with each profile, whose figures are the
+// table of the README
+
+#define DAY_MS          86400000
+#define CHANGES         48
+#define MEASUREMENT_MS  10000   // MEASUREMENT_INTERVAL_ADV_MS of the application
+
+// a fixed 1 s interval, the reference: no burst, no back-off
+static const adv_rate_profile_t fixed = {
+    .fast_interval_ms = 1000,
+    .burst_ms = 0,
+    .idle_interval_ms = 1000,
+    .events_per_step = 1,
+};
+
+// xorshift, so the timeline is the same on every host
+static uint32_t random_state = 1;
+
+static uint32_t random_below(uint32_t n) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % n;
+}
+
+// the back-off after a change: each interval with its duration, until the idle interval
+static void check_back_off(const adv_rate_profile_t *profile) {
+    adv_rate_t rate;
+    uint32_t elapsed_ms = 0;
+    uint32_t interval = profile->fast_interval_ms;
+
+    adv_rate_init(&rate, profile);
+    CHECK_EQ(adv_rate_get_interval(&rate), profile->idle_interval_ms);
+    CHECK_EQ(adv_rate_step_ms(&rate), ADV_RATE_NO_STEP);
+
+    CHECK_EQ(adv_rate_changed(&rate), profile->fast_interval_ms);
+    CHECK_EQ(adv_rate_step_ms(&rate), profile->burst_ms);
+    elapsed_ms += profile->burst_ms;
+    while (adv_rate_step_ms(&rate) != ADV_RATE_NO_STEP) {
+        interval = 2 * interval < profile->idle_interval_ms ? 2 * interval : profile->idle_interval_ms;
+        CHECK_EQ(adv_rate_step(&rate), interval);
+        CHECK_EQ(adv_rate_get_interval(&rate), interval);
+        if (interval < profile->idle_interval_ms) {
+            CHECK_EQ(adv_rate_step_ms(&rate), interval * profile->events_per_step);
+            elapsed_ms += interval * profile->events_per_step;
+        }
+        CHECK(elapsed_ms < 60000);
+    }
+    CHECK_EQ(adv_rate_get_interval(&rate), profile->idle_interval_ms);
+    // a step at the idle interval stays there
+    CHECK_EQ(adv_rate_step(&rate), profile->idle_interval_ms);
+
+    // a change during the back-off starts a new burst
+    adv_rate_changed(&rate);
+    adv_rate_step(&rate);
+    CHECK_EQ(adv_rate_changed(&rate), profile->fast_interval_ms);
+    CHECK_EQ(adv_rate_step_ms(&rate), profile->burst_ms);
+}
+
+static void simulate(const adv_rate_profile_t *profile, const uint32_t *changes, uint32_t measurement_ms,
+                     adv_rate_sim_result_t *result) {
+    adv_rate_sim_config_t config = {
+        .profile = profile,
+        .duration_ms = DAY_MS,
+        .changes_ms = changes,
+        .change_count = CHANGES,
+        .measurement_ms = measurement_ms,
+        .event_us = ADV_RATE_SIM_EVENT_US(31),
+        .receive_percent = 80,
+        .seed = 1,
+    };
+    adv_rate_simulate(&config, result);
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        const adv_rate_profile_t *profile;
+    } PROFILES[] = {
+        { "fixed 1 s", &fixed },
+        { "responsive", &adv_rate_profile_responsive },
+        { "balanced", &adv_rate_profile_balanced },
+        { "low_power", &adv_rate_profile_low_power },
+    };
+    static uint32_t changes[CHANGES];
+    adv_rate_sim_result_t advertised[4];
+    adv_rate_sim_result_t measured[4];
+    adv_rate_t rate;
+
+    check_back_off(&adv_rate_profile_responsive);
+    check_back_off(&adv_rate_profile_balanced);
+    check_back_off(&adv_rate_profile_low_power);
+
+    // balanced: 150, 300, 600, 1200, 2400, then 4000 ms
+    adv_rate_init(&rate, &adv_rate_profile_balanced);
+    adv_rate_changed(&rate);
+    static const uint16_t BALANCED[] = { 300, 600, 1200, 2400, 4000 };
+    for (uint8_t i = 0; i < 5; i++) {
+        CHECK_EQ(adv_rate_step(&rate), BALANCED[i]);
+    }
+
+    // the fixed profile has no burst: the interval stays at 1 s
+    adv_rate_init(&rate, &fixed);
+    CHECK_EQ(adv_rate_changed(&rate), 1000);
+    CHECK_EQ(adv_rate_step_ms(&rate), ADV_RATE_NO_STEP);
+
+    // switching the profile in the middle of a back-off: the controller starts over at the idle interval
+    // of the new one, and the next burst uses its fast interval
+    adv_rate_init(&rate, &adv_rate_profile_responsive);
+    adv_rate_changed(&rate);
+    adv_rate_step(&rate);
+    adv_rate_init(&rate, &adv_rate_profile_low_power);
+    CHECK_EQ(adv_rate_get_interval(&rate), 8000);
+    CHECK_EQ(adv_rate_step_ms(&rate), ADV_RATE_NO_STEP);
+    CHECK_EQ(adv_rate_changed(&rate), 250);
+    CHECK_EQ(adv_rate_step_ms(&rate), 1000);
+
+    // a day with a change at a random time of each half hour
+    for (uint16_t i = 0; i < CHANGES; i++) {
+        changes[i] = i * (DAY_MS / CHANGES) + random_below(DAY_MS / CHANGES);
+    }
+
+    printf("profile      events  advertised: mean    max  end to end: mean     max  duty cycle\n");
+    for (uint8_t i = 0; i < 4; i++) {
+        simulate(PROFILES[i].profile, changes, 0, &advertised[i]);
+        simulate(PROFILES[i].profile, changes, MEASUREMENT_MS, &measured[i]);
+        printf("%-12s %6lu %14.0f ms %4lu ms %14.0f ms %5lu ms %9.3f %%\n", PROFILES[i].name,
+               (unsigned long)advertised[i].events, advertised[i].mean_latency_ms,
+               (unsigned long)advertised[i].max_latency_ms, measured[i].mean_latency_ms,
+               (unsigned long)measured[i].max_latency_ms, advertised[i].duty_cycle * 100);
+
+        // every change gets through
+        CHECK_EQ(advertised[i].received, CHANGES);
+        CHECK_EQ(measured[i].received, CHANGES);
+        // the radio time is that of the events
+        CHECK_NEAR(advertised[i].duty_cycle,
+                   advertised[i].events * (double)ADV_RATE_SIM_EVENT_US(31) / (DAY_MS * 1000.0), 1e-6);
+        // the next measurement detects a change in half an interval on average, at most one interval
+        CHECK(measured[i].mean_latency_ms > advertised[i].mean_latency_ms + MEASUREMENT_MS / 4);
+        CHECK(measured[i].mean_latency_ms < advertised[i].mean_latency_ms + MEASUREMENT_MS * 3 / 4);
+        CHECK(measured[i].max_latency_ms < MEASUREMENT_MS + advertised[i].max_latency_ms + 1000);
+    }
+
+    // the fixed interval advertises about once a second; the idle interval of the profiles divides it
+    CHECK_NEAR(advertised[0].mean_interval_ms, 1005, 10);
+    for (uint8_t i = 1; i < 4; i++) {
+        CHECK(advertised[i].events < advertised[0].events * 1000 / PROFILES[i].profile->idle_interval_ms * 11 / 10);
+        CHECK(advertised[i].events < advertised[i - 1].events);
+        // the burst carries the change faster than the fixed interval
+        CHECK(advertised[i].mean_latency_ms < advertised[0].mean_latency_ms / 4);
+        CHECK(advertised[i].max_latency_ms < advertised[0].max_latency_ms);
+    }
+
+    // the same seed gives the same figures
+    adv_rate_sim_result_t again;
+    simulate(&adv_rate_profile_balanced, changes, 0, &again);
+    CHECK(!memcmp(&again, &advertised[2], sizeof(again)));
+
+    return test_result();
+}
@@ -0,0 +1,273 @@
+#include <string.h>
+#include <time.h>
+#include "app.h"
+#include "calibration.h"
+#include "gatt_db.h"
+#include "hx711_sim.h"
+#include "sl_bluetooth.h"
+#include "stubs.h"
+#include "test.h"
+
+// the application on the simulated HX711: no Bluetooth event handler, timer callback or main loop
+// iteration waits for a conversion, the measurements complete from the DOUT interrupt and the GATT
+// reads of the mass are answered once they are done
+
+// simulated time allowed in a handler: none, a wait for the HX711 takes at least one conversion
+#define HANDLER_MAX_US  0
+#define SCALE           375 // counts per gram, DEFAULT_SCALE of the application
+#define EMPTY           80000
+#define ATT_ERR_INSUFFICIENT_RESOURCES 0x11 // Bluetooth Core, ATT error codes
+#define ATT_ERR_PROCEDURE_FAILED 0x80       // application error code of app.c
+#define TARE_DELAY_MS   2000
+
+#define MEASUREMENT_INTERVAL_ADV_MS 10000 // of the application
+#define AVERAGE_MIN_COUNT 2
+#define AVERAGE_MAX_COUNT 5
+#define SETTLE_US       HX711_SIM_SETTLE_US_10SPS
+#define PERIOD_US       100000
+
+static long load; // counts above the empty scale
+
+// a few counts of noise, like a real sensor: a constant input is taken for a stuck one
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    (void)gain;
+    return EMPTY + load + (long)(time_us / PERIOD_US * 2654435761u % 5) - 2;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t start_us;
+static uint64_t start_ns;
+static uint64_t max_us;
+static uint64_t max_ns;
+static const char *slowest = "none";
+static uint32_t handlers;
+
+static void handler_begin(void) {
+    start_us = hx711_sim_time_us();
+    start_ns = now_ns();
+}
+
+static void handler_end(const char *name) {
+    uint64_t ns = now_ns() - start_ns;
+    uint64_t us = hx711_sim_time_us() - start_us;
+
+    if (us > HANDLER_MAX_US) {
+        printf("%s waited %llu us\n", name, (unsigned long long)us);
+    }
+    if (us > max_us) {
+        max_us = us;
+    }
+    if (ns > max_ns) {
+        max_ns = ns;
+        slowest = name;
+    }
+    handlers++;
+}
+
+static void event(sl_bt_msg_t *evt, uint32_t id, const char *name) {
+    evt->header = id;
+    handler_begin();
+    sl_bt_on_event(evt);
+    handler_end(name);
+}
+
+// the main loop for duration_ms: the interrupts, the expired timers, the external signals of the
+// HX711 callbacks, then the process action
+static void run(uint32_t duration_ms) {
+    sl_bt_msg_t evt;
+    app_timer_t *timer;
+    uint32_t signals;
+
+    for (uint32_t ms = 0; ms < duration_ms; ms++) {
+        hx711_sim_advance(1000);
+        while ((timer = stubs_timer_due())) {
+            handler_begin();
+            timer->callback(timer, timer->callback_data);
+            handler_end("timer");
+        }
+        if ((signals = stubs_take_signals())) {
+            evt.data.evt_system_external_signal.extsignals = signals;
+            event(&evt, sl_bt_evt_system_external_signal_id, "external signal");
+        }
+        handler_begin();
+        app_process_action();
+        handler_end("process action");
+    }
+}
+
+static void read_request(uint8_t connection, uint16_t characteristic, uint16_t offset) {
+    sl_bt_msg_t evt;
+
+    evt.data.evt_gatt_server_user_read_request.connection = connection;
+    evt.data.evt_gatt_server_user_read_request.characteristic = characteristic;
+    evt.data.evt_gatt_server_user_read_request.offset = offset;
+    event(&evt, sl_bt_evt_gatt_server_user_read_request_id, "user read request");
+}
+
+static void write_request(uint8_t connection, uint16_t characteristic, const uint8_t *value, uint8_t len) {
+    sl_bt_msg_t evt;
+
+    evt.data.evt_gatt_server_user_write_request.connection = connection;
+    evt.data.evt_gatt_server_user_write_request.characteristic = characteristic;
+    evt.data.evt_gatt_server_user_write_request.value.len = len;
+    memcpy(evt.data.evt_gatt_server_user_write_request.value.data, value, len);
+    event(&evt, sl_bt_evt_gatt_server_user_write_request_id, "user write request");
+}
+
+// the mass read over GATT, in g: the response comes with the measurement, after the handler returned
+static int32_t read_mass(void) {
+    stubs_response_t response;
+    int32_t mass = 0;
+
+    read_request(1, gattdb_mass, 0);
+    CHECK_EQ(stubs_take_responses(&response, 1), 0);
+    for (uint32_t ms = 0; ms < 2000; ms += 10) {
+        run(10);
+        if (stubs_take_responses(&response, 1)) {
+            CHECK_EQ(response.connection, 1);
+            CHECK_EQ(response.characteristic, gattdb_mass);
+            CHECK_EQ(response.att_errorcode, 0);
+            CHECK_EQ(response.len, sizeof(mass));
+            memcpy(&mass, response.value, sizeof(mass));
+            return mass;
+        }
+    }
+    CHECK(!"no response to the read");
+    return mass;
+}
+
+int main(void) {
+    sl_bt_msg_t evt;
+    stubs_response_t responses[4];
+
+    stubs_reset();
+    hx711_sim_reset(10);
+    hx711_sim_set_input(input);
+    // the boot tare waits for the HX711, before the event loop runs
+    app_init();
+
+    // the advertising does not start with the boot measurement: the device keeps running, and tries
+    // again with the next advertising measurement
+    stubs_advertiser_fail_start(true);
+    memset(&evt, 0, sizeof(evt));
+    event(&evt, sl_bt_evt_system_boot_id, "boot");
+    run(1000);
+    stubs_advertiser_t *advertiser = stubs_advertiser(0);
+    CHECK(advertiser && !advertiser->started);
+    stubs_advertiser_fail_start(false);
+    run(MEASUREMENT_INTERVAL_ADV_MS);
+    CHECK(advertiser->started && advertiser->len > 0);
+
+    // deferred reads: of the empty scale, then of 100 g
+    CHECK_EQ(read_mass(), 0);
+    load = 100 * SCALE;
+    CHECK_EQ(read_mass(), 100);
+
+    // more reads waiting than the application keeps: the last one is refused at once, the others are
+    // answered with the measurement
+    for (uint8_t connection = 1; connection <= 5; connection++) {
+        read_request(connection, gattdb_mass, 0);
+    }
+    CHECK_EQ(stubs_take_responses(responses, 4), 1);
+    CHECK_EQ(responses[0].connection, 5);
+    CHECK_EQ(responses[0].att_errorcode, ATT_ERR_INSUFFICIENT_RESOURCES);
+    run(1000);
+    CHECK_EQ(stubs_take_responses(responses, 4), 4);
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK_EQ(responses[i].connection, i + 1);
+        CHECK_EQ(responses[i].att_errorcode, 0);
+    }
+
+    // a connection: periodic indications of the mass
+    evt.data.evt_connection_opened.connection = 1;
+    event(&evt, sl_bt_evt_connection_opened_id, "connection opened");
+    evt.data.evt_gatt_server_characteristic_status.connection = 1;
+    evt.data.evt_gatt_server_characteristic_status.characteristic = gattdb_mass;
+    evt.data.evt_gatt_server_characteristic_status.status_flags = sl_bt_gatt_server_client_config;
+    evt.data.evt_gatt_server_characteristic_status.client_config_flags = sl_bt_gatt_indication;
+    event(&evt, sl_bt_evt_gatt_server_characteristic_status_id, "characteristic status");
+    run(3500);
+    CHECK(stubs_notifications() >= 3);
+
+    // the health and the profile are answered from the handler
+    read_request(1, gattdb_health, 0);
+    read_request(1, gattdb_profile, 0);
+    CHECK_EQ(stubs_take_responses(responses, 4), 2);
+    CHECK_EQ(responses[0].att_errorcode, 0);
+    CHECK_EQ(responses[1].att_errorcode, 0);
+
+    // a calibration point of the 100 g, captured with the next measurement
+    static const uint8_t START[] = { CALIBRATION_OP_START };
+    // 100000 mg, little endian
+    static const uint8_t CAPTURE[] = { CALIBRATION_OP_CAPTURE, 0xA0, 0x86, 0x01, 0x00 };
+    write_request(1, gattdb_calibration, START, sizeof(START));
+    write_request(1, gattdb_calibration, CAPTURE, sizeof(CAPTURE));
+    CHECK_EQ(stubs_take_responses(responses, 4), 2);
+    CHECK_EQ(responses[0].att_errorcode, 0);
+    CHECK_EQ(responses[1].att_errorcode, 0);
+    run(1000);
+
+    // the advertising resumes with the BTHome packet at once, then the measurement started on the
+    // disconnection updates it with the mass put on the scale meanwhile
+    uint8_t advertised[31];
+    size_t advertised_len = advertiser->len;
+    memcpy(advertised, advertiser->data, advertised_len);
+    evt.data.evt_connection_closed.connection = 1;
+    event(&evt, sl_bt_evt_connection_closed_id, "connection closed");
+    run(1);
+    CHECK(advertiser->started);
+    CHECK_EQ(advertiser->len, advertised_len);
+    CHECK(!memcmp(advertiser->data, advertised, advertised_len));
+    run(1000);
+    CHECK(advertiser->started);
+    CHECK(memcmp(advertiser->data, advertised, advertised_len));
+
+    // the tare button: the tare starts after a delay, from the timer
+    stubs_press(&sl_button_btn1);
+    run(3000);
+    CHECK_EQ(read_mass(), 0);
+
+    // the HX711 disconnected: the read is answered with an error once the measurement timed out, the tare
+    // requested meanwhile runs next and fails too, leaving the offset; back connected, the reads succeed
+    hx711_sim_disconnect(0);
+    read_request(1, gattdb_mass, 0);
+    read_request(2, gattdb_mass, 0);
+    stubs_press(&sl_button_btn1);
+    run(HX711_READ_TIMEOUT_MS - 1);
+    CHECK_EQ(stubs_take_responses(responses, 4), 0);
+    run(2);
+    CHECK_EQ(stubs_take_responses(responses, 4), 2);
+    for (uint8_t i = 0; i < 2; i++) {
+        CHECK_EQ(responses[i].connection, i + 1);
+        CHECK_EQ(responses[i].att_errorcode, ATT_ERR_PROCEDURE_FAILED);
+        CHECK_EQ(responses[i].len, 0);
+    }
+    run(TARE_DELAY_MS + HX711_READ_TIMEOUT_MS);
+    hx711_sim_connect(0, 0, 0);
+    CHECK_EQ(read_mass(), 0);
+
+    // the log button, and a minute of advertising
+    stubs_press(&sl_button_btn0);
+    run(MEASUREMENT_INTERVAL_ADV_MS);
+    hx711_sim_energy_t energy;
+    hx711_sim_energy_reset();
+    run(60000);
+    hx711_sim_energy(&energy);
+    // the HX711 is powered for one settling time before each measurement, and the measurement itself: a
+    // conversion completes on the deadline
+    uint64_t powered_us = 60000000 - energy.hx711_down_us;
+    CHECK(powered_us >= 6 * (SETTLE_US + (AVERAGE_MIN_COUNT - 1) * PERIOD_US));
+    CHECK(powered_us <= 6 * (SETTLE_US + (AVERAGE_MAX_COUNT + 1) * PERIOD_US));
+
+    printf("%u handlers: max %llu us of simulated time, max %.1f us on the host (%s)\n", handlers,
+           (unsigned long long)max_us, max_ns / 1000.0, slowest);
+    CHECK(max_us <= HANDLER_MAX_US);
+
+    return test_result();
+}
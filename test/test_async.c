@@ -0,0 +1,159 @@
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// interrupt-driven asynchronous read: the conversion is clocked out from the DOUT interrupt and delivered
+// through the callback, the caller does not wait for it
+
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    // a new value every conversion, negative on channel B
+    long value = 1000 + (long)(time_us / 1000);
+    return gain == 32 ? -value : value;
+}
+
+static int calls;
+static long value;
+
+static void read_cb(long v) {
+    calls++;
+    value = v;
+}
+
+static int measured;
+static hx711_measurement_t measurement;
+
+static void measure_cb(hx711_t *dev, const hx711_measurement_t *result) {
+    (void)dev;
+    measured++;
+    measurement = *result;
+}
+
+int main(void) {
+    hx711_sim_reset(10);
+    hx711_sim_set_input(input);
+    HX711_init(128);
+
+    // the read returns at once, the value comes with the end of the conversion
+    uint64_t start = hx711_sim_time_us();
+    calls = 0;
+    CHECK(HX711_read_async(read_cb));
+    CHECK_EQ(hx711_sim_time_us(), start);
+    CHECK_EQ(calls, 0);
+    CHECK(HX711_is_busy());
+
+    // a second read is refused while the first one is armed
+    CHECK(!HX711_read_async(read_cb));
+
+    hx711_sim_advance(100000);
+    CHECK_EQ(calls, 1);
+    CHECK(!HX711_is_busy());
+    CHECK_EQ(value, input(0, 200000, 128));
+
+    // no callback after a cancel
+    calls = 0;
+    CHECK(HX711_read_async(read_cb));
+    HX711_read_cancel();
+    CHECK(!HX711_is_busy());
+    hx711_sim_advance(300000);
+    CHECK_EQ(calls, 0);
+
+    // a conversion completed before the read is armed is delivered right away
+    CHECK(HX711_read_async(read_cb));
+    CHECK_EQ(calls, 1);
+    CHECK_EQ(value, input(0, 500000, 128));
+
+    // the blocking read waits for the next conversion
+    long reading;
+    start = hx711_sim_time_us();
+    CHECK(HX711_read(&reading));
+    CHECK_EQ(reading, input(0, 600000, 128));
+    CHECK_EQ(hx711_sim_time_us(), start + 100000);
+
+    // the gain is programmed by the extra clock pulses and applies from the next conversion on
+    HX711_set_gain(32);
+    CHECK(HX711_read(&reading));
+    CHECK_EQ(reading, input(0, hx711_sim_time_us(), 32));
+    CHECK_EQ(hx711_sim_gain(0), 32);
+    HX711_set_gain(128);
+    CHECK(HX711_read(&reading));
+    CHECK_EQ(reading, input(0, hx711_sim_time_us(), 128));
+
+    // a chip which does not answer: the read times out with an error, not a reading, and so does the tare
+    hx711_t *dev = HX711_get_default();
+    hx711_health_t health;
+    HX711_power_down();
+    start = hx711_sim_time_us();
+    reading = 12345;
+    CHECK(!HX711_read(&reading));
+    CHECK_EQ(reading, 12345);
+    CHECK_EQ(hx711_sim_time_us(), start + HX711_READ_TIMEOUT_MS * 1000);
+    CHECK(!HX711_is_busy());
+    HX711_set_offset(777);
+    CHECK(!HX711_tare(5));
+    CHECK_EQ(HX711_get_offset(), 777);
+    HX711_get_health(&health);
+    CHECK_EQ(health.timeouts, 2);
+    CHECK_EQ(health.status, HX711_FAULT_TIMEOUT);
+    HX711_power_up();
+    CHECK(HX711_read(&reading));
+
+    // the asynchronous measurement and tare time out the same way, from the deadline: the callback gets
+    // the timeout status, the offset is left unchanged, and nothing stays busy
+    HX711_power_down();
+    start = hx711_sim_time_us();
+    measured = 0;
+    CHECK(HX711_measure_async(1000, 2, 4, measure_cb));
+    hx711_sim_advance(HX711_READ_TIMEOUT_MS * 1000 - 1);
+    CHECK_EQ(measured, 0);
+    hx711_sim_advance(1);
+    CHECK_EQ(measured, 1);
+    CHECK_EQ(measurement.status, HX711_FAULT_TIMEOUT);
+    CHECK_EQ(measurement.count, 0);
+    CHECK(!HX711_is_busy());
+    CHECK(!dev->measure.active);
+    CHECK(HX711_tare_async(3, measure_cb));
+    while (measured < 2) {
+        hx711_sim_wait();
+    }
+    CHECK_EQ(hx711_sim_time_us(), start + 2 * HX711_READ_TIMEOUT_MS * 1000);
+    CHECK_EQ(measurement.status, HX711_FAULT_TIMEOUT);
+    CHECK_EQ(HX711_get_offset(), 777);
+    HX711_get_health(&health);
+    CHECK_EQ(health.timeouts, 4);
+    CHECK_EQ(health.status, HX711_FAULT_TIMEOUT);
+    // each reading has its own deadline: a measurement longer than the timeout completes
+    HX711_power_up();
+    CHECK(HX711_measure_async(1000, 15, 15, measure_cb));
+    while (measured < 3) {
+        hx711_sim_wait();
+    }
+    CHECK_EQ(measurement.status, 0);
+    CHECK_EQ(measurement.count, 15);
+    // and a completed one leaves no deadline behind
+    hx711_sim_advance(2 * HX711_READ_TIMEOUT_MS * 1000);
+    CHECK_EQ(measured, 3);
+    // nor does a cancelled one
+    CHECK(HX711_measure_async(1000, 2, 4, measure_cb));
+    HX711_read_cancel();
+    hx711_sim_advance(2 * HX711_READ_TIMEOUT_MS * 1000);
+    CHECK_EQ(measured, 3);
+
+    // a rate change settles the output like a power up: the conversions completing meanwhile are discarded
+    CHECK(hx711_set_rate(dev, 80));
+    CHECK(HX711_read(&reading));
+    uint32_t discarded = dev->power.discarded;
+    CHECK(hx711_set_rate(dev, 10));
+    start = hx711_sim_time_us();
+    CHECK(HX711_read(&reading));
+    CHECK(hx711_sim_time_us() >= start + HX711_SETTLE_MS_10SPS * 1000);
+    CHECK(dev->power.discarded > discarded);
+    CHECK_EQ(reading, input(0, hx711_sim_time_us(), 128));
+    // the same rate again does not
+    discarded = dev->power.discarded;
+    CHECK(hx711_set_rate(dev, 10));
+    CHECK(HX711_read(&reading));
+    CHECK_EQ(dev->power.discarded, discarded);
+
+    return test_result();
+}
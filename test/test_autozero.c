@@ -0,0 +1,91 @@
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// auto-zero tracking on the simulated chip: the offset only moves once the reading stayed in the window
+// for the hold time, by 1 / 2^shift of the error per reading; a slow zero drift of the empty scale is
+// tracked out, and the offset holds while a load is on the scale
+
+#define SCALE       100     // counts per gram: 10 mg per count
+#define WINDOW_MG   1000    // +/- 100 counts
+#define HOLD_MS     3000
+#define SHIFT       2
+#define PERIOD_MS   100     // 10 SPS
+#define DRIFT       2       // counts per second
+
+static long raw;
+
+// blocking reads for ms
+static void read_for(uint32_t ms) {
+    for (uint32_t i = 0; i < ms / PERIOD_MS; i++) {
+        CHECK(HX711_read(&raw));
+    }
+}
+
+static void set_load(long base, float drift) {
+    hx711_sim_load_t load = { .waveform = HX711_SIM_CONSTANT, .base = base, .drift = drift, .creep_tau_s = 1 };
+    hx711_sim_set_load(0, &load);
+}
+
+int main(void) {
+    hx711_t *dev = HX711_get_default();
+
+    hx711_sim_reset(10);
+    HX711_init(128);
+    HX711_set_scale(SCALE);
+    HX711_set_offset(0);
+    HX711_set_autozero(WINDOW_MG, HOLD_MS, SHIFT);
+
+    // a zero error of 80 counts: nothing moves during the hold time, then each reading takes a quarter
+    // of the remaining error, at least a count, until the offset reaches it
+    set_load(80, 0);
+    read_for(HOLD_MS);
+    CHECK_EQ(HX711_get_offset(), 0);
+    long expected = 0;
+    for (uint8_t i = 0; i < 60; i++) {
+        long step = (80 - expected) >> SHIFT;
+        expected += step ? step : (80 > expected) - (80 < expected);
+        CHECK(HX711_read(&raw));
+        CHECK_EQ(HX711_get_offset(), expected);
+    }
+    CHECK_EQ(HX711_get_offset(), 80);
+
+    // a slow drift of the empty scale, 600 counts over 5 minutes, is tracked out: the reading stays at zero
+    set_load(80, DRIFT);
+    read_for(300000);
+    long drift = (long)(DRIFT * hx711_sim_time_us() / 1000000);
+    CHECK_NEAR(HX711_get_offset(), 80 + drift, 10);
+    CHECK_NEAR(hx711_to_mg(dev, raw), 0, 100);
+
+    // 500 g on the scale: the offset holds, the drift goes into the reading meanwhile
+    long offset = HX711_get_offset();
+    set_load(80 + 50000, DRIFT);
+    read_for(20000);
+    CHECK_EQ(HX711_get_offset(), offset);
+    CHECK(hx711_to_mg(dev, raw) >= 500000 + 10 * 30);
+
+    // the scale emptied: the drift of the loaded time is taken out again after the hold time
+    set_load(80, DRIFT);
+    read_for(HOLD_MS);
+    CHECK_EQ(HX711_get_offset(), offset);
+    read_for(10000);
+    CHECK_NEAR(hx711_to_mg(dev, raw), 0, 100);
+
+    // a reading out of the window restarts the hold time
+    HX711_set_autozero(WINDOW_MG, HOLD_MS, SHIFT);
+    offset = HX711_get_offset();
+    read_for(HOLD_MS - 1000);
+    set_load(80 + 50000, DRIFT);
+    read_for(PERIOD_MS);
+    set_load(80, DRIFT);
+    read_for(HOLD_MS - 1000);
+    CHECK_EQ(HX711_get_offset(), offset);
+
+    // disabled: the offset stays where it is
+    HX711_set_autozero(0, HOLD_MS, SHIFT);
+    offset = HX711_get_offset();
+    read_for(30000);
+    CHECK_EQ(HX711_get_offset(), offset);
+
+    return test_result();
+}
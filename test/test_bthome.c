@@ -0,0 +1,511 @@
+#include <string.h>
+#include <time.h>
+#include "sl_bt_api.h"
+#include "bthome_v2.h"
+#include "mbedtls/ccm.h"
+#include "nvm3_default.h"
+#include "stubs.h"
+#include "test.h"
+
+// BTHome encoder: the packets of the driver against the encoder it replaced, byte for byte, plain and
+// encrypted, for random measurements and events in ascending and random id order and names of every
+// length, into caller buffers of the exact length; and the host time per update of both
+
+#define BUILDS         2000
+#define BENCH_COUNT    200000
+#define KEY            "231d39c1d7cc1ab1aee224cd096db932"
+#define COUNTER_START  0x1000 // counter value stored in NVM3 before the init
+
+// the reference: the encoder before the cached template, the objects appended as they come, parsed back
+// into blocks and bubble sorted at each build, the packet assembled in stack buffers and the nonce
+// rebuilt from the identity address
+static struct {
+    uint8_t data[MEASUREMENT_MAX_LEN];
+    uint8_t len;
+    uint8_t last_id;
+    bool sort;
+    const char *name;
+    bool encrypt;
+    bool trigger;
+    uint32_t counter;
+    mbedtls_ccm_context ccm;
+} old;
+
+typedef struct {
+    uint8_t id;
+    uint8_t data[4];
+    uint8_t len;
+} block_t;
+
+// object sizes and factors of the ids used here, from the BTHome format
+static uint8_t old_size(uint8_t id) {
+    switch (id) {
+        case ID_PACKET:
+        case ID_BATTERY:
+        case ID_COUNT:
+        case ID_MOISTURE:
+        case STATE_DOOR:
+        case EVENT_BUTTON:
+            return 1;
+        case ID_ILLUMINANCE:
+        case ID_POWER:
+        case ID_PRESSURE:
+        case ID_ENERGY:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+static uint16_t old_factor(uint8_t id) {
+    switch (id) {
+        case ID_HUMIDITY_PRECISE:
+        case ID_ILLUMINANCE:
+        case ID_MASS:
+        case ID_POWER:
+        case ID_PRESSURE:
+        case ID_TEMPERATURE_PRECISE:
+            return 100;
+        case ID_ENERGY:
+        case ID_VOLTAGE:
+            return 1000;
+        default:
+            return 1;
+    }
+}
+
+static void old_init(const char *name, bool encrypt, bool trigger) {
+    uint8_t key[BIND_KEY_LEN];
+
+    for (uint8_t i = 0; i < BIND_KEY_LEN; i++) {
+        char octet[3] = { KEY[2 * i], KEY[2 * i + 1], 0 };
+        key[i] = (uint8_t)strtol(octet, NULL, 16);
+    }
+    mbedtls_ccm_init(&old.ccm);
+    mbedtls_ccm_setkey(&old.ccm, MBEDTLS_CIPHER_ID_AES, key, BIND_KEY_LEN * 8);
+    old.name = name;
+    old.encrypt = encrypt;
+    old.trigger = trigger;
+    old.counter = COUNTER_START;
+    old.len = 0;
+}
+
+static void old_reset(void) {
+    old.len = 0;
+    old.last_id = 0;
+    old.sort = false;
+}
+
+static uint8_t old_limit(void) {
+    return MEASUREMENT_MAX_LEN - (old.encrypt ? 8 : 0);
+}
+
+static void old_append(uint8_t id) {
+    if (id < old.last_id) {
+        old.sort = true;
+    }
+    old.last_id = id;
+}
+
+static void old_add(uint8_t id, uint64_t value) {
+    uint8_t size = old_size(id);
+
+    old.data[old.len++] = id;
+    for (uint8_t i = 0; i < size; i++) {
+        old.data[old.len++] = (uint8_t)((value * old_factor(id)) >> (8 * i));
+    }
+    old_append(id);
+}
+
+static void old_add_float(uint8_t id, float value) {
+    uint64_t value2 = (uint64_t)(value * old_factor(id));
+    uint8_t size = old_size(id);
+
+    old.data[old.len++] = id;
+    for (uint8_t i = 0; i < size; i++) {
+        old.data[old.len++] = (uint8_t)(value2 >> (8 * i));
+    }
+    old_append(id);
+}
+
+static void old_add_state(uint8_t id, uint8_t state, uint8_t steps) {
+    if (id == EVENT_BUTTON) {
+        steps = 0;
+    }
+    old.data[old.len++] = id;
+    old.data[old.len++] = state;
+    if (steps > 0) {
+        old.data[old.len++] = steps;
+    }
+    old_append(id);
+}
+
+static void old_sort(void) {
+    block_t blocks[MEASUREMENT_MAX_LEN / 2 + 1];
+    block_t temp;
+    uint8_t count = 0;
+
+    for (uint8_t j = 0; j < old.len; count++) {
+        blocks[count].id = old.data[j];
+        if (old.data[j] == EVENT_DIMMER) {
+            blocks[count].len = old.data[j + 1] == EVENT_DIMMER_NONE ? 1 : 2;
+        } else {
+            blocks[count].len = old_size(old.data[j]);
+        }
+        memcpy(blocks[count].data, &old.data[j + 1], blocks[count].len);
+        j += blocks[count].len + 1;
+    }
+    for (uint8_t i = 0; count > 1 && i < count - 1; i++) {
+        for (uint8_t j = 0; j < count - 1 - i; j++) {
+            if (blocks[j].id > blocks[j + 1].id) {
+                memcpy(&temp, &blocks[j], sizeof(block_t));
+                memcpy(&blocks[j], &blocks[j + 1], sizeof(block_t));
+                memcpy(&blocks[j + 1], &temp, sizeof(block_t));
+            }
+        }
+    }
+    for (uint8_t i = 0, j = 0; i < count; i++) {
+        old.data[j] = blocks[i].id;
+        memcpy(&old.data[j + 1], blocks[i].data, blocks[i].len);
+        j += blocks[i].len + 1;
+    }
+}
+
+// returns the length of the packet
+static uint8_t old_build(uint8_t *packet) {
+    uint8_t service[BLE_ADVERT_MAX_LEN] = { 0 };
+    uint8_t ciphertext[MEASUREMENT_MAX_LEN];
+    uint8_t nonce[NONCE_LEN];
+    uint8_t mic[MIC_LEN];
+    uint8_t len = 0;
+    uint8_t service_len = 0;
+
+    if (old.sort) {
+        old_sort();
+    }
+    packet[len++] = FLAG1;
+    packet[len++] = FLAG2;
+    packet[len++] = FLAG3;
+
+    // the old encoder padded the encrypted data after truncating the name, and overran the packet with a
+    // long name and less than 5 bytes of data: the padding goes first here, as in the driver
+    while (old.encrypt && old.len < 5) {
+        old.data[old.len++] = 0xFF;
+    }
+    uint8_t name_len = (uint8_t)strlen(old.name) + 2;
+    uint8_t name_flag = COMPLETE_NAME;
+    uint8_t room = BLE_ADVERT_MAX_LEN - old.len - (old.encrypt ? 16 : 8);
+    if (name_len > room) {
+        name_len = room;
+        name_flag = SHORT_NAME;
+    }
+    if (name_len > 2) {
+        packet[len++] = name_len - 1;
+        packet[len++] = name_flag;
+        memcpy(&packet[len], old.name, name_len - 2);
+        len += name_len - 2;
+    }
+
+    service[service_len++] = SERVICE_DATA;
+    service[service_len++] = UUID1;
+    service[service_len++] = UUID2;
+    if (old.encrypt) {
+        bd_addr address;
+        uint8_t type;
+
+        service[service_len++] = old.trigger ? ENCRYPT_TRIGGER_BASE : ENCRYPT;
+        sl_bt_system_get_identity_address(&address, &type);
+        for (uint8_t i = 0; i < 6; i++) {
+            nonce[i] = address.addr[5 - i];
+        }
+        nonce[6] = UUID1;
+        nonce[7] = UUID2;
+        nonce[8] = service[service_len - 1];
+        for (uint8_t i = 0; i < 4; i++) {
+            nonce[9 + i] = (uint8_t)(old.counter >> (8 * i));
+        }
+        mbedtls_ccm_encrypt_and_tag(&old.ccm, old.len, nonce, NONCE_LEN, 0, 0, old.data, ciphertext, mic, MIC_LEN);
+        memcpy(&service[service_len], ciphertext, old.len);
+        service_len += old.len;
+        memcpy(&service[service_len], &nonce[9], 4);
+        service_len += 4;
+        memcpy(&service[service_len], mic, MIC_LEN);
+        service_len += MIC_LEN;
+        old.counter++;
+    } else {
+        service[service_len++] = old.trigger ? NO_ENCRYPT_TRIGGER_BASE : NO_ENCRYPT;
+        memcpy(&service[service_len], old.data, old.len);
+        service_len += old.len;
+    }
+    packet[len++] = service_len;
+    memcpy(&packet[len], service, service_len);
+    return len + service_len;
+}
+
+// xorshift, so the sequences are the same on every host
+static uint32_t random_state = 1;
+
+static uint32_t random_below(uint32_t n) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % n;
+}
+
+static const uint8_t IDS[] = { ID_PACKET, ID_BATTERY, ID_TEMPERATURE_PRECISE, ID_HUMIDITY_PRECISE, ID_PRESSURE,
+                               ID_ILLUMINANCE, ID_MASS, ID_COUNT, ID_ENERGY, ID_POWER, ID_VOLTAGE, ID_MOISTURE,
+                               ID_CO2 };
+
+// adds a random event to both encoders if it fits: a dimmer, with a steps byte when it moved, a button
+// or a door
+static void add_random_state(void) {
+    uint8_t id = EVENT_DIMMER;
+    uint8_t state = (uint8_t)random_below(3);
+    uint8_t steps = state == EVENT_DIMMER_NONE ? 0 : (uint8_t)(1 + random_below(5));
+
+    switch (random_below(3)) {
+        case 0:
+            id = EVENT_BUTTON;
+            state = (uint8_t)random_below(6);
+            break;
+        case 1:
+            id = STATE_DOOR;
+            state = (uint8_t)random_below(2);
+            steps = 0;
+            break;
+    }
+    if (old.len + 2 + (id == EVENT_DIMMER && steps ? 1 : 0) > old_limit()) {
+        return;
+    }
+    bthome_v2_add_measurement_state(id, state, steps);
+    old_add_state(id, state, steps);
+}
+
+// adds a random object to both encoders if it fits; ascending keeps the ids in ascending order
+static void add_random(bool ascending) {
+    if (!ascending && random_below(4) == 0) {
+        add_random_state();
+        return;
+    }
+    uint8_t id = IDS[random_below(sizeof(IDS))];
+    if (ascending && id < old.last_id) {
+        id = old.last_id;
+    }
+    if (old.len + old_size(id) + 1 > old_limit()) {
+        return;
+    }
+    if (random_below(2)) {
+        uint64_t value = random_below(100000);
+        bthome_v2_add_measurement(id, value);
+        old_add(id, value);
+    } else {
+        float value = random_below(10000000) / 100.0f;
+        bthome_v2_add_measurement_float(id, value);
+        old_add_float(id, value);
+    }
+}
+
+// random objects, each packet of the driver against the reference; in random order, the objects with the
+// same id keep the order they were added in
+static void check_packets(const char *name, bool encrypt, bool ascending) {
+    uint8_t expected[BLE_ADVERT_MAX_LEN];
+    uint8_t packet[BLE_ADVERT_MAX_LEN];
+    static char copy[32];
+
+    strcpy(copy, name);
+    nvm3_writeCounter(nvm3_defaultHandle, BTHOME_V2_COUNTER_NVM3_KEY, COUNTER_START);
+    CHECK_EQ(bthome_v2_init((uint8_t *)copy, encrypt, (const uint8_t *)KEY, false), SL_STATUS_OK);
+    old_init(name, encrypt, false);
+
+    for (int build = 0; build < BUILDS; build++) {
+        bthome_v2_reset_measurement();
+        old_reset();
+        uint32_t count = 1 + random_below(8);
+        for (uint32_t i = 0; i < count; i++) {
+            add_random(ascending);
+        }
+        uint8_t expected_len = old_build(expected);
+        uint8_t len = bthome_v2_encode_packet(packet, sizeof(packet));
+        CHECK_EQ(len, expected_len);
+        if (len != expected_len || memcmp(packet, expected, len)) {
+            printf("%s %s %s: packet %d differs\n", name, encrypt ? "encrypted" : "plain",
+                   ascending ? "ascending" : "random order", build);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+// the packets encoded into caller buffers, plain, encrypted and trigger based, against the 31 bytes the
+// reference sent: the same bytes with the zero padding cut, and nothing written past the exact length;
+// a buffer one byte too small is refused untouched, without using a counter value, and the packets
+// built alternately into two buffers leave the other one as it was
+static void check_buffers(const char *name, bool encrypt, bool trigger) {
+    uint8_t sent[BLE_ADVERT_MAX_LEN];
+    uint8_t buffers[2][BLE_ADVERT_MAX_LEN + 8];
+    uint8_t previous[BLE_ADVERT_MAX_LEN + 8];
+    static char copy[32];
+
+    strcpy(copy, name);
+    nvm3_writeCounter(nvm3_defaultHandle, BTHOME_V2_COUNTER_NVM3_KEY, COUNTER_START);
+    CHECK_EQ(bthome_v2_init((uint8_t *)copy, encrypt, (const uint8_t *)KEY, trigger), SL_STATUS_OK);
+    old_init(name, encrypt, trigger);
+    memset(buffers, 0xA5, sizeof(buffers));
+
+    for (int build = 0; build < BUILDS / 4; build++) {
+        uint8_t *buffer = buffers[build & 1];
+        memcpy(previous, buffers[!(build & 1)], sizeof(previous));
+        bthome_v2_reset_measurement();
+        old_reset();
+        uint32_t count = 1 + random_below(8);
+        for (uint32_t i = 0; i < count; i++) {
+            add_random(true);
+        }
+        memset(sent, 0, sizeof(sent));
+        uint8_t expected_len = old_build(sent);
+
+        memset(buffer, 0xA5, sizeof(buffers[0]));
+        CHECK_EQ(bthome_v2_encode_packet(buffer, expected_len - 1), 0);
+        uint8_t len = bthome_v2_encode_packet(buffer, expected_len);
+        CHECK_EQ(len, expected_len);
+        if (len != expected_len || memcmp(buffer, sent, len)) {
+            printf("%s %s%s: packet %d differs\n", name, encrypt ? "encrypted" : "plain",
+                   trigger ? " trigger based" : "", build);
+            CHECK(0);
+            return;
+        }
+        for (uint8_t i = len; i < BLE_ADVERT_MAX_LEN; i++) {
+            CHECK_EQ(sent[i], 0);
+        }
+        for (uint8_t i = len; i < sizeof(buffers[0]); i++) {
+            CHECK_EQ(buffer[i], 0xA5);
+        }
+        CHECK(!memcmp(previous, buffers[!(build & 1)], sizeof(previous)));
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// host time of the packet build of one mass, the application case; the encryption blocks which do not
+// depend on the data are precomputed out of the build, as the application does when idle
+static void benchmark(bool encrypt) {
+    uint8_t packet[BLE_ADVERT_MAX_LEN];
+    static char name[] = "Scale";
+    uint64_t old_ns = 0;
+    uint64_t ns = 0;
+
+    CHECK_EQ(bthome_v2_init((uint8_t *)name, encrypt, (const uint8_t *)KEY, false), SL_STATUS_OK);
+    old_init(name, encrypt, false);
+    for (int32_t i = 0; i < BENCH_COUNT; i++) {
+        old_reset();
+        old_add_float(ID_MASS, i * 0.01f);
+        uint64_t start = now_ns();
+        old_build(packet);
+        old_ns += now_ns() - start;
+
+        bthome_v2_reset_measurement();
+        bthome_v2_add_measurement_float(ID_MASS, i * 0.01f);
+        bthome_v2_prepare();
+        start = now_ns();
+        bthome_v2_encode_packet(packet, sizeof(packet));
+        ns += now_ns() - start;
+    }
+    printf("%-9s build: %.1f ns, %.1f ns before the template\n", encrypt ? "encrypted" : "plain",
+           (double)ns / BENCH_COUNT, (double)old_ns / BENCH_COUNT);
+}
+
+// host time per update of 5 objects added in descending id order: the driver inserts each one in place,
+// the reference sorts them at the build
+static void benchmark_order(void) {
+    uint8_t packet[BLE_ADVERT_MAX_LEN];
+    static char name[] = "Scale";
+
+    CHECK_EQ(bthome_v2_init((uint8_t *)name, false, (const uint8_t *)KEY, false), SL_STATUS_OK);
+    old_init(name, false, false);
+
+    uint64_t start = now_ns();
+    for (int32_t i = 0; i < BENCH_COUNT; i++) {
+        old_reset();
+        old_add(ID_MASS, i);
+        old_add(ID_PRESSURE, i);
+        old_add(ID_TEMPERATURE_PRECISE, i);
+        old_add(ID_BATTERY, 90);
+        old_add(ID_PACKET, i);
+        old_build(packet);
+    }
+    double old_ns = (double)(now_ns() - start) / BENCH_COUNT;
+
+    start = now_ns();
+    for (int32_t i = 0; i < BENCH_COUNT; i++) {
+        bthome_v2_reset_measurement();
+        bthome_v2_add_measurement(ID_MASS, i);
+        bthome_v2_add_measurement(ID_PRESSURE, i);
+        bthome_v2_add_measurement(ID_TEMPERATURE_PRECISE, i);
+        bthome_v2_add_measurement(ID_BATTERY, 90);
+        bthome_v2_add_measurement(ID_PACKET, i);
+        bthome_v2_encode_packet(packet, sizeof(packet));
+    }
+    double ns = (double)(now_ns() - start) / BENCH_COUNT;
+    printf("5 objects in descending order: %.1f ns per update, %.1f ns with the sort at the build\n", ns, old_ns);
+}
+
+// extended advertising data longer than a single command goes through the system data buffer
+static void check_extended(void) {
+    static char name[] = "Scale";
+    sl_bt_msg_t evt;
+
+    stubs_reset();
+    CHECK_EQ(bthome_v2_init((uint8_t *)name, false, (const uint8_t *)KEY, false), SL_STATUS_OK);
+    evt.header = sl_bt_evt_system_boot_id;
+    bthome_v2_bt_on_event(&evt);
+    CHECK_EQ(bthome_v2_set_extended_advertising(true), SL_STATUS_OK);
+    stubs_advertiser_t *legacy = stubs_advertiser(0);
+    stubs_advertiser_t *extended = stubs_advertiser(1);
+    CHECK(legacy && extended);
+
+    // 3 + 7 + 5 bytes of flags, name and service data header, then the objects, up to the full packet
+    for (uint32_t count = 1; count <= (BLE_EXT_ADVERT_MAX_LEN - 15) / 5; count++) {
+        bthome_v2_reset_measurement();
+        for (uint32_t i = 0; i < count; i++) {
+            bthome_v2_add_measurement(ID_COUNT4, 0x01020304 + i);
+        }
+        CHECK_EQ(bthome_v2_build_packet(), SL_STATUS_OK);
+        CHECK_EQ(extended->len, 15 + 5 * count);
+        CHECK_EQ(extended->data[10], 4 + 5 * count);
+        CHECK_EQ(extended->data[extended->len - 5], ID_COUNT4);
+        CHECK_EQ(extended->data[extended->len - 4], 0x04 + count - 1);
+        CHECK_EQ(extended->updates, count);
+        // the fallback has the objects which fit in a legacy packet
+        CHECK(legacy->len <= BLE_ADVERT_MAX_LEN);
+        CHECK_EQ(legacy->updates, count);
+    }
+    CHECK_EQ(extended->len, BLE_EXT_ADVERT_MAX_LEN);
+
+    CHECK_EQ(bthome_v2_set_extended_advertising(false), SL_STATUS_OK);
+}
+
+int main(void) {
+    // a name which always fits, and names truncated to fit more or fewer measurements
+    static const char *const NAMES[] = { "S", "Scale", "Smart scale 2000 kg", "Smart scale of the kitchen" };
+
+    for (uint8_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        for (uint8_t ascending = 0; ascending < 2; ascending++) {
+            check_packets(NAMES[i], false, ascending);
+            check_packets(NAMES[i], true, ascending);
+        }
+        for (uint8_t trigger = 0; trigger < 2; trigger++) {
+            check_buffers(NAMES[i], false, trigger);
+            check_buffers(NAMES[i], true, trigger);
+        }
+    }
+    benchmark(false);
+    benchmark(true);
+    benchmark_order();
+    check_extended();
+
+    return test_result();
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include "sl_bt_api.h"
+#include "bthome_v2.h"
+#include "mbedtls/ccm.h"
+#include "nvm3_default.h"
+#include "stubs.h"
+#include "test.h"
+
+// BTHome encryption: each packet against mbedtls_ccm_encrypt_and_tag() with the nonce of its counter,
+// across the carries of the counter bytes, for data of one to several AES blocks, with the keystream
+// precomputed, missing or precomputed for another length, and packets beyond the precomputed ones
+
+#define KEY     "231d39c1d7cc1ab1aee224cd096db932"
+#define PACKETS 40 // per counter start, around the carry
+
+static mbedtls_ccm_context ccm;
+static uint8_t plaintext[MEASUREMENT_EXT_MAX_LEN];
+static uint8_t plaintext_len;
+static uint32_t failures;
+
+// xorshift, so the sequences are the same on every host
+static uint32_t random_state = 1;
+
+static uint32_t random_below(uint32_t n) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % n;
+}
+
+static void init(uint32_t counter) {
+    static char name[] = "S";
+    uint8_t key[BIND_KEY_LEN];
+    sl_bt_msg_t evt;
+
+    for (uint8_t i = 0; i < BIND_KEY_LEN; i++) {
+        char octet[3] = { KEY[2 * i], KEY[2 * i + 1], 0 };
+        key[i] = (uint8_t)strtol(octet, NULL, 16);
+    }
+    mbedtls_ccm_init(&ccm);
+    mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, BIND_KEY_LEN * 8);
+
+    nvm3_writeCounter(nvm3_defaultHandle, BTHOME_V2_COUNTER_NVM3_KEY, counter);
+    CHECK_EQ(bthome_v2_init((uint8_t *)name, true, (const uint8_t *)KEY, false), SL_STATUS_OK);
+    // the advertising sets are created by the first boot event
+    evt.header = sl_bt_evt_system_boot_id;
+    bthome_v2_bt_on_event(&evt);
+}
+
+// adds count objects of 5 bytes, and keeps their bytes
+static void add_objects(uint8_t count) {
+    bthome_v2_reset_measurement();
+    plaintext_len = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t value = random_below(0xFFFFFFFF);
+        bthome_v2_add_measurement(ID_COUNT4, value);
+        plaintext[plaintext_len++] = ID_COUNT4;
+        for (uint8_t j = 0; j < 4; j++) {
+            plaintext[plaintext_len++] = (uint8_t)(value >> (8 * j));
+        }
+    }
+}
+
+// checks the encrypted service data of a packet, the first data_len bytes of the plaintext with the
+// given counter
+static void check_packet(const uint8_t *packet, size_t len, uint8_t data_len, uint32_t counter) {
+    static const uint8_t HEADER[] = { SERVICE_DATA, UUID1, UUID2, ENCRYPT };
+    uint8_t nonce[NONCE_LEN];
+    uint8_t ciphertext[MEASUREMENT_EXT_MAX_LEN];
+    uint8_t mic[MIC_LEN];
+    bd_addr address;
+    uint8_t type;
+    size_t i = 0;
+
+    while (i + sizeof(HEADER) <= len && memcmp(&packet[i], HEADER, sizeof(HEADER))) {
+        i++;
+    }
+    CHECK(i > 0 && i + sizeof(HEADER) + data_len + 4 + MIC_LEN == len);
+    CHECK_EQ(packet[i - 1], sizeof(HEADER) + data_len + 4 + MIC_LEN);
+    if (i == 0 || i + sizeof(HEADER) + data_len + 4 + MIC_LEN != len) {
+        failures++;
+        return;
+    }
+    const uint8_t *data = &packet[i + sizeof(HEADER)];
+
+    sl_bt_system_get_identity_address(&address, &type);
+    for (uint8_t j = 0; j < 6; j++) {
+        nonce[j] = address.addr[5 - j];
+    }
+    nonce[6] = UUID1;
+    nonce[7] = UUID2;
+    nonce[8] = ENCRYPT;
+    for (uint8_t j = 0; j < 4; j++) {
+        nonce[9 + j] = (uint8_t)(counter >> (8 * j));
+    }
+    mbedtls_ccm_encrypt_and_tag(&ccm, data_len, nonce, NONCE_LEN, 0, 0, plaintext, ciphertext, mic, MIC_LEN);
+    if (memcmp(data, ciphertext, data_len) || memcmp(&data[data_len], &nonce[9], 4)
+        || memcmp(&data[data_len + 4], mic, MIC_LEN)) {
+        printf("counter 0x%08lx, %u bytes: the packet differs from mbedtls_ccm\n", (unsigned long)counter,
+               data_len);
+        failures++;
+    }
+}
+
+// legacy packets of 1 to 3 objects, a single AES block
+static void check_legacy(uint32_t start) {
+    uint8_t packet[BLE_ADVERT_MAX_LEN];
+
+    init(start);
+    for (uint32_t counter = start; counter < start + PACKETS; counter++) {
+        add_objects((uint8_t)(1 + random_below(3)));
+        // the keystream precomputed or not: every few packets, the window runs out
+        if (random_below(3)) {
+            bthome_v2_prepare();
+        }
+        uint8_t len = bthome_v2_encode_packet(packet, sizeof(packet));
+        check_packet(packet, len, plaintext_len, counter);
+    }
+}
+
+// extended packets of 1 to 47 objects, up to 15 AES blocks, and their legacy fallback with the next
+// counter value; the keystream is extended when the data is longer than precomputed
+static void check_extended(uint32_t start) {
+    init(start);
+    CHECK_EQ(bthome_v2_set_extended_advertising(true), SL_STATUS_OK);
+    stubs_advertiser_t *legacy = stubs_advertiser(0);
+    stubs_advertiser_t *extended = stubs_advertiser(1);
+
+    for (uint32_t counter = start; counter < start + PACKETS; counter += 2) {
+        uint8_t count = (uint8_t)(1 + random_below((MEASUREMENT_EXT_MAX_LEN - 8) / 5));
+        add_objects(count);
+        if (random_below(3)) {
+            bthome_v2_prepare();
+        }
+        CHECK_EQ(bthome_v2_build_packet(), SL_STATUS_OK);
+        check_packet(extended->data, extended->len, plaintext_len, counter);
+        // the objects of the fallback are the first ones, 3 fit in a legacy packet
+        check_packet(legacy->data, legacy->len, (count < 3 ? count : 3) * 5, counter + 1);
+    }
+    CHECK_EQ(bthome_v2_set_extended_advertising(false), SL_STATUS_OK);
+}
+
+int main(void) {
+    // the packets around the carry into each byte of the counter
+    static const uint32_t STARTS[] = { 0, 0x100 - PACKETS / 2, 0x10000 - PACKETS / 2, 0x1000000 - PACKETS / 2 };
+
+    stubs_reset();
+    for (uint8_t i = 0; i < sizeof(STARTS) / sizeof(STARTS[0]); i++) {
+        check_legacy(STARTS[i]);
+        check_extended(STARTS[i]);
+    }
+    printf("keystream depth %d: %lu packet(s) differ from mbedtls_ccm\n", BTHOME_V2_KEYSTREAM_DEPTH,
+           (unsigned long)failures);
+    CHECK_EQ(failures, 0);
+
+    return test_result();
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "sl_bt_api.h"
+#include "bthome_v2.h"
+#include "nvm3_default.h"
+#include "stubs.h"
+#include "test.h"
+
+// BTHome encryption counter persisted in NVM3: random power cuts, right after a block was reserved and
+// before it was used or anywhere else, and periods where the NVM3 writes fail. A counter value is only
+// sent below the limit stored in NVM3, so that it never goes back nor repeats after a reset
+// (built with BTHOME_V2_COUNTER_BLOCK 16, many blocks are reserved)
+
+#define KEY    "231d39c1d7cc1ab1aee224cd096db932"
+#define STEPS  20000
+
+// xorshift, so the sequences are the same on every host
+static uint32_t random_state = 1;
+
+static uint32_t random_below(uint32_t n) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % n;
+}
+
+// the device restarts: the driver resumes from NVM3
+static void power_cut(void) {
+    static char name[] = "S";
+
+    CHECK_EQ(bthome_v2_init((uint8_t *)name, true, (const uint8_t *)KEY, false), SL_STATUS_OK);
+}
+
+static uint32_t stored_limit(void) {
+    uint32_t limit = 0;
+
+    CHECK_EQ(nvm3_readCounter(nvm3_defaultHandle, BTHOME_V2_COUNTER_NVM3_KEY, &limit), ECODE_NVM3_OK);
+    return limit;
+}
+
+int main(void) {
+    uint8_t packet[BLE_ADVERT_MAX_LEN];
+    uint32_t last = 0;
+    bool sent = false;
+    bool failing = false;
+    uint32_t packets = 0;
+    uint32_t refused = 0;
+    uint32_t cuts = 0;
+
+    stubs_reset();
+    power_cut();
+    for (uint32_t step = 0; step < STEPS; step++) {
+        uint32_t writes = stubs_nvm3_writes();
+
+        // the writes fail for a while now and then
+        if (random_below(failing ? 20 : 200) == 0) {
+            failing = !failing;
+            stubs_nvm3_fail_writes(failing);
+        }
+
+        // the application reserves ahead when idle
+        if (random_below(2)) {
+            bthome_v2_prepare();
+        }
+        bthome_v2_reset_measurement();
+        bthome_v2_add_measurement(ID_PACKET, step);
+        uint8_t len = bthome_v2_encode_packet(packet, sizeof(packet));
+        if (len == 0) {
+            // only without a reserved value
+            CHECK(failing);
+            refused++;
+        } else {
+            uint32_t counter = packet[len - 8] | packet[len - 7] << 8 | packet[len - 6] << 16
+                               | (uint32_t)packet[len - 5] << 24;
+            CHECK(!sent || counter > last);
+            CHECK(counter < stored_limit());
+            last = counter;
+            sent = true;
+            packets++;
+        }
+
+        // a power cut right after a reservation, before the block is used, or at any time
+        if ((stubs_nvm3_writes() != writes && random_below(3) == 0) || random_below(100) == 0) {
+            power_cut();
+            cuts++;
+        }
+    }
+    printf("%lu packets, %lu refused while the writes failed, %lu power cuts, %lu writes\n",
+           (unsigned long)packets, (unsigned long)refused, (unsigned long)cuts,
+           (unsigned long)stubs_nvm3_writes());
+    CHECK(packets > STEPS / 2);
+    CHECK(refused > 0);
+
+    return test_result();
+}
@@ -0,0 +1,167 @@
+#include <string.h>
+#include "calibration.h"
+#include "hx711.h"
+#include "nvm3_default.h"
+#include "stubs.h"
+#include "test.h"
+
+// the calibration table and the temperature coefficients in NVM3: loaded at boot, written by apply and
+// the tempco command, erased by reset; a stored table that does not build, e.g. a corrupt or oversized
+// count, is ignored and the default scale is used
+
+#define CALIBRATION_NVM3_KEY 0x1000 // of calibration.c
+#define TEMPCO_NVM3_KEY      0x1001
+#define DEFAULT_SCALE        375.0f
+
+// the reference points as calibration.c stores them
+typedef struct {
+    uint8_t count;
+    int32_t raw[CALIBRATION_MAX_POINTS];
+    int32_t mg[CALIBRATION_MAX_POINTS];
+} stored_points_t;
+
+static void store(uint8_t count, const int32_t *raw, const int32_t *mg) {
+    stored_points_t points;
+
+    memset(&points, 0, sizeof(points));
+    points.count = count;
+    for (uint8_t i = 0; i < count && i < CALIBRATION_MAX_POINTS; i++) {
+        points.raw[i] = raw[i];
+        points.mg[i] = mg[i];
+    }
+    CHECK_EQ(nvm3_writeData(nvm3_defaultHandle, CALIBRATION_NVM3_KEY, &points, sizeof(points)), ECODE_NVM3_OK);
+}
+
+static bool stored(void) {
+    stored_points_t points;
+
+    return nvm3_readData(nvm3_defaultHandle, CALIBRATION_NVM3_KEY, &points, sizeof(points)) == ECODE_NVM3_OK;
+}
+
+// the points of the table in use, as served over GATT: count, then raw and mg pairs
+static uint8_t points_in_use(int32_t *raw, int32_t *mg) {
+    uint8_t buf[1 + 8 * CALIBRATION_MAX_POINTS];
+    size_t len = calibration_get_points(buf, sizeof(buf));
+
+    CHECK_EQ(len, 1 + 8 * (size_t)buf[0]);
+    for (uint8_t i = 0; i < buf[0]; i++) {
+        memcpy(&raw[i], &buf[1 + 8 * i], sizeof(int32_t));
+        memcpy(&mg[i], &buf[5 + 8 * i], sizeof(int32_t));
+    }
+    return buf[0];
+}
+
+static void check_default_scale(hx711_t *dev) {
+    int32_t raw[CALIBRATION_MAX_POINTS];
+    int32_t mg[CALIBRATION_MAX_POINTS];
+
+    CHECK(dev->calibration == 0);
+    CHECK_NEAR(HX711_get_scale(), DEFAULT_SCALE, 0.001);
+    CHECK_EQ(points_in_use(raw, mg), 0);
+}
+
+int main(void) {
+    hx711_t *dev = HX711_get_default();
+    int32_t raw[CALIBRATION_MAX_POINTS + 1];
+    int32_t mg[CALIBRATION_MAX_POINTS + 1];
+
+    HX711_set_offset(0);
+
+    // nothing stored: the default scale
+    stubs_reset();
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+    CHECK(dev->temp.tempco == 0);
+
+    // a stored table of two points, unsorted, and the temperature coefficients
+    static const int32_t RAW[] = { 75000, 37500 };
+    static const int32_t MG[] = { 200000, 100000 };
+    static const hx711_tempco_t TEMPCO = { 25.0f, 1.5f, -20.0f };
+    store(2, RAW, MG);
+    CHECK_EQ(nvm3_writeData(nvm3_defaultHandle, TEMPCO_NVM3_KEY, &TEMPCO, sizeof(TEMPCO)), ECODE_NVM3_OK);
+    CHECK(calibration_init(DEFAULT_SCALE));
+    CHECK(dev->calibration != 0);
+    CHECK_EQ(hx711_to_mg(dev, 37500), 100000);
+    CHECK_EQ(hx711_to_mg(dev, 56250), 150000);
+    CHECK_NEAR(HX711_get_scale(), 375.0, 0.001);
+    CHECK(dev->temp.tempco != 0);
+    CHECK(!memcmp(dev->temp.tempco, &TEMPCO, sizeof(TEMPCO)));
+    CHECK_EQ(points_in_use(raw, mg), 2);
+    CHECK_EQ(raw[0], 75000);
+    CHECK_EQ(mg[1], 100000);
+
+    // capture and apply a new table: stored, then used
+    calibration_start();
+    CHECK_EQ(calibration_add_point(40000, 100000), SL_STATUS_OK);
+    CHECK_EQ(calibration_add_point(100000, 250000), SL_STATUS_OK);
+    CHECK_EQ(calibration_apply(), SL_STATUS_OK);
+    CHECK_EQ(hx711_to_mg(dev, 40000), 100000);
+    CHECK_EQ(hx711_to_mg(dev, 70000), 175000);
+    CHECK(stored());
+    // and loaded again at the next boot
+    CHECK(calibration_init(DEFAULT_SCALE));
+    CHECK_EQ(hx711_to_mg(dev, 100000), 250000);
+
+    // the capture is limited to the table size, and the points must build a table
+    calibration_start();
+    CHECK_EQ(calibration_apply(), SL_STATUS_INVALID_PARAMETER);
+    for (uint8_t i = 0; i < CALIBRATION_MAX_POINTS; i++) {
+        CHECK_EQ(calibration_add_point(1000 * (i + 1), 2000 * (i + 1)), SL_STATUS_OK);
+    }
+    CHECK_EQ(calibration_add_point(100000, 200000), SL_STATUS_FULL);
+    calibration_start();
+    CHECK_EQ(calibration_add_point(40000, 100000), SL_STATUS_OK);
+    CHECK_EQ(calibration_add_point(40000, 120000), SL_STATUS_OK);
+    CHECK_EQ(calibration_apply(), SL_STATUS_INVALID_PARAMETER);
+    // the table in use did not change
+    CHECK_EQ(hx711_to_mg(dev, 100000), 250000);
+
+    // a failed NVM3 write keeps the table in use, and the stored one
+    calibration_start();
+    CHECK_EQ(calibration_add_point(50000, 100000), SL_STATUS_OK);
+    stubs_nvm3_fail_writes(true);
+    CHECK_EQ(calibration_apply(), SL_STATUS_FAIL);
+    stubs_nvm3_fail_writes(false);
+    CHECK_EQ(hx711_to_mg(dev, 100000), 250000);
+    CHECK(calibration_init(DEFAULT_SCALE));
+    CHECK_EQ(hx711_to_mg(dev, 100000), 250000);
+
+    // reset: back to the default scale, erased from NVM3, twice is fine
+    CHECK_EQ(calibration_reset(), SL_STATUS_OK);
+    check_default_scale(dev);
+    CHECK(!stored());
+    CHECK_EQ(calibration_reset(), SL_STATUS_OK);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+
+    // a stored count beyond the table, or of zero: ignored
+    for (uint8_t i = 0; i <= CALIBRATION_MAX_POINTS; i++) {
+        raw[i] = 1000 * (i + 1);
+        mg[i] = 2000 * (i + 1);
+    }
+    store(CALIBRATION_MAX_POINTS + 1, raw, mg);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+    store(255, raw, mg);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+    store(0, raw, mg);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+    // the largest table is fine
+    store(CALIBRATION_MAX_POINTS, raw, mg);
+    CHECK(calibration_init(DEFAULT_SCALE));
+    CHECK_EQ(points_in_use(raw, mg), CALIBRATION_MAX_POINTS);
+
+    // corrupt points, two at the same reading, or an object shorter than the table: ignored
+    static const int32_t SAME_RAW[] = { 40000, 40000 };
+    store(2, SAME_RAW, MG);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+    uint8_t truncated[5] = { 2 };
+    CHECK_EQ(nvm3_writeData(nvm3_defaultHandle, CALIBRATION_NVM3_KEY, truncated, sizeof(truncated)), ECODE_NVM3_OK);
+    CHECK(!calibration_init(DEFAULT_SCALE));
+    check_default_scale(dev);
+
+    return test_result();
+}
@@ -0,0 +1,186 @@
+#include <math.h>
+#include <time.h>
+#include "hx711.h"
+#include "hx711_filter.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// streaming filters: the outputs against reference implementations, the noise reduction on simulated
+// load cell traces, and the host time per update
+
+#define TRACE_LEN   2000
+#define BENCH_COUNT 1000000
+
+static volatile int32_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift, so the sequences are the same on every host
+static uint32_t random_state = 1;
+
+static int32_t random_sample(int32_t range) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return (int32_t)(random_state % (2 * (uint32_t)range + 1)) - range;
+}
+
+// median or trimmed mean of the last count samples, sorting a copy of the window
+static int32_t reference_window(const int32_t *samples, uint8_t count, uint8_t size, uint8_t trim, uint8_t median) {
+    int32_t sorted[HX711_FILTER_WINDOW_MAX];
+
+    for (uint8_t i = 0; i < count; i++) {
+        int32_t x = samples[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > x) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = x;
+    }
+    if (median) {
+        if (count & 1) {
+            return sorted[count / 2];
+        }
+        return (int32_t)(((int64_t)sorted[count / 2 - 1] + sorted[count / 2]) / 2);
+    }
+    // the trim is proportional while the window fills up
+    trim = (uint8_t)((uint16_t)trim * count / size);
+    int64_t sum = 0;
+    for (uint8_t i = trim; i < count - trim; i++) {
+        sum += sorted[i];
+    }
+    return (int32_t)(sum / (count - 2 * trim));
+}
+
+static void check_window(uint8_t size, uint8_t trim, uint8_t median) {
+    int32_t samples[200];
+    hx711_filter_t filter;
+
+    if (median) {
+        hx711_filter_init_median(&filter, size);
+    } else {
+        hx711_filter_init_trimmed_mean(&filter, size, trim);
+    }
+    for (uint8_t i = 0; i < 200; i++) {
+        // repeated values, steps and outliers
+        samples[i] = (i % 50 < 25 ? 100000 : -3000) + random_sample(i % 7 == 0 ? 30000 : 20);
+        uint8_t count = i + 1 < size ? i + 1 : size;
+        int32_t expected = reference_window(&samples[i + 1 - count], count, size, trim, median);
+        CHECK_EQ(hx711_filter_update(&filter, samples[i]), expected);
+    }
+    CHECK_EQ(hx711_filter_output(&filter), reference_window(&samples[200 - size], size, size, trim, median));
+
+    // the reset forgets the window
+    hx711_filter_reset(&filter);
+    CHECK_EQ(hx711_filter_update(&filter, 42), 42);
+}
+
+static void check_iir(void) {
+    hx711_filter_t filter;
+    int64_t state = 0;
+
+    hx711_filter_init_iir(&filter, 3);
+    for (int i = 0; i < 200; i++) {
+        int32_t x = 50000 + random_sample(500);
+        state = i == 0 ? (int64_t)x << 8 : state + ((((int64_t)x << 8) - state) >> 3);
+        CHECK_EQ(hx711_filter_update(&filter, x), (state + 128) >> 8);
+    }
+}
+
+// RMS error of a filter against the true load, after the first samples
+static double rms_error(hx711_filter_t *filter, const int32_t *trace, const int32_t *truth) {
+    double sum = 0;
+    int count = 0;
+
+    hx711_filter_reset(filter);
+    for (int i = 0; i < TRACE_LEN; i++) {
+        int32_t y = hx711_filter_update(filter, trace[i]);
+        if (i >= 50) {
+            sum += (double)(y - truth[i]) * (y - truth[i]);
+            count++;
+        }
+    }
+    return sqrt(sum / count);
+}
+
+// records a trace of the simulated load cell at 80 SPS: constant load with Gaussian noise,
+// and optional single-sample spikes
+static void record(int32_t *trace, int32_t *truth, float noise, uint8_t spikes) {
+    hx711_sim_load_t load = { .waveform = HX711_SIM_CONSTANT, .base = 200000, .noise = noise };
+
+    hx711_sim_reset(80);
+    hx711_sim_set_load(0, &load);
+    HX711_init(128);
+    hx711_set_rate(HX711_get_default(), 80);
+    for (int i = 0; i < TRACE_LEN; i++) {
+        long value;
+        CHECK(HX711_read(&value));
+        trace[i] = (int32_t)value;
+        truth[i] = load.base;
+        if (spikes && i % 97 == 13) {
+            trace[i] += 50000;
+        }
+    }
+}
+
+static void check_noise(void) {
+    static int32_t trace[TRACE_LEN];
+    static int32_t truth[TRACE_LEN];
+    hx711_filter_t filters[5];
+    static const char *const NAMES[] = { "none", "iir 1/8", "median 9", "trimmed mean 12/3", "kalman" };
+    // required RMS error relative to the raw samples, without and with spikes
+    static const double LIMITS[][2] = { { 1.01, 1.01 }, { 0.35, 0.35 }, { 0.5, 0.05 }, { 0.4, 0.05 }, { 0.1, 0.2 } };
+
+    hx711_filter_init_none(&filters[0]);
+    hx711_filter_init_iir(&filters[1], 3);
+    hx711_filter_init_median(&filters[2], 9);
+    hx711_filter_init_trimmed_mean(&filters[3], 12, 3);
+    hx711_filter_init_kalman(&filters[4], 1.0f, 300.0f * 300.0f);
+
+    for (uint8_t spikes = 0; spikes < 2; spikes++) {
+        record(trace, truth, 300, spikes);
+        double raw = rms_error(&filters[0], trace, truth);
+        for (uint8_t f = 0; f < 5; f++) {
+            double rms = rms_error(&filters[f], trace, truth);
+            printf("%-18s %s RMS error %7.1f counts (%.2f of raw)\n", NAMES[f], spikes ? "spikes" : "noise ",
+                   rms, rms / raw);
+            CHECK(rms <= raw * LIMITS[f][spikes]);
+        }
+    }
+}
+
+static void benchmark(void) {
+    hx711_filter_t filters[5];
+    static const char *const NAMES[] = { "iir", "median 5", "median 16", "trimmed mean 16/4", "kalman" };
+
+    hx711_filter_init_iir(&filters[0], 3);
+    hx711_filter_init_median(&filters[1], 5);
+    hx711_filter_init_median(&filters[2], 16);
+    hx711_filter_init_trimmed_mean(&filters[3], 16, 4);
+    hx711_filter_init_kalman(&filters[4], 1.0f, 10000.0f);
+    for (uint8_t f = 0; f < 5; f++) {
+        uint64_t start = now_ns();
+        for (int32_t i = 0; i < BENCH_COUNT; i++) {
+            sink = hx711_filter_update(&filters[f], 100000 + random_sample(300));
+        }
+        printf("%-18s %.1f ns per sample\n", NAMES[f], (double)(now_ns() - start) / BENCH_COUNT);
+    }
+}
+
+int main(void) {
+    for (uint8_t size = 1; size <= HX711_FILTER_WINDOW_MAX; size++) {
+        check_window(size, 0, 1);
+        for (uint8_t trim = 0; 2 * trim < size; trim++) {
+            check_window(size, trim, 0);
+        }
+    }
+    check_iir();
+    check_noise();
+    benchmark();
+    return test_result();
+}
@@ -0,0 +1,90 @@
+#include <time.h>
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// fixed-point milligram pipeline: accuracy against the floating point path, and a benchmark of both
+// the benchmark reports host nanoseconds; on target, build with PROFILE_ENABLED for the cycle counts
+
+#define BENCH_COUNT 1000000
+
+static volatile int64_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the conversion of the floating point API: (reading - offset) / scale, in mg
+static double float_mg(hx711_t *dev, long raw) {
+    return (double)(raw - hx711_get_offset(dev)) / hx711_get_scale(dev) * 1000;
+}
+
+static void check_scale(hx711_t *dev, float scale, long offset) {
+    hx711_set_scale(dev, scale);
+    hx711_set_offset(dev, offset);
+    for (long raw = -0x800000; raw <= 0x7FFFFF; raw += 4099) {
+        double expected = float_mg(dev, raw);
+        // the reciprocal of the scale is rounded to Q16, plus the final rounding
+        double tolerance = (double)(raw - offset) / (1 << HX711_MG_Q) / 2;
+        tolerance = (tolerance < 0 ? -tolerance : tolerance) + 1;
+        CHECK_NEAR(hx711_to_mg(dev, raw), expected, tolerance);
+    }
+}
+
+static void check_calibration(hx711_t *dev) {
+    static const int32_t RAW[] = { 100000, 200000, 400000 };
+    static const int32_t MG[] = { 250000, 520000, 1000000 };
+    hx711_calibration_t cal;
+
+    CHECK(hx711_calibration_build(&cal, RAW, MG, 3));
+    hx711_set_offset(dev, 1000);
+    hx711_set_calibration(dev, &cal);
+    // the points themselves, the middle of a segment, and the extrapolation of the last one
+    // the Q16 slopes are rounded: up to 0.5 / 2^16 mg per count from the start of the segment
+    CHECK_EQ(hx711_to_mg(dev, 1000), 0);
+    CHECK_EQ(hx711_to_mg(dev, 1000 + 100000), 250000);
+    CHECK_NEAR(hx711_to_mg(dev, 1000 + 150000), 385000, 2);
+    CHECK_NEAR(hx711_to_mg(dev, 1000 + 200000), 520000, 2);
+    CHECK_NEAR(hx711_to_mg(dev, 1000 + 400000), 1000000, 4);
+    CHECK_NEAR(hx711_to_mg(dev, 1000 + 500000), 1240000, 5);
+    hx711_set_calibration(dev, 0);
+}
+
+static void benchmark(hx711_t *dev) {
+    hx711_set_scale(dev, 375);
+    hx711_set_offset(dev, 1234);
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < BENCH_COUNT; i++) {
+        sink = (int64_t)float_mg(dev, i * 8);
+    }
+    uint64_t float_ns = now_ns() - start;
+
+    start = now_ns();
+    for (long i = 0; i < BENCH_COUNT; i++) {
+        sink = hx711_to_mg(dev, i * 8);
+    }
+    uint64_t fixed_ns = now_ns() - start;
+
+    printf("to mg: floating point %.2f ns, fixed point %.2f ns per conversion\n",
+           (double)float_ns / BENCH_COUNT, (double)fixed_ns / BENCH_COUNT);
+}
+
+int main(void) {
+    hx711_sim_reset(10);
+    HX711_init(128);
+    hx711_t *dev = HX711_get_default();
+
+    check_scale(dev, 375, 0);
+    check_scale(dev, 375, -52000);
+    // the full range stays within int32 milligrams for scales above 4
+    check_scale(dev, 25, 1000);
+    check_scale(dev, -420, 0);
+    check_scale(dev, 12000, 0);
+    check_calibration(dev);
+    benchmark(dev);
+
+    return test_result();
+}
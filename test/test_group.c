@@ -0,0 +1,147 @@
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// group read of three chips sharing the clock line: a single burst clocks out the conversion of every
+// cell, each reading is converted with the offset and scale of its cell and the weights are summed; a
+// cell which is not ready holds the burst back, and the cells which are ready wait for it; a cell failing
+// the validation rejects the burst, and after HX711_MAX_REJECTS bursts the result flags it
+
+#define CELLS       3
+#define PERIOD_US   100000 // 10 SPS
+
+static const long LOADS[CELLS] = { 120000, -35000, 64000 };
+static const long OFFSETS[CELLS] = { 2000, -1000, 4000 };
+static const float SCALES[CELLS] = { 100, 50, 200 };
+
+// cell 1 reads saturated until this time
+static uint64_t saturated_until;
+
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)gain;
+    return chip == 1 && time_us < saturated_until ? 0x7FFFFF : LOADS[chip];
+}
+
+static int calls;
+static hx711_group_result_t delivered;
+static uint64_t delivered_us;
+
+static void group_cb(hx711_group_t *group, const hx711_group_result_t *result) {
+    (void)group;
+    calls++;
+    delivered = *result;
+    delivered_us = hx711_sim_time_us();
+}
+
+// checks the readings of the cells, their weights and the sum
+static void check_result(const hx711_group_result_t *result) {
+    float total = 0;
+
+    for (uint8_t i = 0; i < CELLS; i++) {
+        float units = (LOADS[i] - OFFSETS[i]) / SCALES[i];
+        CHECK_EQ(result->raw[i], LOADS[i]);
+        CHECK_NEAR(result->units[i], units, 1e-3);
+        CHECK_EQ(result->faults[i], 0);
+        total += units;
+    }
+    CHECK_NEAR(result->total, total, 1e-3);
+}
+
+int main(void) {
+    hx711_t cells[CELLS];
+    hx711_t *members[CELLS];
+    hx711_group_t group;
+    hx711_group_result_t result;
+
+    hx711_sim_reset(10);
+    for (uint8_t i = 0; i < CELLS; i++) {
+        hx711_sim_load_t load = { .waveform = HX711_SIM_CONSTANT, .base = LOADS[i], .creep_tau_s = 1 };
+        hx711_sim_connect(i, 0, i);
+        hx711_sim_set_load(i, &load);
+    }
+    for (uint8_t i = 0; i < CELLS; i++) {
+        hx711_init(&cells[i], 0, 0, 0, i, 128);
+        hx711_set_offset(&cells[i], OFFSETS[i]);
+        hx711_set_scale(&cells[i], SCALES[i]);
+        members[i] = &cells[i];
+    }
+
+    // the cells of a group share the clock line and the gain
+    CHECK(!hx711_group_init(&group, members, 0));
+    CHECK(!hx711_group_init(&group, members, HX711_GROUP_MAX + 1));
+    hx711_select_gain(&cells[2], 32);
+    CHECK(!hx711_group_init(&group, members, CELLS));
+    hx711_select_gain(&cells[2], 128);
+    CHECK(hx711_group_init(&group, members, CELLS));
+
+    // one burst, within a conversion period
+    uint64_t start = hx711_sim_time_us();
+    hx711_group_read(&group, &result);
+    CHECK(hx711_sim_time_us() - start <= PERIOD_US);
+    check_result(&result);
+    for (uint8_t i = 0; i < CELLS; i++) {
+        CHECK(!hx711_is_busy(&cells[i]));
+    }
+
+    // an asynchronous read returns at once; the cells cannot be read on their own meanwhile
+    calls = 0;
+    CHECK(hx711_group_read_async(&group, group_cb));
+    CHECK(!hx711_group_read_async(&group, group_cb));
+    CHECK(!hx711_read_async(&cells[0], 0));
+    CHECK_EQ(calls, 0);
+    hx711_sim_advance(PERIOD_US);
+    CHECK_EQ(calls, 1);
+    check_result(&delivered);
+
+    // a cell which is not ready: the burst waits for its conversion
+    hx711_sim_disconnect(2);
+    CHECK(hx711_group_read_async(&group, group_cb));
+    hx711_sim_advance(3 * PERIOD_US);
+    CHECK_EQ(calls, 1);
+    CHECK_EQ(group.pending, 1 << 2);
+    // a group sharing its cells is refused meanwhile
+    hx711_group_t other;
+    CHECK(hx711_group_init(&other, members, 1));
+    CHECK(!hx711_group_read_async(&other, group_cb));
+    hx711_sim_connect(2, 0, 2);
+    uint64_t connected = hx711_sim_time_us();
+    hx711_sim_advance(2 * PERIOD_US);
+    CHECK_EQ(calls, 2);
+    CHECK_EQ(delivered_us, connected + PERIOD_US);
+    check_result(&delivered);
+
+    // a saturated cell: the burst is read again until the cell recovers
+    hx711_health_t health;
+    hx711_sim_set_input(input);
+    for (uint8_t i = 0; i < CELLS; i++) {
+        hx711_set_validation(&cells[i], 0, 0);
+    }
+    hx711_group_read(&group, &result);
+    check_result(&result);
+    saturated_until = hx711_sim_time_us() + 5 * PERIOD_US / 2;
+    start = hx711_sim_time_us();
+    hx711_group_read(&group, &result);
+    CHECK(hx711_sim_time_us() - start > 2 * PERIOD_US);
+    check_result(&result);
+    hx711_get_health(&cells[1], &health);
+    CHECK_EQ(health.rejected, 2);
+    hx711_get_health(&cells[0], &health);
+    CHECK_EQ(health.rejected, 0);
+
+    // a cell which stays saturated fails the read: it is flagged and left out of the total
+    saturated_until = UINT64_MAX;
+    start = hx711_sim_time_us();
+    hx711_group_read(&group, &result);
+    CHECK(hx711_sim_time_us() - start <= (HX711_MAX_REJECTS + 1) * PERIOD_US);
+    CHECK_EQ(result.faults[0], 0);
+    CHECK_EQ(result.faults[1], HX711_FAULT_SATURATED);
+    CHECK_EQ(result.faults[2], 0);
+    CHECK_EQ(result.units[1], 0);
+    CHECK_EQ(hx711_get_faults(&cells[1]), HX711_FAULT_SATURATED);
+    CHECK_NEAR(result.total, (LOADS[0] - OFFSETS[0]) / SCALES[0] + (LOADS[2] - OFFSETS[2]) / SCALES[2], 1e-3);
+    hx711_get_health(&cells[1], &health);
+    CHECK_EQ(health.rejected, 2 + HX711_MAX_REJECTS);
+    CHECK(!group.busy);
+
+    return test_result();
+}
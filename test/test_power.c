@@ -0,0 +1,109 @@
+#include "hx711.h"
+#include "hx711_power.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// the power policy on the simulated chip, at both rates: powered down between measurements and woken up
+// one settling time before the next deadline, so that the measurement gets a settled reading right away;
+// kept powered when the deadline is closer than the settling time
+
+#define LOAD        123456
+#define DEADLINE_MS 1000
+
+static hx711_power_t policy;
+
+static uint32_t elapsed_ms(uint64_t since_us) {
+    return (uint32_t)((hx711_sim_time_us() - since_us) / 1000);
+}
+
+static uint64_t down_us(void) {
+    hx711_sim_energy_t energy;
+
+    hx711_sim_energy(&energy);
+    return energy.hx711_down_us;
+}
+
+static void check_rate(uint8_t sps) {
+    hx711_t *dev = HX711_get_default();
+    uint32_t period_ms = 1000 / sps;
+    long value;
+
+    hx711_sim_reset(sps);
+    hx711_sim_load_t load = { .waveform = HX711_SIM_CONSTANT, .base = LOAD, .creep_tau_s = 1 };
+    hx711_sim_set_load(0, &load);
+    HX711_init(128);
+    hx711_set_rate_pin(dev, 0, 1);
+    CHECK(hx711_set_rate(dev, sps));
+    uint32_t settle_ms = hx711_get_settling_ms(dev);
+    CHECK_EQ(settle_ms, sps == 80 ? HX711_SETTLE_MS_80SPS : HX711_SETTLE_MS_10SPS);
+    CHECK(HX711_read(&value));
+    hx711_power_init(&policy, dev);
+    uint32_t discarded = dev->power.discarded;
+
+    // a deadline further than the settling time: powered down, woken up one settling time before it
+    hx711_sim_energy_reset();
+    uint64_t start = hx711_sim_time_us();
+    uint32_t wake_ms = hx711_power_release(&policy, DEADLINE_MS);
+    CHECK_EQ(wake_ms, DEADLINE_MS - settle_ms);
+    CHECK(hx711_is_powered_down(dev));
+    hx711_sim_advance(wake_ms * 1000);
+    CHECK(hx711_sim_powered_down(0));
+    hx711_power_wake(&policy);
+    CHECK(!hx711_sim_powered_down(0));
+    CHECK_EQ(policy.wakes, 1);
+    CHECK_EQ(policy.early_wakes, 1);
+    // powered down for the time before the wake up, less the SCK high time before the power down
+    CHECK_NEAR(down_us(), wake_ms * 1000, HX711_SIM_POWER_DOWN_US);
+
+    // at the deadline the chip is settled: the measurement starts at once, with a full reading
+    hx711_sim_advance(settle_ms * 1000);
+    CHECK_EQ(elapsed_ms(start), DEADLINE_MS);
+    CHECK_EQ(hx711_power_acquire(&policy), 0);
+    CHECK(HX711_read(&value));
+    CHECK_EQ(value, LOAD);
+    CHECK(elapsed_ms(start) <= DEADLINE_MS + period_ms);
+    CHECK_EQ(dev->power.discarded, discarded);
+
+    // a wake up without the lead time: the first settled reading comes one settling time later
+    CHECK_EQ(hx711_power_release(&policy, HX711_POWER_NO_DEADLINE), HX711_POWER_NO_DEADLINE);
+    hx711_sim_advance(10000);
+    CHECK(hx711_sim_powered_down(0));
+    start = hx711_sim_time_us();
+    CHECK_EQ(hx711_power_acquire(&policy), settle_ms);
+    CHECK_EQ(policy.wakes, 2);
+    CHECK(HX711_read(&value));
+    CHECK_EQ(value, LOAD);
+    CHECK(elapsed_ms(start) >= settle_ms);
+    CHECK(elapsed_ms(start) <= settle_ms + period_ms);
+
+    // requests closer than the settling time: the chip stays powered, each measurement starts at once
+    hx711_sim_energy_reset();
+    for (uint8_t i = 0; i < 5; i++) {
+        CHECK_EQ(hx711_power_release(&policy, settle_ms), HX711_POWER_NO_DEADLINE);
+        CHECK(!hx711_sim_powered_down(0));
+        hx711_sim_advance(settle_ms * 1000);
+        CHECK_EQ(hx711_power_acquire(&policy), 0);
+        start = hx711_sim_time_us();
+        CHECK(HX711_read(&value));
+        CHECK_EQ(value, LOAD);
+        CHECK(elapsed_ms(start) <= period_ms);
+    }
+    CHECK_EQ(policy.keeps, 5);
+    CHECK_EQ(policy.wakes, 2);
+    CHECK_EQ(down_us(), 0);
+
+    // a close deadline while powered down: woken up right away
+    CHECK_EQ(hx711_power_release(&policy, HX711_POWER_NO_DEADLINE), HX711_POWER_NO_DEADLINE);
+    hx711_sim_advance(10000);
+    CHECK(hx711_sim_powered_down(0));
+    CHECK_EQ(hx711_power_release(&policy, settle_ms / 2), HX711_POWER_NO_DEADLINE);
+    CHECK(!hx711_is_powered_down(dev));
+    CHECK_EQ(policy.early_wakes, 2);
+}
+
+int main(void) {
+    check_rate(10);
+    check_rate(80);
+
+    return test_result();
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+#include "profile.h"
+#include "test.h"
+
+// the profiling statistics, built with PROFILE_ENABLED: histogram buckets of [4^i, 4^(i+1)) ticks, min,
+// max and mean, and their serialization as little endian integers
+
+#define PROBE   PROFILE_HX711_TO_MG
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint8_t bucket_of(uint32_t ticks) {
+    profile_stats_t before;
+    profile_stats_t after;
+
+    profile_get(PROBE, &before);
+    profile_record(PROBE, ticks);
+    profile_get(PROBE, &after);
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {
+        if (after.histogram[b] != before.histogram[b]) {
+            return b;
+        }
+    }
+    return PROFILE_BUCKETS;
+}
+
+int main(void) {
+    static uint8_t buf[PROFILE_SERIALIZED_LEN + 8];
+    profile_stats_t stats;
+
+    profile_init();
+    profile_get(PROBE, &stats);
+    CHECK_EQ(stats.count, 0);
+
+    // bucket boundaries at the powers of 4, 0 ticks in the first bucket, the whole 32-bit range covered
+    CHECK_EQ(bucket_of(0), 0);
+    CHECK_EQ(bucket_of(1), 0);
+    CHECK_EQ(bucket_of(3), 0);
+    for (uint8_t i = 1; i < PROFILE_BUCKETS; i++) {
+        uint32_t low = (uint32_t)1 << (2 * i);
+        CHECK_EQ(bucket_of(low - 1), i - 1);
+        CHECK_EQ(bucket_of(low), i);
+        CHECK_EQ(bucket_of(low + low / 2), i);
+    }
+    CHECK_EQ(bucket_of(UINT32_MAX), PROFILE_BUCKETS - 1);
+
+    // min, max and mean
+    profile_reset();
+    profile_record(PROBE, 100);
+    profile_record(PROBE, 40);
+    profile_record(PROBE, 250);
+    profile_record(PROBE, 11);
+    profile_get(PROBE, &stats);
+    CHECK_EQ(stats.count, 4);
+    CHECK_EQ(stats.min, 11);
+    CHECK_EQ(stats.max, 250);
+    CHECK_EQ(stats.sum, 401);
+    // the sum does not wrap with long durations
+    profile_record(PROFILE_BTHOME_BUILD, UINT32_MAX);
+    profile_record(PROFILE_BTHOME_BUILD, UINT32_MAX);
+    profile_get(PROFILE_BTHOME_BUILD, &stats);
+    CHECK_EQ(stats.sum, 2 * (uint64_t)UINT32_MAX);
+    CHECK_EQ(stats.min, UINT32_MAX);
+
+    // serialized: tick rate, then count, min, max, mean and the histogram of each probe, little endian;
+    // a probe without records has a min of 0
+    for (uint32_t i = 0; i < 70000; i++) {
+        profile_record(PROFILE_HX711_READOUT, 5);
+    }
+    memset(buf, 0xAA, sizeof(buf));
+    CHECK_EQ(profile_serialize(buf, sizeof(buf)), PROFILE_SERIALIZED_LEN);
+    CHECK_EQ(buf[PROFILE_SERIALIZED_LEN], 0xAA);
+    CHECK_EQ(get_u32(buf), PROFILE_TICKS_PER_SECOND);
+    CHECK_EQ(buf[0], (uint8_t)PROFILE_TICKS_PER_SECOND);
+    for (uint8_t i = 0; i < PROFILE_PROBE_COUNT; i++) {
+        const uint8_t *record = buf + sizeof(uint32_t) + i * PROFILE_RECORD_LEN;
+        const uint8_t *histogram = record + 4 * sizeof(uint32_t);
+        switch (i) {
+        case PROBE:
+            CHECK_EQ(get_u32(record), 4);
+            CHECK_EQ(get_u32(record + 4), 11);
+            CHECK_EQ(get_u32(record + 8), 250);
+            CHECK_EQ(get_u32(record + 12), 100);
+            // 11 in [4, 16), 40 in [16, 64), 100 and 250 in [64, 256)
+            CHECK_EQ(get_u16(histogram + 2), 1);
+            CHECK_EQ(get_u16(histogram + 4), 1);
+            CHECK_EQ(get_u16(histogram + 6), 2);
+            break;
+        case PROFILE_HX711_READOUT:
+            // the count is not saturated, the histogram is
+            CHECK_EQ(get_u32(record), 70000);
+            CHECK_EQ(get_u32(record + 4), 5);
+            CHECK_EQ(get_u32(record + 12), 5);
+            CHECK_EQ(get_u16(histogram + 2), UINT16_MAX);
+            CHECK_EQ(get_u16(histogram), 0);
+            break;
+        case PROFILE_BTHOME_BUILD:
+            CHECK_EQ(get_u32(record + 8), UINT32_MAX);
+            CHECK_EQ(get_u32(record + 12), UINT32_MAX);
+            CHECK_EQ(get_u16(histogram + 2 * (PROFILE_BUCKETS - 1)), 2);
+            break;
+        default:
+            for (uint8_t b = 0; b < PROFILE_RECORD_LEN; b++) {
+                CHECK_EQ(record[b], 0);
+            }
+            break;
+        }
+    }
+
+    // a buffer too small for the whole table: nothing written
+    memset(buf, 0xAA, sizeof(buf));
+    CHECK_EQ(profile_serialize(buf, PROFILE_SERIALIZED_LEN - 1), 0);
+    CHECK_EQ(buf[0], 0xAA);
+    CHECK_EQ(profile_serialize(buf, 0), 0);
+
+    // reset: the statistics are cleared
+    profile_reset();
+    profile_get(PROFILE_HX711_READOUT, &stats);
+    CHECK_EQ(stats.count, 0);
+    CHECK_EQ(stats.histogram[1], 0);
+
+    return test_result();
+}
@@ -0,0 +1,87 @@
+#include "hx711.h"
+#include "hx711_sched.h"
+#include "hx711_sim.h"
+#include "hx711_stream.h"
+#include "test.h"
+
+// interleaved channel A/B acquisition with the validation enabled: the readings the driver rejects are
+// converted with the pulses the scheduler programmed, and must not shift the channels; a start while
+// a stream runs is refused without touching it
+
+#define LOAD_A      200000
+#define LOAD_B      -40000
+#define SPIKE       5000
+#define SPIKE_AT    100000 // simulated time of a single spike on channel A [us]
+
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    if (gain == 32) {
+        return LOAD_B;
+    }
+    // one conversion completing around SPIKE_AT carries a spike
+    if (time_us >= SPIKE_AT && time_us < SPIKE_AT + 12500) {
+        return LOAD_A + 100000;
+    }
+    return LOAD_A;
+}
+
+static uint32_t wrong;
+
+static void sample(hx711_sched_t *sched, uint8_t channel, long value) {
+    (void)sched;
+    if (value != (channel == 0 ? LOAD_A : LOAD_B)) {
+        wrong++;
+    }
+}
+
+int main(void) {
+    hx711_sched_t sched;
+
+    hx711_sim_reset(80);
+    hx711_sim_set_input(input);
+    HX711_init(128);
+    hx711_t *dev = HX711_get_default();
+    hx711_set_rate(dev, 80);
+    hx711_set_validation(dev, SPIKE, 0);
+
+    hx711_sched_init(&sched, dev, HX711_SCHED_SETTLE, sample);
+    CHECK_EQ(hx711_sched_add(&sched, 128, 4), 0);
+    CHECK_EQ(hx711_sched_add(&sched, 32, 2), 1);
+    CHECK(hx711_sched_start(&sched));
+    hx711_sim_advance(5000000);
+    hx711_sched_stop(&sched);
+
+    hx711_health_t health;
+    hx711_get_health(dev, &health);
+    printf("%lu A and %lu B samples, %lu discarded, %lu rejected\n", (unsigned long)hx711_sched_samples(&sched, 0),
+           (unsigned long)hx711_sched_samples(&sched, 1), (unsigned long)sched.discarded,
+           (unsigned long)health.rejected);
+    // the channel switches are not spikes, the spike is rejected once
+    CHECK_EQ(health.spikes, 1);
+    CHECK_EQ(health.rejected, 1);
+    CHECK_EQ(wrong, 0);
+    CHECK(hx711_sched_samples(&sched, 0) > 100);
+    CHECK(hx711_sched_samples(&sched, 1) > 50);
+    CHECK_EQ(hx711_sched_value(&sched, 0), LOAD_A);
+    CHECK_EQ(hx711_sched_value(&sched, 1), LOAD_B);
+
+    // a stream of channel B: the refused start leaves it its context and its channel
+    hx711_stream_t stream;
+    hx711_sample_t samples[HX711_STREAM_SIZE];
+    hx711_select_gain(dev, 32);
+    CHECK(hx711_stream_start(&stream, dev, 80));
+    hx711_sim_advance(100000);
+    hx711_stream_flush(&stream);
+    CHECK(!hx711_sched_start(&sched));
+    CHECK(dev->user == &stream);
+    CHECK_EQ(dev->gain, 2);
+    hx711_sim_advance(100000);
+    uint32_t count = hx711_stream_read(&stream, samples, HX711_STREAM_SIZE);
+    CHECK(count >= 7);
+    for (uint32_t i = 0; i < count; i++) {
+        CHECK_EQ(samples[i].value, LOAD_B);
+    }
+    hx711_stream_stop(&stream);
+
+    return test_result();
+}
@@ -0,0 +1,28 @@
+#include <signal.h>
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// a wait with no chip powered and no wakeup pending fails at once instead of hanging the test: the group
+// read has no timeout, the simulation asserts
+
+static void aborted(int sig) {
+    (void)sig;
+    _Exit(0);
+}
+
+int main(void) {
+    hx711_group_t group;
+    hx711_group_result_t result;
+
+    hx711_sim_reset(80);
+    HX711_init(128);
+    hx711_t *cells[] = { HX711_get_default() };
+    CHECK(hx711_group_init(&group, cells, 1));
+    HX711_power_down();
+    signal(SIGABRT, aborted);
+    hx711_group_read(&group, &result);
+    CHECK(!"the group read of a powered down chip returned");
+
+    return test_result();
+}
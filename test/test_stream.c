@@ -0,0 +1,87 @@
+#include "hx711_stream.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// continuous acquisition into the ring buffer: throughput and latency of a consumer draining batches,
+// and overrun accounting when it does not keep up
+
+// the reading is the time of the conversion in ms, so the samples tell when they were converted
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    (void)gain;
+    return (long)(time_us / 1000);
+}
+
+// streams for duration_us, draining the buffer every period_us; returns the number of samples
+static uint32_t drain(hx711_stream_t *stream, uint32_t period_us, uint32_t duration_us, uint32_t *max_latency_us) {
+    hx711_sample_t batch[HX711_STREAM_SIZE];
+    uint32_t total = 0;
+    long last = -1;
+
+    *max_latency_us = 0;
+    for (uint32_t t = 0; t < duration_us; t += period_us) {
+        hx711_sim_advance(period_us);
+        uint32_t count = hx711_stream_read(stream, batch, HX711_STREAM_SIZE);
+        uint32_t now = (uint32_t)hx711_sim_time_us();
+        for (uint32_t i = 0; i < count; i++) {
+            // oldest first, stamped at the end of the readout
+            CHECK(batch[i].value > last);
+            CHECK_EQ(batch[i].value, batch[i].timestamp / 1000);
+            last = batch[i].value;
+            if (now - batch[i].timestamp > *max_latency_us) {
+                *max_latency_us = now - batch[i].timestamp;
+            }
+        }
+        total += count;
+    }
+    return total;
+}
+
+int main(void) {
+    hx711_stream_t stream;
+    uint32_t latency;
+
+    hx711_sim_reset(10);
+    hx711_sim_set_input(input);
+    HX711_init(128);
+
+    // 80 SPS, drained every 100 ms: every conversion arrives, none waits longer than a drain period
+    CHECK(hx711_stream_start(&stream, HX711_get_default(), 80));
+    uint32_t count = drain(&stream, 100000, 2000000, &latency);
+    printf("80 SPS: %u samples in 2 s, max latency %u us\n", count, latency);
+    // the conversion in progress when the rate changes completes at the old rate, and the output settles
+    CHECK_NEAR(count, 2 * 80 - 80 * HX711_SETTLE_MS_80SPS / 1000, 100000 / 12500);
+    CHECK(latency <= 100000);
+    CHECK_EQ(hx711_stream_overruns(&stream), 0);
+
+    // another read is refused while streaming, and a stream while another read is armed
+    CHECK(!hx711_read_async(HX711_get_default(), 0));
+    hx711_stream_t other;
+    CHECK(!hx711_stream_start(&other, HX711_get_default(), 80));
+    CHECK(HX711_get_default()->user == &stream);
+
+    // no drain for 1 s: the buffer keeps the oldest samples, the others are counted as overruns
+    hx711_sim_advance(1000000);
+    CHECK_EQ(hx711_stream_count(&stream), HX711_STREAM_SIZE);
+    CHECK_EQ(hx711_stream_overruns(&stream), 80 - HX711_STREAM_SIZE);
+    CHECK_EQ(hx711_stream_overruns(&stream), 0);
+    hx711_stream_flush(&stream);
+    CHECK_EQ(hx711_stream_count(&stream), 0);
+
+    // once stopped, no sample is added
+    hx711_stream_stop(&stream);
+    hx711_sim_advance(500000);
+    CHECK_EQ(hx711_stream_count(&stream), 0);
+    CHECK(!hx711_is_busy(HX711_get_default()));
+
+    // 10 SPS, drained every 250 ms
+    CHECK(hx711_stream_start(&stream, HX711_get_default(), 10));
+    count = drain(&stream, 250000, 2000000, &latency);
+    printf("10 SPS: %u samples in 2 s, max latency %u us\n", count, latency);
+    CHECK_NEAR(count, 2 * 10 - 10 * HX711_SETTLE_MS_10SPS / 1000, 1);
+    CHECK(latency <= 250000);
+    CHECK_EQ(hx711_stream_overruns(&stream), 0);
+    hx711_stream_stop(&stream);
+
+    return test_result();
+}
@@ -0,0 +1,95 @@
+#include "hx711.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// temperature compensation on a synthetic drift trace: the simulated chip drifts in zero and span with its
+// temperature, from the reference temperature to an oven and a cold window; the compensated weight stays
+// within a few counts, the uncompensated one is off by grams
+
+#define SCALE            375 // counts per gram
+#define EMPTY            2000
+#define REF_CELSIUS      25.0f
+#define ZERO_PER_DEGREE  40.0f
+#define SPAN_PPM         150.0f
+// the span drift of the empty scale reading is not modeled by the compensation: EMPTY * 150 ppm * 20 degC
+#define TOLERANCE_MG     50
+
+static long load;
+
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    (void)time_us;
+    (void)gain;
+    return EMPTY + load;
+}
+
+// maximum error over the trace, empty and with 1 kg at each temperature
+static int32_t trace_error(hx711_t *dev, const hx711_tempco_t *tempco) {
+    hx711_measurement_t result;
+    int32_t max_error = 0;
+
+    hx711_sim_set_temperature(REF_CELSIUS);
+    hx711_set_tempco(dev, tempco, 0);
+    load = 0;
+    CHECK(hx711_tare(dev, 5));
+
+    // 25 -> 45 degC (oven), 45 -> 5 degC (window), back to 25 degC
+    for (int step = 0; step <= 80; step++) {
+        float celsius = step <= 20 ? REF_CELSIUS + step : step <= 60 ? 65.0f - step : step - 55.0f;
+        hx711_sim_set_temperature(celsius);
+        for (int kg = 0; kg <= 1; kg++) {
+            load = kg * 1000 * SCALE;
+            CHECK(hx711_get_adaptive_mg(dev, 1000, 2, 5, &result));
+            int32_t error = result.mg - kg * 1000000;
+            if (error < 0) {
+                error = -error;
+            }
+            if (error > max_error) {
+                max_error = error;
+            }
+        }
+    }
+    return max_error;
+}
+
+// a calibration point captured away from the reference temperature: the counts of the reading corrected to
+// the reference temperature, as the table converts them
+static void check_capture(hx711_t *dev, const hx711_tempco_t *tempco) {
+    hx711_measurement_t result;
+
+    hx711_sim_set_temperature(REF_CELSIUS);
+    hx711_set_tempco(dev, tempco, 0);
+    load = 0;
+    CHECK(hx711_tare(dev, 5));
+
+    hx711_sim_set_temperature(45);
+    load = 500 * SCALE;
+    // the measurement samples the temperature
+    CHECK(hx711_get_adaptive_mg(dev, 1000, 2, 5, &result));
+    long raw;
+    CHECK(hx711_read(dev, &raw));
+    CHECK_NEAR(hx711_to_counts(dev, raw), 500 * SCALE, 8);
+}
+
+int main(void) {
+    static const hx711_tempco_t TEMPCO = { REF_CELSIUS, ZERO_PER_DEGREE, SPAN_PPM };
+
+    hx711_sim_reset(80);
+    hx711_sim_set_input(input);
+    hx711_sim_set_tempco(0, REF_CELSIUS, ZERO_PER_DEGREE, SPAN_PPM);
+    HX711_init(128);
+    hx711_t *dev = HX711_get_default();
+    hx711_set_rate(dev, 80);
+    hx711_set_scale(dev, SCALE);
+
+    int32_t uncompensated = trace_error(dev, 0);
+    int32_t compensated = trace_error(dev, &TEMPCO);
+    printf("max error over the trace: %ld mg uncompensated, %ld mg compensated\n", (long)uncompensated,
+           (long)compensated);
+    CHECK(uncompensated > 1000);
+    CHECK(compensated <= TOLERANCE_MG);
+
+    check_capture(dev, &TEMPCO);
+
+    return test_result();
+}
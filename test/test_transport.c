@@ -0,0 +1,86 @@
+#include "hx711.h"
+#include "hx711_platform.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// readout transports against the peripheral model of the simulation: the frame assembly is checked on
+// synthetic frames, and both transports must read the same conversions
+// built twice, with HX711_TRANSPORT set to HX711_TRANSPORT_GPIO and to HX711_TRANSPORT_USART
+
+static const long VALUES[] = { 0, 1, -1, 0x7FFFFF, -0x800000, 0x123456, -0x123456, 0x555555, -0x2AAAAB };
+#define VALUE_COUNT (sizeof(VALUES) / sizeof(VALUES[0]))
+
+// splits the 24 data bits and the extra clock pulses of a readout into frames of frame_bits bits,
+// the way the USART samples DOUT: it stays high after the 24th bit
+static uint8_t split(long value, uint8_t pulses, uint8_t frame_bits, uint16_t *frames) {
+    uint8_t count = (24 + pulses) / frame_bits;
+    uint8_t bit = 0;
+
+    for (uint8_t n = 0; n < count; n++) {
+        frames[n] = 0;
+        for (uint8_t i = 0; i < frame_bits; i++, bit++) {
+            uint8_t dout = bit < 24 ? ((uint32_t)value >> (23 - bit)) & 1 : 1;
+            frames[n] = (frames[n] << 1) | dout;
+        }
+    }
+    return count;
+}
+
+static void check_decode(void) {
+    // the frame layouts of the USART transport: 25 = 5 * 5, 26 = 2 * 13, 27 = 3 * 9
+    static const uint8_t LAYOUTS[][2] = { { 1, 5 }, { 2, 13 }, { 3, 9 } };
+    uint16_t frames[5];
+
+    for (uint8_t i = 0; i < VALUE_COUNT; i++) {
+        for (uint8_t l = 0; l < 3; l++) {
+            CHECK_EQ(split(VALUES[i], LAYOUTS[l][0], LAYOUTS[l][1], frames) * LAYOUTS[l][1], 24 + LAYOUTS[l][0]);
+            CHECK_EQ(HX711_decode(frames, LAYOUTS[l][1]), VALUES[i]);
+        }
+        // bytes of the GPIO transport
+        frames[0] = ((uint32_t)VALUES[i] >> 16) & 0xFF;
+        frames[1] = ((uint32_t)VALUES[i] >> 8) & 0xFF;
+        frames[2] = (uint32_t)VALUES[i] & 0xFF;
+        CHECK_EQ(HX711_decode(frames, 8), VALUES[i]);
+    }
+}
+
+// walks through the test values, a different one per conversion and channel
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    return VALUES[(time_us / 100000 + gain) % VALUE_COUNT];
+}
+
+static void check_reads(void) {
+    static const uint8_t GAINS[] = { 128, 32, 64 };
+    hx711_sim_energy_t energy;
+
+    hx711_sim_reset(10);
+    hx711_sim_set_input(input);
+    HX711_init(128);
+
+    for (uint8_t g = 0; g < 3; g++) {
+        HX711_set_gain(GAINS[g]);
+        for (uint8_t i = 0; i < 2 * VALUE_COUNT; i++) {
+            hx711_sim_energy_reset();
+            long value;
+            CHECK(HX711_read(&value));
+            CHECK_EQ(value, input(0, hx711_sim_time_us(), GAINS[g]));
+            CHECK_EQ(hx711_sim_gain(0), GAINS[g]);
+
+            // the USART clocks the readout while the CPU sleeps in EM1
+            hx711_sim_energy(&energy);
+            CHECK_EQ(energy.readouts, 1);
+#if HX711_TRANSPORT == HX711_TRANSPORT_USART
+            CHECK(energy.em1_us > 0);
+#else
+            CHECK_EQ(energy.em1_us, 0);
+#endif
+        }
+    }
+}
+
+int main(void) {
+    check_decode();
+    check_reads();
+    return test_result();
+}
@@ -0,0 +1,125 @@
+#include "hx711.h"
+#include "hx711_filter.h"
+#include "hx711_sim.h"
+#include "test.h"
+
+// validation of the readings: a faulty reading is rejected and the next conversion is read instead;
+// after HX711_MAX_REJECTS rejects in a row the read fails, the faulty reading is reported with its faults
+// and does not reach the filter, the averages or the offset
+
+#define PERIOD_US   100000 // 10 SPS
+
+static uint8_t saturated;
+
+static long input(uint8_t chip, uint64_t time_us, uint8_t gain) {
+    (void)chip;
+    (void)gain;
+    // a new value every conversion, so that the readings are not taken for a stuck sensor
+    return saturated ? 0x7FFFFF : 1000 + (long)(time_us / PERIOD_US);
+}
+
+static int calls;
+static long value;
+static uint8_t faults;
+
+static void read_cb(hx711_t *dev, long v) {
+    calls++;
+    value = v;
+    faults = hx711_get_faults(dev);
+}
+
+static int measured;
+static hx711_measurement_t measurement;
+
+static void measure_cb(hx711_t *dev, const hx711_measurement_t *result) {
+    (void)dev;
+    measured++;
+    measurement = *result;
+}
+
+int main(void) {
+    hx711_t dev;
+    hx711_filter_t filter;
+    hx711_health_t health;
+    long reading;
+
+    hx711_sim_reset(10);
+    hx711_sim_set_input(input);
+    hx711_init(&dev, 0, 0, 0, 0, 128);
+    hx711_filter_init_none(&filter);
+    hx711_set_filter(&dev, &filter);
+    hx711_set_validation(&dev, 0, 0);
+
+    // a valid reading is delivered without faults
+    CHECK(hx711_read(&dev, &reading));
+    CHECK_EQ(hx711_get_faults(&dev), 0);
+    CHECK_EQ(hx711_get_filtered(&dev), reading);
+    long last = reading;
+
+    // a saturated chip: the rejected readings are retried, then the read fails with their faults
+    saturated = 1;
+    uint64_t start = hx711_sim_time_us();
+    CHECK(!hx711_read(&dev, &reading));
+    CHECK_EQ(reading, last);
+    CHECK_EQ(hx711_get_faults(&dev), HX711_FAULT_SATURATED);
+    CHECK(hx711_sim_time_us() - start <= (HX711_MAX_REJECTS + 1) * PERIOD_US);
+    hx711_get_health(&dev, &health);
+    CHECK_EQ(health.rejected, HX711_MAX_REJECTS);
+    CHECK_EQ(health.saturated, HX711_MAX_REJECTS + 1);
+    CHECK_EQ(health.status, HX711_FAULT_SATURATED);
+    // the faulty reading did not reach the filter
+    CHECK_EQ(hx711_get_filtered(&dev), last);
+
+    // the asynchronous read completes with the faults too
+    calls = 0;
+    CHECK(hx711_read_async(&dev, read_cb));
+    hx711_sim_advance((HX711_MAX_REJECTS + 1) * PERIOD_US);
+    CHECK_EQ(calls, 1);
+    CHECK_EQ(value, 0x7FFFFF);
+    CHECK_EQ(faults, HX711_FAULT_SATURATED);
+    CHECK_EQ(hx711_get_filtered(&dev), last);
+
+    // the measurements fail with the faults as their status, the tares leave the offset unchanged
+    measured = 0;
+    CHECK(hx711_measure_async(&dev, 10, 2, 10, measure_cb));
+    hx711_sim_advance((HX711_MAX_REJECTS + 1) * PERIOD_US);
+    CHECK_EQ(measured, 1);
+    CHECK_EQ(measurement.status, HX711_FAULT_SATURATED);
+    CHECK_EQ(measurement.count, 0);
+    CHECK(!hx711_is_busy(&dev));
+
+    hx711_set_offset(&dev, 500);
+    CHECK(hx711_tare_async(&dev, 4, measure_cb));
+    hx711_sim_advance((HX711_MAX_REJECTS + 1) * PERIOD_US);
+    CHECK_EQ(measured, 2);
+    CHECK_EQ(measurement.status, HX711_FAULT_SATURATED);
+    CHECK_EQ(hx711_get_offset(&dev), 500);
+    CHECK(!hx711_tare(&dev, 4));
+    CHECK_EQ(hx711_get_offset(&dev), 500);
+
+    // a measurement which loses the chip midway fails as well
+    saturated = 0;
+    CHECK(hx711_measure_async(&dev, 0, 10, 10, measure_cb));
+    hx711_sim_advance(3 * PERIOD_US);
+    CHECK_EQ(measured, 2);
+    saturated = 1;
+    hx711_sim_advance((HX711_MAX_REJECTS + 1) * PERIOD_US);
+    CHECK_EQ(measured, 3);
+    CHECK_EQ(measurement.status, HX711_FAULT_SATURATED);
+    CHECK(measurement.count >= 2 && measurement.count < 10);
+
+    // a single faulty reading is only retried: the read succeeds
+    CHECK(hx711_read_async(&dev, read_cb));
+    hx711_sim_advance(PERIOD_US);
+    saturated = 0;
+    hx711_sim_advance(2 * PERIOD_US);
+    CHECK_EQ(calls, 2);
+    CHECK_EQ(faults, 0);
+    CHECK(value != 0x7FFFFF);
+    CHECK_EQ(hx711_get_filtered(&dev), value);
+    CHECK(hx711_read(&dev, &reading));
+    CHECK(hx711_tare(&dev, 4));
+    CHECK(hx711_get_offset(&dev) != 500);
+
+    return test_result();
+}